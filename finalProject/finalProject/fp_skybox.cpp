@@ -7,6 +7,9 @@ static int windowHeight = 768;
 static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode);
 static void cursor_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+static void handleKey(int key, int scancode, int action, int mode);
+static void handleCursor(double xpos, double ypos);
+static void handleScroll(double xoffset, double yoffset);
 // Camera setup
 glm::vec3 eye_center(0.0f, 0.0f, 0.0f); // Set the camera position higher and further away
 glm::vec3 lookat(0.0f, 0.0f, -1.0f); // Look at the center of the scene
@@ -31,25 +34,121 @@ static glm::vec3 lightPosition(-275.0f, 500.0f, -275.0f);
 static float viewAzimuth = 0.f;
 static float viewPolar = 0.f;
 static float viewDistance = 500.0f;
+static float cursorLastX = 1024.0f / 2.0;
+static float cursorLastY = 768.0f / 2.0;
+static bool firstMouse = true;
 
 // Shadow mapping
-static glm::vec3 lightUp(0.0f, -1.0f, 0.0f); //Light facing down
-GLuint shadowFBO;
-glm::vec3 boxCenter(-275.0f, 274.4f, -279.6f);
-GLuint depthTexture;
+// The sun is treated as a directional light shining from lightPosition towards the origin
+static glm::vec3 lightDirection = glm::normalize(-lightPosition);
+static SHIrradiance skyIrradiance;      // Ambient light projected from the skybox image
+static bool cacheSkyIrradiance = true;  // Stores the projection next to the image
+static CascadedShadowMap shadowMaps;
 GLuint depthProgramID;
-GLuint lightSpaceMatrixLocation;
-glm::mat4 lightSpaceMatrix;
-static int shadowMapWidth = 1024;
-static int shadowMapHeight = 1024;
-
-// View Parameters
-static float depthFoV = 90.0f;
-static float depthNear = 90.0f;
-static float depthFar = 1000.0f;
-
-// Helper flag and function to save depth maps for debugging
-static bool saveDepth = false;
+static int shadowMapWidth = 2048;
+static int shadowMapHeight = 2048;
+static int numShadowCascades = 4;
+static float shadowDistance = 3000.0f;  // Shadows fade out beyond this view distance
+static int shadowFilter = SHADOW_FILTER_PCF2X2;  // Cycled with the T key
+
+// GPU timings of the shadow and scene passes, to compare shadow filter tiers.
+// In the deferred path the scene timer covers the G-buffer only, and the
+// lighting timer the point lights, sky and composite.
+static GpuTimer shadowPassTimer;
+static GpuTimer scenePassTimer;
+static GpuTimer lightingPassTimer;
+
+// Adaptive quality. The governor holds a frame time target, by default the
+// 15 FPS floor, from the CPU time of the main thread and the GPU time of the frame.
+static QualityGovernor governor;
+static GpuFrameTimer frameGpuTimer;
+static double qualityTargetMs = 1000.0 / 15.0;  // --quality-target <ms>, 0 turns the governor off
+static bool hasQualityTarget = false;
+static std::string qualityLogPath;              // --quality-log <path>, one CSV row per decision
+
+// Dynamic resolution. The scene is rendered at this scale times the governor's
+// into the corner of targets that keep the window size, and the resolve
+// sharpens it on the way up to the window.
+static float renderScale = 1.0f;                // --render-scale <scale>
+static float upscaleSharpness = 0.5f;           // --sharpness <0-1>
+
+// Deferred shading with point lights on the buildings and rockets
+static DeferredRenderer deferred;
+static bool useDeferred = true;     // Toggled with the G key, forward rendering is the fallback
+static int maxPointLights = 512;
+
+// Screen-space ambient occlusion for the deferred path
+static SSAO ssao;
+static int ssaoPreset = SSAO_PRESET_MEDIUM;    // Cycled with the Y key
+
+// Depth pre-pass for the opaque boxes, and overdraw instrumentation
+static bool useDepthPrePass = true;     // Toggled with the Z key
+static bool countFragments = false;     // Toggled with the O key
+static FragmentCounter fragmentCounter;
+
+// Uniform buffers: the frame block is written once per frame, object and
+// skin blocks go through the ring
+static FrameUniformBuffer frameUniforms;
+static UniformRing uniformRing;
+static const GLsizeiptr uniformRingSize = 4 << 20;
+static std::vector<ObjectUniforms> objectConstants;     // Scratch for one draw list
+static UniformStats lastUniformStats;                   // Uniform traffic of the last frame
+
+// Shadowed GL state, redundant binds and toggles never reach the driver
+static GLStateStats lastStateStats;     // Cached calls of the last frame
+static bool validateState = false;      // --validate-gl-state, compare the cache against glGet* every frame
+
+// Draw, switch and upload counters of the instrumentation build (FP_GL_STATS)
+static GLCallStats lastCallStats;       // Counts of the last frame
+static GLCallLog glCallLog;
+static std::string glStatsOutput;       // --gl-stats <path>, one CSV row per frame
+
+// Frame profiler, written as a Chrome trace. Started with --profile <frames> or the F key.
+static Profiler profiler;
+static int profileFrames = 0;
+static std::string profileOutput = "profile.json";
+
+// Linear HDR scene target, tone mapped once per pixel into the window
+static HDRTarget hdrTarget;
+static bool useSRGBFramebuffer = false;     // --srgb, encode in hardware instead of the resolve shader
+
+// Helper flags and function to save depth maps and screenshots for debugging
+static bool saveDepth = false;      // Space key
+static bool saveScreenshot = false; // P key
+static AsyncReadback readback;
+
+// Frame sequence capture, enabled with --capture <frames>
+static FrameCapture capture;
+static int captureFrames = 0;
+static CaptureFormat captureFormat = CAPTURE_PNG;
+static std::string captureOutput;
+static int captureFps = 30;     // Also the fixed simulation rate while capturing
+
+// Scene size and layout. Interactive runs seed from the clock unless --seed is given.
+static int numBuildings = 200;
+static int numRockets = 20;
+static int numBots = 1;
+static const int maxBuildings = 750;            // Random placement jams at 850 to 900 in the 2000 x 2000 area
+static const int maxPlacementAttempts = 10000;  // Random spots tried for one object before the city counts as full
+static unsigned int sceneSeed = 0;
+static bool hasSceneSeed = false;
+static std::string saveScenePath;   // --save-scene <path> writes the generated city here
+static std::string loadScenePath;   // --load-scene <path> replaces generation with a saved city
+
+// Headless benchmark, enabled with --bench <frames>
+static Benchmark benchmark;
+static int benchFrames = 0;
+static int benchWarmupFrames = 30;
+static const float fixedFrameTime = 1.0f / 60.0f;  // Simulation step of benchmarks and replays
+static std::string benchOutput;                     // JSON file, stdout when empty
+static std::vector<int> sweepBuildings;             // Scene sizes to sweep, empty for the single size
+static std::vector<int> sweepRockets;
+static std::vector<int> sweepBots;
+
+// Input recording and replay of camera sessions, --record <path> and --replay <path>
+static InputLog inputLog;
+static std::string recordPath;
+static std::string replayPath;
 
 // Animation
 static bool playAnimation = true;
@@ -57,26 +156,20 @@ static float playbackSpeed = 2.0f;
 
 
 // This function retrieves and stores the depth map of the default frame buffer
-// or a particular frame buffer (indicated by FBO ID) to a PNG image.
+// or a particular frame buffer (indicated by FBO ID) to a PNG image. The copy
+// is asynchronous, the file is written a few frames later by a worker thread.
 static void saveDepthTexture(GLuint fbo, std::string filename) {
     int width = shadowMapWidth;
     int height = shadowMapHeight;
-    if (shadowMapWidth == 0 || shadowMapHeight == 0) {
+    if (fbo == hdrTarget.fbo) {
+        width = hdrTarget.width;
+        height = hdrTarget.height;
+    } else if (fbo == 0 || shadowMapWidth == 0 || shadowMapHeight == 0) {
         width = windowWidth;
         height = windowHeight;
     }
-    int channels = 3;
-
-    std::vector<float> depth(width * height);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    glReadBuffer(GL_DEPTH_COMPONENT);
-    glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, depth.data());
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    std::vector<unsigned char> img(width * height * 3);
-    for (int i = 0; i < width * height; ++i) img[3 * i] = img[3 * i + 1] = img[3 * i + 2] = depth[i] * 255;
 
-    stbi_write_png(filename.c_str(), width, height, channels, img.data(), width * channels);
+    readback.savePNG(fbo, READBACK_DEPTH, width, height, filename);
 }
 
 struct Skybox {
@@ -184,12 +277,10 @@ struct Skybox {
     GLuint vertexArrayID;
     GLuint vertexBufferID;
     GLuint indexBufferID;
-    GLuint colorBufferID;
     GLuint uvBufferID;
     GLuint textureID;
 
     // Shader variable IDs
-    GLuint mvpMatrixID;
     GLuint textureSamplerID;
     GLuint programID;
 
@@ -207,15 +298,14 @@ struct Skybox {
         glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
+        // skybox.vert reads the UVs from location 2, location 1 (colour) is left unused
         glGenBuffers(1, &uvBufferID);
         glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
         glBufferData(GL_ARRAY_BUFFER, sizeof(uv_buffer_data), uv_buffer_data, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
 
         // Create an index buffer object to store the index data that defines triangle faces
         glGenBuffers(1, &indexBufferID);
@@ -228,31 +318,19 @@ struct Skybox {
             std::cerr << "Failed to load shaders." << std::endl;
         }
 
-        // Get a handle for our "MVP" uniform
-        mvpMatrixID = glGetUniformLocation(programID, "MVP");
-
         //  Load a texture
         textureID = LoadTextureTileBox(texturePath);
 
-        // Get a handle to texture sampler
+        // Get a handle to texture sampler, which always reads texture unit 0
         textureSamplerID = glGetUniformLocation(programID, "textureSampler");
+        glUseProgram(programID);
+        glUniform1i(textureSamplerID, 0);
     }
 
     void render(glm::mat4 cameraMatrix) {
         glUseProgram(programID);
-
         glBindVertexArray(vertexArrayID);
 
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-
         // Model transform
         glm::mat4 modelMatrix = glm::mat4(1.0f);
         modelMatrix = glm::translate(modelMatrix, position);
@@ -262,18 +340,14 @@ struct Skybox {
         modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, 0.5f, 0.0f));
 
         // Set model-view-projection matrix
-        glm::mat4 mvp = cameraMatrix * modelMatrix;
-        glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
-
-        // Enable UV buffer and texture sampler
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        ObjectUniforms object;
+        object.mvp = cameraMatrix * modelMatrix;
+        object.model = modelMatrix;
+        GLintptr offset = uniformRing.upload(&object, 1, sizeof(ObjectUniforms));
+        uniformRing.bind(OBJECT_UNIFORM_BINDING, offset, 0, sizeof(ObjectUniforms));
 
-        // Set textureSampler to use texture unit 0
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glUniform1i(textureSamplerID, 0);
 
         // Draw the box
         glDrawElements(
@@ -282,15 +356,10 @@ struct Skybox {
                 GL_UNSIGNED_INT,   // type
                 (void*)0           // element array buffer offset
         );
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
     }
 
     void cleanup() {
         glDeleteBuffers(1, &vertexBufferID);
-        glDeleteBuffers(1, &colorBufferID);
         glDeleteBuffers(1, &indexBufferID);
         glDeleteVertexArrays(1, &vertexArrayID);
         glDeleteBuffers(1, &uvBufferID);
@@ -299,198 +368,129 @@ struct Skybox {
     }
 };
 
-struct Building {
-    glm::vec3 position;		// Position of the box
-    glm::vec3 scale;		// Size of the box in each axis
-    glm::vec3 dimensions;
-    void setTexture(GLuint tex) {
-        textureID = tex;
-    }
-    GLfloat vertex_buffer_data[72] = {	// Vertex definition for a canonical box
-            // Front face
-            -1.0f, -1.0f, 1.0f,
-            1.0f, -1.0f, 1.0f,
-            1.0f, 1.0f, 1.0f,
-            -1.0f, 1.0f, 1.0f,
-
-            // Back face
-            1.0f, -1.0f, -1.0f,
-            -1.0f, -1.0f, -1.0f,
-            -1.0f, 1.0f, -1.0f,
-            1.0f, 1.0f, -1.0f,
-
-            // Left face
-            -1.0f, -1.0f, -1.0f,
-            -1.0f, -1.0f, 1.0f,
-            -1.0f, 1.0f, 1.0f,
-            -1.0f, 1.0f, -1.0f,
-
-            // Right face
-            1.0f, -1.0f, 1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f, 1.0f, -1.0f,
-            1.0f, 1.0f, 1.0f,
-
-            // Top face
-            -1.0f, 1.0f, 1.0f,
-            1.0f, 1.0f, 1.0f,
-            1.0f, 1.0f, -1.0f,
-            -1.0f, 1.0f, -1.0f,
-
-            // Bottom face
-            -1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f, 1.0f,
-            -1.0f, -1.0f, 1.0f,
-    };
-
-    GLfloat color_buffer_data[72] = {
-            // Front, red
-            1.0f, 0.0f, 0.0f,
-            1.0f, 0.0f, 0.0f,
-            1.0f, 0.0f, 0.0f,
-            1.0f, 0.0f, 0.0f,
-
-            // Back, yellow
-            1.0f, 1.0f, 0.0f,
-            1.0f, 1.0f, 0.0f,
-            1.0f, 1.0f, 0.0f,
-            1.0f, 1.0f, 0.0f,
-
-            // Left, green
-            0.0f, 1.0f, 0.0f,
-            0.0f, 1.0f, 0.0f,
-            0.0f, 1.0f, 0.0f,
-            0.0f, 1.0f, 0.0f,
-
-            // Right, cyan
-            0.0f, 1.0f, 1.0f,
-            0.0f, 1.0f, 1.0f,
-            0.0f, 1.0f, 1.0f,
-            0.0f, 1.0f, 1.0f,
-
-            // Top, blue
-            0.0f, 0.0f, 1.0f,
-            0.0f, 0.0f, 1.0f,
-            0.0f, 0.0f, 1.0f,
-            0.0f, 0.0f, 1.0f,
-
-            // Bottom, magenta
-            1.0f, 0.0f, 1.0f,
-            1.0f, 0.0f, 1.0f,
-            1.0f, 0.0f, 1.0f,
-            1.0f, 0.0f, 1.0f,
-    };
-
-    GLuint index_buffer_data[36] = {		// 12 triangle faces of a box
-            0, 1, 2,
-            0, 2, 3,
-
-            4, 5, 6,
-            4, 6, 7,
-
-            8, 9, 10,
-            8, 10, 11,
+// The city's buildings as a structure of arrays, 28 bytes per building. They
+// all draw the one shared box mesh below, placed by their object uniforms.
+struct Buildings {
+    std::vector<glm::vec3> positions;   // Centre of the box
+    std::vector<glm::vec3> scales;      // Half extents of the box
+    std::vector<uint32_t> textures;     // Index into the building texture list
 
-            12, 13, 14,
-            12, 14, 15,
+    size_t size() const {
+        return positions.size();
+    }
 
-            16, 17, 18,
-            16, 18, 19,
+    // New buildings sit at the origin with no size until they are placed
+    void resize(size_t count) {
+        positions.resize(count, glm::vec3(0.0f));
+        scales.resize(count, glm::vec3(0.0f));
+        textures.resize(count, 0);
+    }
 
-            20, 21, 22,
-            20, 22, 23,
-    };
+    void clear() {
+        positions.clear();
+        scales.clear();
+        textures.clear();
+    }
 
-    GLfloat uv_buffer_data[48] = {
-            // Front
-            0.0f, 1.0f,
-            1.0f, 1.0f,
-            1.0f, 0.0f,
-            0.0f, 0.0f,
+    glm::mat4 getModelMatrix(size_t i) const {
+        glm::mat4 modelMatrix = glm::mat4();
+        modelMatrix = glm::translate(modelMatrix, positions[i]); // Translate to the building's position
+        modelMatrix = glm::scale(modelMatrix, scales[i]);        // Scale the building
+        return modelMatrix;
+    }
 
-            // Back
-            0.0f, 1.0f,
-            1.0f, 1.0f,
-            1.0f, 0.0f,
-            0.0f, 0.0f,
-            // Left
-            0.0f, 1.0f,
-            1.0f, 1.0f,
-            1.0f, 0.0f,
-            0.0f, 0.0f,
-            // Right
-            0.0f, 1.0f,
-            1.0f, 1.0f,
-            1.0f, 0.0f,
-            0.0f, 0.0f,
+    // World-space bounds of the canonical box after scaling
+    void getBounds(size_t i, glm::vec3 &boxMin, glm::vec3 &boxMax) const {
+        boxMin = positions[i] - scales[i];
+        boxMax = positions[i] + scales[i];
+    }
 
-            // Top - we do not want texture the top
-            0.0f, 0.0f,
-            0.0f, 0.0f,
-            0.0f, 0.0f,
-            0.0f, 0.0f,
-            // Bottom - we do not want texture the bottom
-            0.0f, 0.0f,
-            0.0f, 0.0f,
-            0.0f, 0.0f,
-            0.0f, 0.0f,
-    };
+    // Object constants for a draw of building i, placed by a view-projection
+    ObjectUniforms getObjectUniforms(size_t i, const glm::mat4 &cameraMatrix) const {
+        ObjectUniforms object;
+        object.model = getModelMatrix(i);
+        object.mvp = cameraMatrix * object.model;
+        return object;
+    }
+};
 
-    // OpenGL buffers
+// The canonical box every building is drawn with, its forward program and
+// the building textures. Uploaded once, however many buildings there are.
+struct BuildingMesh {
     GLuint vertexArrayID;
     GLuint vertexBufferID;
-    GLuint indexBufferID;
-    GLuint colorBufferID;
     GLuint uvBufferID;
-    GLuint textureID;
+    GLuint indexBufferID;
+    std::vector<GLuint> textures;   // Indexed by Buildings::textures
 
-    // Shader variable IDs
-    GLuint mvpMatrixID;
+    // Shader variable IDs. The matrices, light and sky come from uniform blocks.
     GLuint textureSamplerID;
     GLuint programID;
 
-    glm::vec3 getPosition() const {
-        return position;
-    }
-
-    glm::vec3 getSize() const {
-        return dimensions;
-    }
-
-    void initialize(glm::vec3 position, glm::vec3 scale) {
-        // Define scale of the building geometry
-        this->position = position;
-        this->scale = scale;
-
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // Set the background color to baby blue
-
+    // GPU memory of the buffers, shared by every building
+    size_t gpuBytes;
+
+    void initialize(const std::vector<GLuint> &textures) {
+        static const GLfloat vertex_buffer_data[72] = {
+                // Front face
+                -1.0f, -1.0f, 1.0f,   1.0f, -1.0f, 1.0f,    1.0f, 1.0f, 1.0f,     -1.0f, 1.0f, 1.0f,
+                // Back face
+                1.0f, -1.0f, -1.0f,   -1.0f, -1.0f, -1.0f,  -1.0f, 1.0f, -1.0f,   1.0f, 1.0f, -1.0f,
+                // Left face
+                -1.0f, -1.0f, -1.0f,  -1.0f, -1.0f, 1.0f,   -1.0f, 1.0f, 1.0f,    -1.0f, 1.0f, -1.0f,
+                // Right face
+                1.0f, -1.0f, 1.0f,    1.0f, -1.0f, -1.0f,   1.0f, 1.0f, -1.0f,    1.0f, 1.0f, 1.0f,
+                // Top face
+                -1.0f, 1.0f, 1.0f,    1.0f, 1.0f, 1.0f,     1.0f, 1.0f, -1.0f,    -1.0f, 1.0f, -1.0f,
+                // Bottom face
+                -1.0f, -1.0f, -1.0f,  1.0f, -1.0f, -1.0f,   1.0f, -1.0f, 1.0f,    -1.0f, -1.0f, 1.0f,
+        };
+
+        // The facades tile five times vertically, the top and bottom are not textured
+        static const GLfloat uv_buffer_data[48] = {
+                0.0f, 5.0f,  1.0f, 5.0f,  1.0f, 0.0f,  0.0f, 0.0f,    // Front
+                0.0f, 5.0f,  1.0f, 5.0f,  1.0f, 0.0f,  0.0f, 0.0f,    // Back
+                0.0f, 5.0f,  1.0f, 5.0f,  1.0f, 0.0f,  0.0f, 0.0f,    // Left
+                0.0f, 5.0f,  1.0f, 5.0f,  1.0f, 0.0f,  0.0f, 0.0f,    // Right
+                0.0f, 0.0f,  0.0f, 0.0f,  0.0f, 0.0f,  0.0f, 0.0f,    // Top
+                0.0f, 0.0f,  0.0f, 0.0f,  0.0f, 0.0f,  0.0f, 0.0f,    // Bottom
+        };
+
+        static const GLuint index_buffer_data[36] = {		// 12 triangle faces of a box
+                0, 1, 2,     0, 2, 3,
+                4, 5, 6,     4, 6, 7,
+                8, 9, 10,    8, 10, 11,
+                12, 13, 14,  12, 14, 15,
+                16, 17, 18,  16, 18, 19,
+                20, 21, 22,  20, 22, 23,
+        };
+
+        this->textures = textures;
 
         // Create a vertex array object
         glGenVertexArrays(1, &vertexArrayID);
         glBindVertexArray(vertexArrayID);
 
-        // Create a vertex buffer object to store the vertex data
+        // Positions and UVs. The shaders do not read the vertex colour the boxes used to carry.
         glGenBuffers(1, &vertexBufferID);
         glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
-        // Create a vertex buffer object to store the color data
-        glGenBuffers(1, &colorBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(color_buffer_data), color_buffer_data, GL_STATIC_DRAW);
-
-        // Create a vertex buffer object to store the UV data
-        for (int i = 0; i < 24; ++i) uv_buffer_data[2*i+1] *= 5;
         glGenBuffers(1, &uvBufferID);
         glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(uv_buffer_data), uv_buffer_data,
-                     GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(uv_buffer_data), uv_buffer_data, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
 
         // Create an index buffer object to store the index data that defines triangle faces
         glGenBuffers(1, &indexBufferID);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
+        glBindVertexArray(0);
+
+        gpuBytes = sizeof(vertex_buffer_data) + sizeof(uv_buffer_data) + sizeof(index_buffer_data);
 
         // Create and compile our GLSL program from the shaders
         programID = LoadShadersFromFile("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\box.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\box.frag");
@@ -499,69 +499,26 @@ struct Building {
             std::cerr << "Failed to load shaders." << std::endl;
         }
 
-        // Get a handle for our "MVP" uniform
-        mvpMatrixID = glGetUniformLocation(programID, "MVP");
-
         // Get a handle to texture sampler
         textureSamplerID = glGetUniformLocation(programID,"textureSampler");
-    }
-
 
-    void render(glm::mat4 cameraMatrix) {
+        // Texture units never change, so the samplers are set once
         glUseProgram(programID);
-
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-
-
-        // Enable UV buffer and texture sampler
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textureID);
         glUniform1i(textureSamplerID, 0);
-
-        // Model transform
-        glm::mat4 modelMatrix = glm::mat4();
-        modelMatrix = glm::translate(modelMatrix, position); // Translate to the building's position
-        modelMatrix = glm::scale(modelMatrix, scale);        // Scale the building
-
-        // Set model-view-projection matrix
-        glm::mat4 mvp = cameraMatrix * modelMatrix;
-        glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
-
-        // Draw the box
-        glDrawElements(
-                GL_TRIANGLES,      // mode
-                36,                // number of indices
-                GL_UNSIGNED_INT,   // type
-                (void*)0           // element array buffer offset
-        );
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        setShadowSamplers(programID, SHADOW_TEXTURE_UNIT, SHADOW_DEPTH_TEXTURE_UNIT);
     }
 
     void cleanup() {
         glDeleteBuffers(1, &vertexBufferID);
-        glDeleteBuffers(1, &colorBufferID);
+        glDeleteBuffers(1, &uvBufferID);
         glDeleteBuffers(1, &indexBufferID);
         glDeleteVertexArrays(1, &vertexArrayID);
-        //glDeleteBuffers(1, &uvBufferID);
-        //glDeleteTextures(1, &textureID);
         glDeleteProgram(programID);
     }
 };
 
+static BuildingMesh buildingMesh;
+
 
 struct Rocket {
     glm::vec3 position;		// Position of the box
@@ -712,9 +669,8 @@ struct Rocket {
     GLuint uvBufferID;
     GLuint textureID;
 
-    // Shader variable IDs
-    GLuint mvpMatrixID;
-    GLuint textureSamplerID;
+    // Forward box program, shared with the buildings and owned by BuildingMesh.
+    // The matrices, light and sky come from uniform blocks.
     GLuint programID;
 
     glm::vec3 getPosition() const {
@@ -725,7 +681,21 @@ struct Rocket {
         return dimensions;
     }
 
-    void initialize(glm::vec3 position, glm::vec3 scale) {
+    glm::mat4 getModelMatrix() const {
+        glm::mat4 modelMatrix = glm::mat4();
+        modelMatrix = glm::translate(modelMatrix, position); // Translate to the building's position
+        modelMatrix = glm::scale(modelMatrix, scale);        // Scale the building
+        return modelMatrix;
+    }
+
+    // World-space bounds of the canonical box after scaling
+    void getBounds(glm::vec3 &boxMin, glm::vec3 &boxMax) const {
+        boxMin = position - scale;
+        boxMax = position + scale;
+    }
+
+    // The program is the forward box program, its samplers already set
+    void initialize(glm::vec3 position, glm::vec3 scale, GLuint programID) {
         // Define scale of the building geometry
         this->position = position;
         this->scale = scale;
@@ -741,11 +711,15 @@ struct Rocket {
         glGenBuffers(1, &vertexBufferID);
         glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
         // Create a vertex buffer object to store the color data
         glGenBuffers(1, &colorBufferID);
         glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
         glBufferData(GL_ARRAY_BUFFER, sizeof(color_buffer_data), color_buffer_data, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
         // Create a vertex buffer object to store the UV data
         // for (int i = 0; i < 24; ++i) uv_buffer_data[2*i+1] *= 5;
@@ -753,57 +727,32 @@ struct Rocket {
         glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
         glBufferData(GL_ARRAY_BUFFER, sizeof(uv_buffer_data), uv_buffer_data,
                      GL_STATIC_DRAW);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
 
         // Create an index buffer object to store the index data that defines triangle faces
         glGenBuffers(1, &indexBufferID);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
 
-        // Create and compile our GLSL program from the shaders
-        programID = LoadShadersFromFile("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\box.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\box.frag");
-        if (programID == 0)
-        {
-            std::cerr << "Failed to load shaders." << std::endl;
-        }
+        this->programID = programID;
+    }
 
-        // Get a handle for our "MVP" uniform
-        mvpMatrixID = glGetUniformLocation(programID, "MVP");
 
-        // Get a handle to texture sampler
-        textureSamplerID = glGetUniformLocation(programID,"textureSampler");
+    // Object constants for the draws below, placed by a view-projection
+    ObjectUniforms getObjectUniforms(const glm::mat4 &cameraMatrix) const {
+        ObjectUniforms object;
+        object.model = getModelMatrix();
+        object.mvp = cameraMatrix * object.model;
+        return object;
     }
 
-
-    void render(glm::mat4 cameraMatrix) {
+    // Shades the box, with its object uniforms and the shadow maps already bound
+    void render() {
         glUseProgram(programID);
-
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-
-
-        // Enable UV buffer and texture sampler
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        glBindVertexArray(vertexArrayID);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glUniform1i(textureSamplerID, 0);
-
-        // Model transform
-        glm::mat4 modelMatrix = glm::mat4();
-        modelMatrix = glm::translate(modelMatrix, position); // Translate to the building's position
-        modelMatrix = glm::scale(modelMatrix, scale);        // Scale the building
-
-        // Set model-view-projection matrix
-        glm::mat4 mvp = cameraMatrix * modelMatrix;
-        glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
 
         // Draw the box
         glDrawElements(
@@ -812,10 +761,20 @@ struct Rocket {
                 GL_UNSIGNED_INT,   // type
                 (void*)0           // element array buffer offset
         );
+    }
 
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+    // Draws only the positions of the box into the currently bound depth target
+    void renderDepth() {
+        glBindVertexArray(vertexArrayID);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void*)0);
+    }
+
+    // Draws the textured box into the G-buffer of the deferred renderer
+    void renderGeometry() {
+        glBindVertexArray(vertexArrayID);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void*)0);
     }
 
     void cleanup() {
@@ -825,197 +784,207 @@ struct Rocket {
         glDeleteVertexArrays(1, &vertexArrayID);
         //glDeleteBuffers(1, &uvBufferID);
         //glDeleteTextures(1, &textureID);
-        glDeleteProgram(programID);
     }
 };
 
-struct MyBot {
-    // Shader variable IDs
-    GLuint mvpMatrixID;
-    GLuint jointMatricesID;
-    GLuint lightPositionID;
-    GLuint lightIntensityID;
+// One character type, compiled from a glTF file into what animating and
+// drawing its bots needs: the node hierarchy, the skin, the animation clips
+// and the draw list. The parsed model and its raw buffers are released once
+// the geometry is on the GPU. Bots share the asset and only keep their pose.
+struct BotAsset {
+    // Forward program. It and the ones below take the camera, light and joint
+    // matrices from uniform blocks.
     GLuint programID;
 
-    tinygltf::Model model;
+    // Skinned depth-only program for the shadow cascades
+    GLuint depthProgramID;
 
-    // Each VAO corresponds to each mesh primitive in the GLTF model
-    struct PrimitiveObject {
-        GLuint vao;
-        std::map<int, GLuint> vbos;
+    // Skinned program writing into the deferred G-buffer
+    GLuint gBufferProgramID;
+
+    // Local transform of a node, the rest pose or the one an animation sets
+    struct NodeState {
+        glm::vec3 translation;
+        glm::quat rotation;
+        glm::vec3 scale;
     };
-    std::vector<PrimitiveObject> primitiveObjects;
 
-    // Skinning
-    struct SkinObject {
-        // Transforms the geometry into the space of the respective joint
-        std::vector<glm::mat4> inverseBindMatrices;
+    // Hierarchy: the nodes reachable from the scene's roots, each listed after
+    // its parent, so global transforms are one pass over the list
+    struct HierarchyNode {
+        int node;
+        int parent;     // -1 for a root
+    };
+    std::vector<HierarchyNode> hierarchy;
+    std::vector<NodeState> restStates;      // One per node of the model
 
-        // Transforms the geometry following the movement of the joints
-        std::vector<glm::mat4> globalJointTransforms;
+    // Skinning, of the model's first skin
+    std::vector<int> jointNodes;
+    std::vector<glm::mat4> inverseBindMatrices;    // Into the space of the respective joint
 
-        // Combined transforms
-        std::vector<glm::mat4> jointMatrices;
-    };
-    std::vector<SkinObject> skinObjects;
+    // Animation, with each channel resolved to its node and property
+    enum ChannelPath { CHANNEL_TRANSLATION, CHANNEL_ROTATION, CHANNEL_SCALE };
 
-    // Animation
     struct SamplerObject {
         std::vector<float> input;
         std::vector<glm::vec3> outputVec3;
-        std::vector<glm::vec4> outputVec4;
-        int interpolation;
-    };
-
-    struct NodeState {
-        glm::vec3 translation;
-        glm::quat rotation;
-        glm::vec3 scale;
+        std::vector<glm::quat> outputQuat;
     };
 
-    std::vector<NodeState> nodeStates;
-
     struct ChannelObject {
         int sampler;
-        std::string targetPath;
         int targetNode;
+        ChannelPath path;
     };
+
     struct AnimationObject {
         std::vector<SamplerObject> samplers;	// Animation data
+        std::vector<ChannelObject> channels;
     };
-
     std::vector<AnimationObject> animationObjects;
 
-    glm::mat4 getNodeTransform(const tinygltf::Node& node) {
-        glm::mat4 transform(1.0f);
+    // Draw list, one entry per mesh primitive. The vertex array holds the
+    // attributes and the index buffer.
+    struct DrawObject {
+        GLuint vao;
+        GLenum mode;
+        GLsizei count;
+        GLenum indexType;
+        size_t indexOffset;
+    };
+    std::vector<DrawObject> drawObjects;
+    std::vector<GLuint> buffers;    // One per buffer view the primitives read
 
-        if (node.matrix.size() == 16) {
-            transform = glm::make_mat4(node.matrix.data());
-        } else {
-            if (node.translation.size() == 3) {
-                transform = glm::translate(transform, glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
-            }
-            if (node.rotation.size() == 4) {
-                glm::quat q(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
-                transform *= glm::mat4_cast(q);
-            }
-            if (node.scale.size() == 3) {
-                transform = glm::scale(transform, glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
-            }
-        }
-        return transform;
-    }
+    // Memory kept after loading. The resident figures are the growth of the
+    // process while the glTF was parsed and once it was released.
+    size_t cpuBytes;
+    size_t gpuBytes;
+    size_t residentParsedBytes;
+    size_t residentBytes;
 
-    void computeLocalNodeTransform(const tinygltf::Model& model,
-                                   int nodeIndex,
-                                   std::vector<glm::mat4> &localTransforms)
-    {
-        const tinygltf::Node &node = model.nodes[nodeIndex];
+    BotAsset() : programID(0), depthProgramID(0), gBufferProgramID(0), cpuBytes(0), gpuBytes(0),
+                 residentParsedBytes(0), residentBytes(0) {}
 
-        // get local transform for the current node
-        localTransforms[nodeIndex] = getNodeTransform(node);
+    bool loadModel(tinygltf::Model &model, const char *filename) {
+        tinygltf::TinyGLTF loader;
+        std::string err;
+        std::string warn;
 
-        // recursively compute transforms for all child nodes
-        for (int childIndex : node.children) {
-            computeLocalNodeTransform(model, childIndex, localTransforms);
+        bool res = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
+        if (!warn.empty()) {
+            std::cout << "WARN: " << warn << std::endl;
         }
-    }
-
-    void computeGlobalNodeTransform(const tinygltf::Model& model,
-                                    const std::vector<glm::mat4> &localTransforms,
-                                    int nodeIndex, const glm::mat4& parentTransform,
-                                    std::vector<glm::mat4> &globalTransforms)
-    {
-        // compute global transform for the current node
-        globalTransforms[nodeIndex] = parentTransform * localTransforms[nodeIndex];
 
-        // recursively compute global transforms for child nodes
-        const tinygltf::Node &node = model.nodes[nodeIndex];
-        for (int childIndex : node.children) {
-            computeGlobalNodeTransform(model, localTransforms, childIndex, globalTransforms[nodeIndex], globalTransforms);
+        if (!err.empty()) {
+            std::cout << "ERR: " << err << std::endl;
         }
-    }
-
-    std::vector<SkinObject> prepareSkinning(const tinygltf::Model &model) {
-        std::vector<SkinObject> skinObjects;
-
-        // In our Blender exporter, the default number of joints that may influence a vertex is set to 4, just for convenient implementation in shaders.
-
-        for (size_t i = 0; i < model.skins.size(); i++) {
-            SkinObject skinObject;
-
-            const tinygltf::Skin &skin = model.skins[i];
-
-            // Read inverseBindMatrices
-            const tinygltf::Accessor &accessor = model.accessors[skin.inverseBindMatrices];
-            assert(accessor.type == TINYGLTF_TYPE_MAT4);
-            const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-            const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-            const float *ptr = reinterpret_cast<const float *>(
-                    buffer.data.data() + accessor.byteOffset + bufferView.byteOffset);
-
-            skinObject.inverseBindMatrices.resize(accessor.count);
-            for (size_t j = 0; j < accessor.count; j++) {
-                float m[16];
-                memcpy(m, ptr + j * 16, 16 * sizeof(float));
-                skinObject.inverseBindMatrices[j] = glm::make_mat4(m);
-            }
-
-            assert(skin.joints.size() == accessor.count);
 
-            skinObject.globalJointTransforms.resize(skin.joints.size());
-            skinObject.jointMatrices.resize(skin.joints.size());
-
-            // Compute local transforms for all nodes
-            std::vector<glm::mat4> localTransforms(model.nodes.size(), glm::mat4(1.0f));
-            for (size_t i = 0; i < model.nodes.size(); ++i) {
-                localTransforms[i] = getNodeTransform(model.nodes[i]);
-            }
+        if (!res)
+            std::cout << "Failed to load glTF: " << filename << std::endl;
+        else
+            std::cout << "Loaded glTF: " << filename << std::endl;
 
-            // Compute global transforms starting from the scene's root nodes
-            std::vector<glm::mat4> globalTransforms(model.nodes.size(), glm::mat4(1.0f));
-            for (size_t i = 0; i < model.scenes[model.defaultScene].nodes.size(); ++i) {
-                computeGlobalNodeTransform(model, localTransforms, model.scenes[model.defaultScene].nodes[i], glm::mat4(1.0f), globalTransforms);
-            }
+        return res;
+    }
 
-            // Store global joint transforms
-            skinObject.globalJointTransforms.resize(model.nodes.size(), glm::mat4(1.0f));
-            for (size_t j = 0; j < skin.joints.size(); ++j) {
-                int nodeIndex = skin.joints[j];
-                skinObject.globalJointTransforms[nodeIndex] = globalTransforms[nodeIndex];
+    // Shrinks the model to the size of the scene
+    void scaleModel(tinygltf::Model &model) {
+        glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(2.0f)); // Adjust the scale factor as needed
+        for (auto& node : model.nodes) {
+            if (node.matrix.size() == 16) {
+                glm::mat4 nodeMatrix = glm::make_mat4(node.matrix.data());
+                nodeMatrix = scaleMatrix * nodeMatrix;
+                std::copy(glm::value_ptr(nodeMatrix), glm::value_ptr(nodeMatrix) + 16, node.matrix.begin());
+            } else {
+                // Apply scaling to translation, rotation, and scale if matrix is not present
+                if (node.translation.size() == 3) {
+                    node.translation[0] *= 0.1f;
+                    node.translation[1] *= 0.1f;
+                    node.translation[2] *= 0.1f;
+                }
+                if (node.scale.size() == 3) {
+                    node.scale[0] *= 0.1f;
+                    node.scale[1] *= 0.1f;
+                    node.scale[2] *= 0.1f;
+                }
             }
-            skinObjects.push_back(skinObject);
         }
+    }
 
-        return skinObjects;
+    void addHierarchyNodes(const tinygltf::Model &model, int nodeIndex, int parent) {
+        HierarchyNode entry;
+        entry.node = nodeIndex;
+        entry.parent = parent;
+        hierarchy.push_back(entry);
+        for (int childIndex : model.nodes[nodeIndex].children) {
+            addHierarchyNodes(model, childIndex, nodeIndex);
+        }
     }
 
-    int findKeyframeIndex(const std::vector<float>& times, float animationTime)
-    {
-        int left = 0;
-        int right = times.size() - 1;
+    void prepareHierarchy(const tinygltf::Model &model) {
+        const tinygltf::Scene &scene = model.scenes[model.defaultScene];
+        for (size_t i = 0; i < scene.nodes.size(); ++i) {
+            assert((scene.nodes[i] >= 0) && (scene.nodes[i] < model.nodes.size()));
+            addHierarchyNodes(model, scene.nodes[i], -1);
+        }
 
-        while (left <= right) {
-            int mid = (left + right) / 2;
+        // Animations only set translation, rotation and scale, so a node's
+        // matrix is not part of its pose
+        restStates.resize(model.nodes.size());
+        for (size_t i = 0; i < model.nodes.size(); ++i) {
+            const tinygltf::Node &node = model.nodes[i];
 
-            if (mid + 1 < times.size() && times[mid] <= animationTime && animationTime < times[mid + 1]) {
-                return mid;
+            NodeState &state = restStates[i];
+            // Translation
+            if (node.translation.size() == 3) {
+                state.translation = glm::vec3(node.translation[0], node.translation[1], node.translation[2]);
+            } else {
+                state.translation = glm::vec3(0.0f);
             }
-            else if (times[mid] > animationTime) {
-                right = mid - 1;
+            // Rotation
+            if (node.rotation.size() == 4) {
+                state.rotation = glm::quat(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
+            } else {
+                state.rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
             }
-            else { // animationTime >= times[mid + 1]
-                left = mid + 1;
+            // Scale
+            if (node.scale.size() == 3) {
+                state.scale = glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
+            } else {
+                state.scale = glm::vec3(1.0f);
             }
         }
+    }
 
-        // Target not found
-        return times.size() - 2;
+    void prepareSkinning(const tinygltf::Model &model) {
+        // In our Blender exporter, the default number of joints that may influence a vertex is set to 4, just for convenient implementation in shaders.
+        if (model.skins.empty()) return;
+        if (model.skins.size() > 1) {
+            std::cout << "WARN: only the first of " << model.skins.size() << " skins is used" << std::endl;
+        }
+        const tinygltf::Skin &skin = model.skins[0];
+
+        // Read inverseBindMatrices
+        const tinygltf::Accessor &accessor = model.accessors[skin.inverseBindMatrices];
+        assert(accessor.type == TINYGLTF_TYPE_MAT4);
+        const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+        const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+        const float *ptr = reinterpret_cast<const float *>(
+                buffer.data.data() + accessor.byteOffset + bufferView.byteOffset);
+
+        inverseBindMatrices.resize(accessor.count);
+        for (size_t j = 0; j < accessor.count; j++) {
+            float m[16];
+            memcpy(m, ptr + j * 16, 16 * sizeof(float));
+            inverseBindMatrices[j] = glm::make_mat4(m);
+        }
+
+        assert(skin.joints.size() == accessor.count);
+        jointNodes = skin.joints;
     }
 
-    std::vector<AnimationObject> prepareAnimation(const tinygltf::Model &model)
+    void prepareAnimation(const tinygltf::Model &model)
     {
-        std::vector<AnimationObject> animationObjects;
         for (const auto &anim : model.animations) {
             AnimationObject animationObject;
 
@@ -1052,11 +1021,11 @@ struct MyBot {
                         samplerObject.outputVec3[i] = glm::vec3(p[0], p[1], p[2]);
                     }
                 } else if (outputAccessor.type == TINYGLTF_TYPE_VEC4) {
-                    // VEC4 data (rotation)
-                    samplerObject.outputVec4.resize(outputAccessor.count);
+                    // VEC4 data (rotation), stored x, y, z, w
+                    samplerObject.outputQuat.resize(outputAccessor.count);
                     for (size_t i = 0; i < outputAccessor.count; ++i) {
                         const float *p = reinterpret_cast<const float*>(outputPtr + i * outputStride);
-                        samplerObject.outputVec4[i] = glm::vec4(p[0], p[1], p[2], p[3]);
+                        samplerObject.outputQuat[i] = glm::quat(p[3], p[0], p[1], p[2]);
                     }
                 } else {
                     std::cout << "Unsupported accessor type in animation output" << std::endl;
@@ -1065,425 +1034,1659 @@ struct MyBot {
                 animationObject.samplers.push_back(samplerObject);
             }
 
+            // Resolve the channels once instead of comparing path names every frame
+            for (const auto &channel : anim.channels) {
+                ChannelObject channelObject;
+                channelObject.sampler = channel.sampler;
+                channelObject.targetNode = channel.target_node;
+                const SamplerObject &samplerObject = animationObject.samplers[channel.sampler];
+                size_t outputs;
+                if (channel.target_path == "translation") {
+                    channelObject.path = CHANNEL_TRANSLATION;
+                    outputs = samplerObject.outputVec3.size();
+                } else if (channel.target_path == "rotation") {
+                    channelObject.path = CHANNEL_ROTATION;
+                    outputs = samplerObject.outputQuat.size();
+                } else if (channel.target_path == "scale") {
+                    channelObject.path = CHANNEL_SCALE;
+                    outputs = samplerObject.outputVec3.size();
+                } else {
+                    continue;
+                }
+                if (channel.target_node < 0 || samplerObject.input.size() < 2 ||
+                    outputs < samplerObject.input.size()) {
+                    std::cout << "WARN: skipping animation channel of node " << channel.target_node << std::endl;
+                    continue;
+                }
+                animationObject.channels.push_back(channelObject);
+            }
+
             animationObjects.push_back(animationObject);
         }
-        return animationObjects;
     }
 
+    void bindMesh(const tinygltf::Model &model, const tinygltf::Mesh &mesh,
+                  const std::vector<GLuint> &viewBuffers) {
+        // Each mesh can contain several primitives (or parts), each we need to
+        // bind to an OpenGL vertex array object
+        for (size_t i = 0; i < mesh.primitives.size(); ++i) {
 
-    void updateAnimation(
-            const tinygltf::Model &model,
-            const tinygltf::Animation &anim,
-            const AnimationObject &animationObject,
-            float time)
-    {
-        for (size_t i = 0; i < anim.channels.size(); ++i) {
-            const auto &channel = anim.channels[i];
-            int targetNodeIndex = channel.target_node;
-            const auto &sampler = anim.samplers[channel.sampler];
+            const tinygltf::Primitive &primitive = mesh.primitives[i];
+            const tinygltf::Accessor &indexAccessor = model.accessors[primitive.indices];
 
-            const SamplerObject &samplerObject = animationObject.samplers[channel.sampler];
+            GLuint vao;
+            glGenVertexArrays(1, &vao);
+            glBindVertexArray(vao);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, viewBuffers[indexAccessor.bufferView]);
 
-            const std::vector<float> &times = samplerObject.input;
-            float animationTime = fmod(time, times.back());
+            for (auto &attrib : primitive.attributes) {
+                const tinygltf::Accessor &accessor = model.accessors[attrib.second];
+                int byteStride =
+                        accessor.ByteStride(model.bufferViews[accessor.bufferView]);
+                glBindBuffer(GL_ARRAY_BUFFER, viewBuffers[accessor.bufferView]);
 
-            int keyframeIndex = findKeyframeIndex(times, animationTime);
-            float t = (animationTime - times[keyframeIndex]) /
-                      (times[keyframeIndex + 1] - times[keyframeIndex]);
+                int size = 1;
+                if (accessor.type != TINYGLTF_TYPE_SCALAR) {
+                    size = accessor.type;
+                }
 
-            NodeState &state = nodeStates[targetNodeIndex];
+                int vaa = -1;
+                if (attrib.first == "POSITION") vaa = 0;
+                else if (attrib.first == "NORMAL") vaa = 1;
+                else if (attrib.first == "TEXCOORD_0") vaa = 2;
+                else if (attrib.first == "JOINTS_0") vaa = 3;
+                else if (attrib.first == "WEIGHTS_0") vaa = 4;
 
-            if (channel.target_path == "translation") {
-                glm::vec3 translation0 = samplerObject.outputVec3[keyframeIndex];
-                glm::vec3 translation1 = samplerObject.outputVec3[keyframeIndex + 1];
+                if (vaa > -1) {
+                    glEnableVertexAttribArray(vaa);
 
-                glm::vec3 translation = glm::mix(translation0, translation1, t);
-                state.translation = translation;
-            } else if (channel.target_path == "rotation") {
-                glm::quat rotation0 = glm::quat(samplerObject.outputVec4[keyframeIndex].w, samplerObject.outputVec4[keyframeIndex].x, samplerObject.outputVec4[keyframeIndex].y, samplerObject.outputVec4[keyframeIndex].z);
-                glm::quat rotation1 = glm::quat(samplerObject.outputVec4[keyframeIndex + 1].w, samplerObject.outputVec4[keyframeIndex + 1].x, samplerObject.outputVec4[keyframeIndex + 1].y, samplerObject.outputVec4[keyframeIndex + 1].z);
+                    if (attrib.first == "JOINTS_0") {
+                        // integer attribute pointer for joint indices
+                        glVertexAttribIPointer(vaa, size, accessor.componentType,
+                                               byteStride, BUFFER_OFFSET(accessor.byteOffset));
+                    } else {
+                        // regular attribute pointer for other attributes
+                        glVertexAttribPointer(vaa, size, accessor.componentType,
+                                              accessor.normalized ? GL_TRUE : GL_FALSE,
+                                              byteStride, BUFFER_OFFSET(accessor.byteOffset));
+                    }
+                } else {
+                    std::cout << "Unknown attribute: " << attrib.first << std::endl;
+                }
+            }
 
-                glm::quat rotation = glm::slerp(rotation0, rotation1, t);
-                state.rotation = rotation;
-            } else if (channel.target_path == "scale") {
-                glm::vec3 scale0 = samplerObject.outputVec3[keyframeIndex];
-                glm::vec3 scale1 = samplerObject.outputVec3[keyframeIndex + 1];
+            DrawObject drawObject;
+            drawObject.vao = vao;
+            drawObject.mode = primitive.mode;
+            drawObject.count = (GLsizei)indexAccessor.count;
+            drawObject.indexType = indexAccessor.componentType;
+            drawObject.indexOffset = indexAccessor.byteOffset;
+            drawObjects.push_back(drawObject);
 
-                glm::vec3 scale = glm::mix(scale0, scale1, t);
-                state.scale = scale;
-            }
+            glBindVertexArray(0);
         }
     }
 
+    void bindModelNodes(const tinygltf::Model &model, const tinygltf::Node &node,
+                        const std::vector<GLuint> &viewBuffers) {
+        // Bind buffers for the current mesh at the node
+        if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
+            bindMesh(model, model.meshes[node.mesh], viewBuffers);
+        }
 
-    void updateSkinning(const std::vector<glm::mat4> &globalTransforms) {
-        for (auto &skinObject : skinObjects) {
-            for (size_t j = 0; j < skinObject.jointMatrices.size(); ++j) {
-                int nodeIndex = model.skins[0].joints[j];  // Assuming single skin
-                skinObject.jointMatrices[j] = globalTransforms[nodeIndex] * skinObject.inverseBindMatrices[j];
-            }
+        // Recursive into children nodes
+        for (size_t i = 0; i < node.children.size(); i++) {
+            assert((node.children[i] >= 0) && (node.children[i] < model.nodes.size()));
+            bindModelNodes(model, model.nodes[node.children[i]], viewBuffers);
         }
     }
 
+    // Uploads every buffer view once, then builds the draw list in the order
+    // the scene's nodes are visited
+    void bindModel(const tinygltf::Model &model) {
+        std::vector<GLuint> viewBuffers(model.bufferViews.size(), 0);
+        for (size_t i = 0; i < model.bufferViews.size(); ++i) {
+            const tinygltf::BufferView &bufferView = model.bufferViews[i];
 
-    void update(float time) {
-        if (model.animations.size() > 0) {
-            const tinygltf::Animation &animation = model.animations[0];
-            const AnimationObject &animationObject = animationObjects[0];
-
-            // Apply animations to nodeStates
-            updateAnimation(model, animation, animationObject, time);
-
-            // Reconstruct nodeTransforms from nodeStates
-            std::vector<glm::mat4> nodeTransforms(model.nodes.size(), glm::mat4(1.0f));
-            for (size_t i = 0; i < model.nodes.size(); ++i) {
-                NodeState &state = nodeStates[i];
-                glm::mat4 translationMatrix = glm::translate(glm::mat4(1.0f), state.translation);
-                glm::mat4 rotationMatrix = glm::mat4_cast(state.rotation);
-                glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), state.scale);
-
-                nodeTransforms[i] = translationMatrix * rotationMatrix * scaleMatrix;
+            if (bufferView.target == 0) {
+                // The bufferView with target == 0 in our model refers to
+                // the skinning weights, for 25 joints, each 4x4 matrix (16 floats), totaling to 400 floats or 1600 bytes.
+                // So it is considered safe to skip the warning.
+                //std::cout << "WARN: bufferView.target is zero" << std::endl;
+                continue;
             }
 
-            // Compute global transforms
-            std::vector<glm::mat4> globalTransforms(model.nodes.size(), glm::mat4(1.0f));
-            for (size_t i = 0; i < model.scenes[model.defaultScene].nodes.size(); ++i) {
-                computeGlobalNodeTransform(model, nodeTransforms,
-                                           model.scenes[model.defaultScene].nodes[i], glm::mat4(1.0f), globalTransforms);
-            }
+            // Uploaded through GL_ARRAY_BUFFER even for indices: binding to
+            // GL_ELEMENT_ARRAY_BUFFER here would change whichever vertex array
+            // is bound. The index buffer is attached to each primitive's below.
+            const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+            GLuint vbo;
+            glGenBuffers(1, &vbo);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBufferData(GL_ARRAY_BUFFER, bufferView.byteLength,
+                         &buffer.data.at(0) + bufferView.byteOffset, GL_STATIC_DRAW);
 
-            // Recompute joint matrices for skinning
-            updateSkinning(globalTransforms);
+            viewBuffers[i] = vbo;
+            buffers.push_back(vbo);
+            gpuBytes += bufferView.byteLength;
+        }
+
+        const tinygltf::Scene &scene = model.scenes[model.defaultScene];
+        for (size_t i = 0; i < scene.nodes.size(); ++i) {
+            assert((scene.nodes[i] >= 0) && (scene.nodes[i] < model.nodes.size()));
+            bindModelNodes(model, model.nodes[scene.nodes[i]], viewBuffers);
         }
     }
 
+    bool load(const char *filename) {
+        // Memory freed earlier would otherwise be reused without showing up
+        releaseFreeHeap();
+        size_t residentStart = getResidentBytes();
+        {
+            tinygltf::Model model;
+            if (!loadModel(model, filename)) {
+                return false;
+            }
+            size_t resident = getResidentBytes();
+            residentParsedBytes = resident > residentStart ? resident - residentStart : 0;
 
-    bool loadModel(tinygltf::Model &model, const char *filename) {
-        tinygltf::TinyGLTF loader;
-        std::string err;
-        std::string warn;
+            // Apply scaling transformation
+            scaleModel(model);
 
-        bool res = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
-        if (!warn.empty()) {
-            std::cout << "WARN: " << warn << std::endl;
+            // Compile everything the bots read at run time. The model goes out of scope afterwards.
+            prepareHierarchy(model);
+            prepareSkinning(model);
+            prepareAnimation(model);
+            bindModel(model);
         }
-
-        if (!err.empty()) {
-            std::cout << "ERR: " << err << std::endl;
+        releaseFreeHeap();
+        size_t resident = getResidentBytes();
+        residentBytes = resident > residentStart ? resident - residentStart : 0;
+
+        cpuBytes = hierarchy.size() * sizeof(HierarchyNode) + restStates.size() * sizeof(NodeState) +
+                   jointNodes.size() * sizeof(int) + inverseBindMatrices.size() * sizeof(glm::mat4) +
+                   drawObjects.size() * sizeof(DrawObject) + buffers.size() * sizeof(GLuint);
+        for (const AnimationObject &animation : animationObjects) {
+            cpuBytes += animation.channels.size() * sizeof(ChannelObject);
+            for (const SamplerObject &sampler : animation.samplers) {
+                cpuBytes += sampler.input.size() * sizeof(float) + sampler.outputVec3.size() * sizeof(glm::vec3) +
+                            sampler.outputQuat.size() * sizeof(glm::quat);
+            }
         }
 
-        if (!res)
-            std::cout << "Failed to load glTF: " << filename << std::endl;
-        else
-            std::cout << "Loaded glTF: " << filename << std::endl;
+        // Create and compile our GLSL program from the shaders
+        programID = LoadShadersFromFile("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\bot.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\bot.frag");
+        if (programID == 0) {
+            std::cerr << "Failed to load shaders." << std::endl;
+        }
 
-        return res;
+        depthProgramID = LoadShadersFromFile("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\bot_depth.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\depth.frag");
+        if (depthProgramID == 0) {
+            std::cerr << "Failed to load depth shaders." << std::endl;
+        }
+
+        gBufferProgramID = LoadShadersFromFile("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\bot.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\gbuffer_bot.frag");
+        if (gBufferProgramID == 0) {
+            std::cerr << "Failed to load G-buffer shaders." << std::endl;
+        }
+        return true;
     }
 
-    void initialize(const glm::vec3& pos) {
-        position = pos;
-        if (!loadModel(model, "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\model\\bot\\bot.gltf")) {
-            return;
+    int findKeyframeIndex(const std::vector<float>& times, float animationTime) const
+    {
+        int left = 0;
+        int right = times.size() - 1;
+
+        while (left <= right) {
+            int mid = (left + right) / 2;
+
+            if (mid + 1 < times.size() && times[mid] <= animationTime && animationTime < times[mid + 1]) {
+                return mid;
+            }
+            else if (times[mid] > animationTime) {
+                right = mid - 1;
+            }
+            else { // animationTime >= times[mid + 1]
+                left = mid + 1;
+            }
         }
 
-        // Apply scaling transformation
-        glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(2.0f)); // Adjust the scale factor as needed
-        for (auto& node : model.nodes) {
-            if (node.matrix.size() == 16) {
-                glm::mat4 nodeMatrix = glm::make_mat4(node.matrix.data());
-                nodeMatrix = scaleMatrix * nodeMatrix;
-                std::copy(glm::value_ptr(nodeMatrix), glm::value_ptr(nodeMatrix) + 16, node.matrix.begin());
-            } else {
-                // Apply scaling to translation, rotation, and scale if matrix is not present
-                if (node.translation.size() == 3) {
-                    node.translation[0] *= 0.1f;
-                    node.translation[1] *= 0.1f;
-                    node.translation[2] *= 0.1f;
-                }
-                if (node.scale.size() == 3) {
-                    node.scale[0] *= 0.1f;
-                    node.scale[1] *= 0.1f;
-                    node.scale[2] *= 0.1f;
-                }
+        // Target not found
+        return times.size() - 2;
+    }
+
+    // Writes the pose of a clip at the given time into one state per node
+    void updateAnimation(const AnimationObject &animationObject, float time, NodeState *nodeStates) const
+    {
+        for (const ChannelObject &channel : animationObject.channels) {
+            const SamplerObject &samplerObject = animationObject.samplers[channel.sampler];
+
+            const std::vector<float> &times = samplerObject.input;
+            float animationTime = fmod(time, times.back());
+
+            int keyframeIndex = findKeyframeIndex(times, animationTime);
+            float t = (animationTime - times[keyframeIndex]) /
+                      (times[keyframeIndex + 1] - times[keyframeIndex]);
+
+            NodeState &state = nodeStates[channel.targetNode];
+
+            switch (channel.path) {
+            case CHANNEL_TRANSLATION:
+                state.translation = glm::mix(samplerObject.outputVec3[keyframeIndex],
+                                             samplerObject.outputVec3[keyframeIndex + 1], t);
+                break;
+            case CHANNEL_ROTATION:
+                state.rotation = glm::slerp(samplerObject.outputQuat[keyframeIndex],
+                                            samplerObject.outputQuat[keyframeIndex + 1], t);
+                break;
+            case CHANNEL_SCALE:
+                state.scale = glm::mix(samplerObject.outputVec3[keyframeIndex],
+                                       samplerObject.outputVec3[keyframeIndex + 1], t);
+                break;
             }
         }
+    }
 
-        // Prepare buffers for rendering
-        primitiveObjects = bindModel(model);
+    // Both arrays hold one transform per node of the model. The roots are
+    // placed by rootTransform. Nodes outside the hierarchy keep what
+    // globalTransforms holds.
+    void computeGlobalNodeTransforms(const glm::mat4 *localTransforms, const glm::mat4 &rootTransform,
+                                     glm::mat4 *globalTransforms) const
+    {
+        for (const HierarchyNode &entry : hierarchy) {
+            globalTransforms[entry.node] = (entry.parent < 0 ? rootTransform : globalTransforms[entry.parent]) *
+                                           localTransforms[entry.node];
+        }
+    }
 
-        // Prepare joint matrices
-        skinObjects = prepareSkinning(model);
+    void updateSkinning(const glm::mat4 *globalTransforms, glm::mat4 *jointMatrices) const {
+        for (size_t j = 0; j < jointNodes.size(); ++j) {
+            jointMatrices[j] = globalTransforms[jointNodes[j]] * inverseBindMatrices[j];
+        }
+    }
 
-        // Prepare animation data
-        animationObjects = prepareAnimation(model);
+    // The draws expect the program, and the object and skin uniforms, bound
+    void draw() const {
+        for (const DrawObject &drawObject : drawObjects) {
+            glBindVertexArray(drawObject.vao);
+            glDrawElements(drawObject.mode, drawObject.count, drawObject.indexType,
+                           BUFFER_OFFSET(drawObject.indexOffset));
+        }
+    }
 
-        // Create and compile our GLSL program from the shaders
-        programID = LoadShadersFromFile("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\bot.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\bot.frag");
-        if (programID == 0) {
-            std::cerr << "Failed to load shaders." << std::endl;
+    void cleanup() {
+        for (const DrawObject &drawObject : drawObjects) {
+            glDeleteVertexArrays(1, &drawObject.vao);
+        }
+        if (!buffers.empty()) glDeleteBuffers((GLsizei)buffers.size(), &buffers[0]);
+        drawObjects.clear();
+        buffers.clear();
+        glDeleteProgram(programID);
+        glDeleteProgram(depthProgramID);
+        glDeleteProgram(gBufferProgramID);
+    }
+};
+
+// The only character type, loaded once for every bot
+static BotAsset botAsset;
+
+// A bot instance: its place and pose. Everything else is in the shared asset.
+struct MyBot {
+    const BotAsset *asset;
+    std::vector<BotAsset::NodeState> nodeStates;
+    std::vector<glm::mat4> jointMatrices;   // Of the asset's skin in world space, combined by pose()
+
+    // Starts in the rest pose, at the given position
+    void initialize(const BotAsset &asset, const glm::vec3& pos) {
+        this->asset = &asset;
+        position = pos;
+        poseTime = -1.0f;
+        nodeStates = asset.restStates;
+        jointMatrices.assign(asset.jointNodes.size(), glm::mat4(1.0f));
+
+        std::vector<glm::mat4> nodeTransforms(nodeStates.size());
+        std::vector<glm::mat4> globalTransforms(nodeStates.size());
+        pose(nodeTransforms.data(), globalTransforms.data());
+    }
+
+    // Combines the joint matrices from nodeStates. The bot's position moves
+    // the roots, so the joints and whatever is measured against position
+    // agree with where the bot is drawn. Both arrays are scratch of one
+    // transform per node.
+    void pose(glm::mat4 *nodeTransforms, glm::mat4 *globalTransforms) {
+        // Reconstruct nodeTransforms from nodeStates
+        for (size_t i = 0; i < nodeStates.size(); ++i) {
+            const BotAsset::NodeState &state = nodeStates[i];
+            glm::mat4 translationMatrix = glm::translate(glm::mat4(1.0f), state.translation);
+            glm::mat4 rotationMatrix = glm::mat4_cast(state.rotation);
+            glm::mat4 scaleMatrix = glm::scale(glm::mat4(1.0f), state.scale);
+
+            nodeTransforms[i] = translationMatrix * rotationMatrix * scaleMatrix;
+            globalTransforms[i] = glm::mat4(1.0f);
         }
 
-        nodeStates.resize(model.nodes.size());
-        for (size_t i = 0; i < model.nodes.size(); ++i) {
-            const tinygltf::Node &node = model.nodes[i];
+        // Compute global transforms
+        asset->computeGlobalNodeTransforms(nodeTransforms, glm::translate(glm::mat4(1.0f), position),
+                                           globalTransforms);
 
-            NodeState &state = nodeStates[i];
-            // Translation
-            if (node.translation.size() == 3) {
-                state.translation = glm::vec3(node.translation[0], node.translation[1], node.translation[2]);
-            } else {
-                state.translation = glm::vec3(0.0f);
-            }
-            // Rotation
-            if (node.rotation.size() == 4) {
-                state.rotation = glm::quat(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
-            } else {
-                state.rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+        // Recompute joint matrices for skinning
+        asset->updateSkinning(globalTransforms, jointMatrices.data());
+        rootPosition = asset->jointNodes.empty() ? position : glm::vec3(globalTransforms[asset->jointNodes[0]][3]);
+    }
+
+    // The scratch transforms come from the arena of the frame being simulated
+    void update(float time, FrameArena &arena) {
+        if (asset->animationObjects.empty()) return;
+
+        // Apply animations to nodeStates
+        asset->updateAnimation(asset->animationObjects[0], time, nodeStates.data());
+
+        ArenaAllocator<glm::mat4> allocator(&arena);
+        ArenaVector<glm::mat4> nodeTransforms(nodeStates.size(), allocator);
+        ArenaVector<glm::mat4> globalTransforms(nodeStates.size(), allocator);
+        pose(nodeTransforms.data(), globalTransforms.data());
+    }
+
+    // Appends the joint matrices after update(), which the draws below use.
+    // The render functions take them from a frame packet rather than the bot,
+    // which the simulation thread may already be updating for the next frame.
+    void appendJointMatrices(ArenaVector<glm::mat4> &jointMatrices) const {
+        jointMatrices.insert(jointMatrices.end(), this->jointMatrices.begin(), this->jointMatrices.end());
+    }
+
+    // The joint matrices already hold the bot's position, so the bot has no model transform
+    ObjectUniforms getObjectUniforms(const glm::mat4 &cameraMatrix) const {
+        ObjectUniforms object;
+        object.mvp = cameraMatrix;
+        object.model = glm::mat4();
+        return object;
+    }
+
+    // The draws below expect the object and skin uniforms bound
+    void render() {
+        glUseProgram(asset->programID);
+        asset->draw();
+    }
+
+    // Draws the skinned model into the currently bound depth target
+    void renderDepth() {
+        glUseProgram(asset->depthProgramID);
+        asset->draw();
+    }
+
+    // Draws the skinned model into the G-buffer of the deferred renderer
+    void renderGeometry() {
+        glUseProgram(asset->gBufferProgramID);
+        asset->draw();
+    }
+
+    glm::vec3 position;
+    glm::vec3 rootPosition; // Root joint of the current pose in world space, for the animation LOD
+    float poseTime;     // Animation time of the current pose, for the animation LOD
+};
+
+// Only the footprint of the new box counts, the buildings are taken as points.
+// Changing that would change the city every seed lays out.
+bool isPositionInBuilding(const glm::vec3& position, const glm::vec3& size, const Buildings& buildings, float buffer) {
+    for (const glm::vec3 &buildingPos : buildings.positions) {
+        if (position.x < buildingPos.x + buffer && position.x + size.x + buffer > buildingPos.x &&
+            position.z < buildingPos.z + buffer && position.z + size.z + buffer > buildingPos.z) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Everything placed in the city. Benchmark sweeps rebuild it with other sizes.
+struct Scene {
+    Buildings buildings;
+    std::vector<Rocket> rockets;
+    std::vector<MyBot> bots;
+};
+
+// What the simulation stage needs to know about a frame, snapshotted on the main thread
+struct FrameInput {
+    float time;             // Animation time
+    bool animate;
+    glm::vec3 eyeCenter;
+    glm::vec3 lookat;
+    QualitySettings quality;
+};
+
+// The immutable result of the simulation stage, everything the render stage
+// needs besides the scene's GL objects and the render settings
+struct FramePacket {
+    FrameInput input;
+    glm::mat4 view;
+    glm::mat4 viewProjection;
+    ShadowCascadeFit shadows;
+
+    // The containers below, and the scratch of both stages, live in the arena
+    // of the packet's slot until the slot is simulated into again
+    FrameArena *arena;
+    ArenaVector<int> visibleBuildings;      // Indices into the scene, inside the camera frustum
+    ArenaVector<int> visibleRockets;
+    ArenaVector<int> shadowRockets[MAX_SHADOW_CASCADES];    // Dynamic casters of each cascade
+    ArenaVector<glm::mat4> botJointMatrices;    // The joints of every bot, one after another
+    ArenaVector<int> botJointOffsets;           // First joint of each bot, and the end of the last
+
+    // When the simulation of the packet ran, and its bot update started, for the profiler
+    std::chrono::steady_clock::time_point simulationStart;
+    std::chrono::steady_clock::time_point botUpdateStart;
+    std::chrono::steady_clock::time_point simulationEnd;
+};
+
+// The next frame is simulated on a worker thread while the current one renders.
+// --serial runs both stages on the main thread.
+static FramePipeline pipeline;
+static FramePacket framePackets[FRAME_PIPELINE_SLOTS];
+static FrameArena frameArenas[FRAME_PIPELINE_SLOTS];
+static bool usePipeline = true;
+
+// Writes the object uniforms of a draw list into the ring with one upload,
+// then draws each object with its own block bound
+template <typename Object, typename Draw>
+static void drawObjects(std::vector<Object> &objects, const ArenaVector<int> &indices,
+                        const glm::mat4 &viewProjection, Draw draw) {
+    if (indices.empty()) return;
+    objectConstants.resize(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        objectConstants[i] = objects[indices[i]].getObjectUniforms(viewProjection);
+    }
+    GLintptr offset = uniformRing.upload(&objectConstants[0], (int)indices.size(), sizeof(ObjectUniforms));
+    for (size_t i = 0; i < indices.size(); ++i) {
+        uniformRing.bind(OBJECT_UNIFORM_BINDING, offset, (int)i, sizeof(ObjectUniforms));
+        draw(objects[indices[i]]);
+    }
+}
+
+// Same for the buildings, which all share one box mesh that stays bound.
+// Colour passes bind the texture of each building, the state cache drops
+// the repeats.
+static void drawBuildings(const Buildings &buildings, const ArenaVector<int> &indices,
+                          const glm::mat4 &viewProjection, bool textured) {
+    if (indices.empty()) return;
+    objectConstants.resize(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        objectConstants[i] = buildings.getObjectUniforms(indices[i], viewProjection);
+    }
+    GLintptr offset = uniformRing.upload(&objectConstants[0], (int)indices.size(), sizeof(ObjectUniforms));
+    glBindVertexArray(buildingMesh.vertexArrayID);
+    glActiveTexture(GL_TEXTURE0);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        uniformRing.bind(OBJECT_UNIFORM_BINDING, offset, (int)i, sizeof(ObjectUniforms));
+        if (textured) glBindTexture(GL_TEXTURE_2D, buildingMesh.textures[buildings.textures[indices[i]]]);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void*)0);
+    }
+}
+
+// Same for the bots, which also need their joint matrices bound
+template <typename Draw>
+static void drawBots(Scene &scene, const FramePacket &packet, const glm::mat4 &viewProjection, Draw draw) {
+    static std::vector<SkinUniforms> skinConstants;
+    int count = (int)scene.bots.size();
+    if (count == 0) return;
+
+    skinConstants.resize(count);
+    objectConstants.resize(count);
+    for (int i = 0; i < count; ++i) {
+        int first = packet.botJointOffsets[i];
+        int numJoints = std::min(packet.botJointOffsets[i + 1] - first, MAX_JOINTS);
+        std::copy(packet.botJointMatrices.begin() + first, packet.botJointMatrices.begin() + first + numJoints,
+                  skinConstants[i].jointMatrices);
+        objectConstants[i] = scene.bots[i].getObjectUniforms(viewProjection);
+    }
+
+    // Both uploads are bound together, so neither may orphan the other
+    uniformRing.reserve(count * (uniformRing.stride(sizeof(SkinUniforms)) + uniformRing.stride(sizeof(ObjectUniforms))));
+    GLintptr skinOffset = uniformRing.upload(&skinConstants[0], count, sizeof(SkinUniforms));
+    GLintptr objectOffset = uniformRing.upload(&objectConstants[0], count, sizeof(ObjectUniforms));
+    for (int i = 0; i < count; ++i) {
+        uniformRing.bind(SKIN_UNIFORM_BINDING, skinOffset, i, sizeof(SkinUniforms));
+        uniformRing.bind(OBJECT_UNIFORM_BINDING, objectOffset, i, sizeof(ObjectUniforms));
+        draw(scene.bots[i]);
+    }
+}
+
+// Renders the shadow cascades. Static casters (buildings) are drawn into a
+// persistent depth array only when a cascade has moved, the light has changed
+// or the set of buildings has changed. Every frame the cached depth is copied
+// and only the dynamic casters (rockets, bots) are drawn on top of it.
+static void renderShadowCascades(Scene &scene, const FramePacket &packet) {
+    ArenaVector<int> staticCasters((ArenaAllocator<int>(packet.arena)));
+    glm::vec3 boxMin, boxMax;
+
+    for (int i = 0; i < shadowMaps.numCascades; ++i) {
+        const glm::mat4 &lightSpace = shadowMaps.lightSpaceMatrices[i];
+
+        if (!shadowMaps.isStaticCacheValid(i)) {
+            staticCasters.clear();
+            for (size_t j = 0; j < scene.buildings.size(); ++j) {
+                scene.buildings.getBounds(j, boxMin, boxMax);
+                if (shadowMaps.isVisible(i, boxMin, boxMax)) staticCasters.push_back((int)j);
             }
-            // Scale
-            if (node.scale.size() == 3) {
-                state.scale = glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
-            } else {
-                state.scale = glm::vec3(1.0f);
+            glUseProgram(depthProgramID);
+            shadowMaps.beginStaticCascade(i);
+            drawBuildings(scene.buildings, staticCasters, lightSpace, false);
+            shadowMaps.endStaticCascade(i);
+        }
+
+        shadowMaps.beginCascade(i);
+
+        glUseProgram(depthProgramID);
+        drawObjects(scene.rockets, packet.shadowRockets[i], lightSpace, [](Rocket &rocket) { rocket.renderDepth(); });
+        drawBots(scene, packet, lightSpace, [](MyBot &bot) { bot.renderDepth(); });
+    }
+
+    shadowMaps.end(hdrTarget.width, hdrTarget.height);
+}
+
+// Lays down the depth of the opaque boxes with colour writes off. The following
+// colour pass tests with GL_EQUAL, so each pixel shades only its visible facade.
+// Its MVPs are computed the same way, so the depths match bit for bit.
+static void renderDepthPrePass(Scene &scene, const FramePacket &packet) {
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glUseProgram(depthProgramID);
+    drawBuildings(scene.buildings, packet.visibleBuildings, packet.viewProjection, false);
+    drawObjects(scene.rockets, packet.visibleRockets, packet.viewProjection,
+                [](Rocket &rocket) { rocket.renderDepth(); });
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+// Scatters warm window lights over the building facades and puts an exhaust
+// light under every rocket
+static std::vector<PointLight> createPointLights(const Buildings &buildings, const std::vector<Rocket> &rockets) {
+    std::vector<PointLight> lights;
+
+    for (const auto &rocket : rockets) {
+        if ((int)lights.size() >= maxPointLights) break;
+        PointLight light;
+        light.positionRadius = glm::vec4(rocket.position - glm::vec3(0.0f, rocket.scale.y * 1.5f, 0.0f), 150.0f);
+        light.color = glm::vec4(2.0f, 0.9f, 0.3f, 1.0f);
+        lights.push_back(light);
+    }
+
+    for (size_t b = 0; b < buildings.size(); ++b) {
+        for (int i = 0; i < 2 && (int)lights.size() < maxPointLights; ++i) {
+            // Pick one of the four side faces and a spot on it, just outside the wall
+            int face = rand() % 4;
+            float along = static_cast<float>(rand() % 200 - 100) / 100.0f;
+            float height = static_cast<float>(rand() % 200 - 100) / 100.0f;
+            glm::vec3 offset;
+            switch (face) {
+                case 0: offset = glm::vec3(1.1f, height, along); break;
+                case 1: offset = glm::vec3(-1.1f, height, along); break;
+                case 2: offset = glm::vec3(along, height, 1.1f); break;
+                default: offset = glm::vec3(along, height, -1.1f); break;
             }
+
+            PointLight light;
+            light.positionRadius = glm::vec4(buildings.positions[b] + offset * buildings.scales[b],
+                                             40.0f + static_cast<float>(rand() % 40));
+            light.color = glm::vec4(1.2f, 0.9f, 0.5f, 1.0f) * (0.5f + static_cast<float>(rand() % 100) / 100.0f);
+            lights.push_back(light);
         }
+    }
+
+    return lights;
+}
 
-        // Get a handle for GLSL variables
-        mvpMatrixID = glGetUniformLocation(programID, "MVP");
-        lightPositionID = glGetUniformLocation(programID, "lightPosition");
-        lightIntensityID = glGetUniformLocation(programID, "lightIntensity");
-        jointMatricesID = glGetUniformLocation(programID, "jointMatrices");
+// Writes the city and its lights for --save-scene. Textures are stored as
+// indices into the lists they were picked from.
+static void saveScene(const Scene &scene, const std::vector<GLuint> &rocketTextures,
+                      const std::vector<PointLight> &lights) {
+    SceneSnapshotData snapshot;
+    snapshot.buildingPositions = scene.buildings.positions;
+    snapshot.buildingScales = scene.buildings.scales;
+    snapshot.buildingTextures = scene.buildings.textures;
+    for (const auto &rocket : scene.rockets) {
+        snapshot.rocketPositions.push_back(rocket.position);
+        snapshot.rocketScales.push_back(rocket.scale);
+        snapshot.rocketTextures.push_back(
+            (uint32_t)(std::find(rocketTextures.begin(), rocketTextures.end(), rocket.textureID) - rocketTextures.begin()));
     }
+    for (const auto &bot : scene.bots) {
+        snapshot.botPositions.push_back(bot.position);
+    }
+    snapshot.lights = lights;
 
-    void bindMesh(std::vector<PrimitiveObject> &primitiveObjects,
-                  tinygltf::Model &model, tinygltf::Mesh &mesh) {
+    if (snapshot.write(saveScenePath, sceneSeed)) {
+        std::cout << "Scene saved to " << saveScenePath << std::endl;
+    }
+}
 
-        std::map<int, GLuint> vbos;
-        for (size_t i = 0; i < model.bufferViews.size(); ++i) {
-            const tinygltf::BufferView &bufferView = model.bufferViews[i];
+// Lays out numBuildings buildings, numRockets rockets and numBots bots from
+// sceneSeed, so the same seed always gives the same city, and gives the
+// deferred renderer their point lights. Fails when an object finds no free spot.
+static bool createScene(Scene &scene, const std::vector<GLuint> &textures, const std::vector<GLuint> &rocketTextures) {
+    srand(sceneSeed);
 
-            int target = bufferView.target;
+    // Create multiple buildings
+    Buildings &buildings = scene.buildings;
+    buildings.resize(numBuildings);
 
-            if (bufferView.target == 0) {
-                // The bufferView with target == 0 in our model refers to
-                // the skinning weights, for 25 joints, each 4x4 matrix (16 floats), totaling to 400 floats or 1600 bytes.
-                // So it is considered safe to skip the warning.
-                //std::cout << "WARN: bufferView.target is zero" << std::endl;
-                continue;
+    float buffer = 40.0f; // Adjust this value to increase or decrease the buffer zone
+
+    for (int i = 0; i < numBuildings; ++i) {
+        // Increase the size range for buildings
+        float height = 10.0f + static_cast<float>(rand() % 100 + 1); // Random height between 10 and 110
+        float width = 10.0f + static_cast<float>(rand() % 20 + 1);   // Random width between 10 and 30
+        float depth = 10.0f + static_cast<float>(rand() % 20 + 1);   // Random depth between 10 and 30
+
+        glm::vec3 size(width, height, depth);
+        glm::vec3 position;
+
+        // Ensure buildings do not overlap
+        int attempts = 0;
+        do {
+            if (++attempts > maxPlacementAttempts) {
+                std::cerr << "No room left for building " << i + 1 << " of " << numBuildings << std::endl;
+                return false;
             }
+            position.x = static_cast<float>(rand() % 2000 - 1000); // Random x position between -1000 and 1000
+            position.z = static_cast<float>(rand() % 2000 - 1000); // Random z position between -1000 and 1000
+        } while (isPositionInBuilding(position, size, buildings, buffer));
 
-            const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-            GLuint vbo;
-            glGenBuffers(1, &vbo);
-            glBindBuffer(target, vbo);
-            glBufferData(target, bufferView.byteLength,
-                         &buffer.data.at(0) + bufferView.byteOffset, GL_STATIC_DRAW);
+        buildings.positions[i] = position;
+        buildings.scales[i] = size;
+        buildings.textures[i] = (uint32_t)(i % textures.size());
+    }
 
-            vbos[i] = vbo;
-        }
 
-        // Each mesh can contain several primitives (or parts), each we need to
-        // bind to an OpenGL vertex array object
-        for (size_t i = 0; i < mesh.primitives.size(); ++i) {
+    /* std::vector<GLuint> treeTextures;
+     treeTextures.push_back(LoadTextureTileBox(
+             "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\buildings\\tree3.png"));
 
-            tinygltf::Primitive primitive = mesh.primitives[i];
-            tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
+     std::vector<Rocket> trees;
+     int numTrees = 20; // Adjust this number to add more buildings
 
-            GLuint vao;
-            glGenVertexArrays(1, &vao);
-            glBindVertexArray(vao);
+     for (int i = 0; i < numTrees; ++i) {
+         trees.push_back(Rocket());
+     }
 
-            for (auto &attrib : primitive.attributes) {
-                tinygltf::Accessor accessor = model.accessors[attrib.second];
-                int byteStride =
-                        accessor.ByteStride(model.bufferViews[accessor.bufferView]);
-                glBindBuffer(GL_ARRAY_BUFFER, vbos[accessor.bufferView]);
+     for (int i = 0; i < numTrees; ++i) {
+         // Increase the size range for buildings
+         // Increase the size range for buildings
+         float height_t = 25.0f ; // Random height between 10 and 110
+         float width_t = 25.0f;   // Random width between 10 and 30
+         float depth_t = 25.0f;   // Random depth between 10 and 30
 
-                int size = 1;
-                if (accessor.type != TINYGLTF_TYPE_SCALAR) {
-                    size = accessor.type;
-                }
+         glm::vec3 size_t(width_t, height_t, depth_t);
+         glm::vec3 position_t;
 
-                int vaa = -1;
-                if (attrib.first == "POSITION") vaa = 0;
-                else if (attrib.first == "NORMAL") vaa = 1;
-                else if (attrib.first == "TEXCOORD_0") vaa = 2;
-                else if (attrib.first == "JOINTS_0") vaa = 3;
-                else if (attrib.first == "WEIGHTS_0") vaa = 4;
+         // Ensure trees do not overlap with buildings
+         do {
+             position_t.x = static_cast<float>(rand() % 2000 - 1000); // Random x position between -1000 and 1000
+             position_t.z = static_cast<float>(rand() % 2000 - 1000); // Random z position between -1000 and 1000
+         } while (isPositionInBuilding(position_t, size_t, buildings, buffer));
 
-                if (vaa > -1) {
-                    glEnableVertexAttribArray(vaa);
+         trees[i].initialize(position_t, size_t);
+         trees[i].setTexture(treeTextures[i % treeTextures.size()]);
+         std::cout << "Tree initialized at position: (" << position_t.x << ", 0, " << position_t.z << ") with size: (" << width_t << ", " << height_t << ", " << depth_t << ")" << std::endl;
 
-                    if (attrib.first == "JOINTS_0") {
-                        // integer attribute pointer for joint indices
-                        glVertexAttribIPointer(vaa, size, accessor.componentType,
-                                               byteStride, BUFFER_OFFSET(accessor.byteOffset));
-                    } else {
-                        // regular attribute pointer for other attributes
-                        glVertexAttribPointer(vaa, size, accessor.componentType,
-                                              accessor.normalized ? GL_TRUE : GL_FALSE,
-                                              byteStride, BUFFER_OFFSET(accessor.byteOffset));
-                    }
-                } else {
-                    std::cout << "Unknown attribute: " << attrib.first << std::endl;
-                }
+ }*/
+
+    std::vector<Rocket> &rockets = scene.rockets;
+    rockets.resize(numRockets);
+
+    for (int i = 0; i < numRockets; ++i) {
+        // Increase the size range for buildings
+        // Increase the size range for buildings
+        float height_r = 25.0f ; // Random height between 10 and 110
+        float width_r = 25.0f;   // Random width between 10 and 30
+        float depth_r = 25.0f;   // Random depth between 10 and 30
+
+        glm::vec3 size_t(width_r, height_r, depth_r);
+        glm::vec3 position_r;
+
+        // Ensure trees do not overlap with buildings
+        int attempts = 0;
+        do {
+            if (++attempts > maxPlacementAttempts) {
+                std::cerr << "No room left for rocket " << i + 1 << " of " << numRockets << std::endl;
+                return false;
+            }
+            position_r.x = static_cast<float>(rand() % 2000 - 1000); // Random x position between -1000 and 1000
+            position_r.z = static_cast<float>(rand() % 2000 - 1000); // Random z position between -1000 and 1000
+            position_r.y = static_cast<float>(rand() % 1000 + 700);   // Random y position between 100 and 600 (sky level)
+        } while (isPositionInBuilding(position_r, size_t, buildings, buffer));
+
+        rockets[i].initialize(position_r, size_t, buildingMesh.programID);
+        rockets[i].setTexture(rocketTextures[i % rocketTextures.size()]);
+    }
+
+
+    // Create the bots, all of the one character type, spread over the city
+    // on the ground and clear of the buildings. Each bot is drawn where it is placed.
+    glm::vec3 botFootprint(20.0f, 0.0f, 20.0f);
+    scene.bots.reserve(numBots);
+    for (int i = 0; i < numBots; ++i) {
+        glm::vec3 botPosition(0.0f);
+        int attempts = 0;
+        do {
+            if (++attempts > maxPlacementAttempts) {
+                std::cerr << "No room left for bot " << i + 1 << " of " << numBots << std::endl;
+                return false;
             }
+            botPosition.x = static_cast<float>(rand() % 2000 - 1000); // Random x position between -1000 and 1000
+            botPosition.z = static_cast<float>(rand() % 2000 - 1000); // Random z position between -1000 and 1000
+        } while (isPositionInBuilding(botPosition, botFootprint, buildings, buffer));
+        scene.bots.push_back(MyBot());
+        scene.bots.back().initialize(botAsset, botPosition);
+    }
 
-            PrimitiveObject primitiveObject;
-            primitiveObject.vao = vao;
-            primitiveObject.vbos = vbos;
-            primitiveObjects.push_back(primitiveObject);
+    // Lights follow the layout
+    std::vector<PointLight> pointLights = createPointLights(buildings, rockets);
+    deferred.setLights(pointLights);
 
-            glBindVertexArray(0);
+    // The city is complete, build the static shadow cache on the next frame
+    shadowMaps.invalidateStaticCasters();
+
+    if (!saveScenePath.empty()) {
+        saveScene(scene, rocketTextures, pointLights);
+    }
+    return true;
+}
+
+// Instantiates the city of a snapshot written by --save-scene. Nothing is
+// laid out again and no random numbers are drawn, the lights go from the
+// mapped file straight into the deferred renderer's instance buffer.
+static bool loadScene(Scene &scene, const std::vector<GLuint> &textures, const std::vector<GLuint> &rocketTextures) {
+    SceneSnapshot snapshot;
+    if (!snapshot.open(loadScenePath)) {
+        return false;
+    }
+    const SceneSnapshotHeader &header = *snapshot.header;
+    for (uint32_t i = 0; i < header.numBuildings; ++i) {
+        if (snapshot.buildingTextures[i] >= textures.size()) {
+            std::cerr << loadScenePath << " uses building texture " << snapshot.buildingTextures[i] << std::endl;
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header.numRockets; ++i) {
+        if (snapshot.rocketTextures[i] >= rocketTextures.size()) {
+            std::cerr << loadScenePath << " uses rocket texture " << snapshot.rocketTextures[i] << std::endl;
+            return false;
         }
     }
 
-    void bindModelNodes(std::vector<PrimitiveObject> &primitiveObjects,
-                        tinygltf::Model &model,
-                        tinygltf::Node &node) {
-        // Bind buffers for the current mesh at the node
-        if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
-            bindMesh(primitiveObjects, model, model.meshes[node.mesh]);
+    sceneSeed = header.seed;
+    numBuildings = (int)header.numBuildings;
+    numRockets = (int)header.numRockets;
+    numBots = (int)header.numBots;
+
+    scene.buildings.positions.assign(snapshot.buildingPositions, snapshot.buildingPositions + numBuildings);
+    scene.buildings.scales.assign(snapshot.buildingScales, snapshot.buildingScales + numBuildings);
+    scene.buildings.textures.assign(snapshot.buildingTextures, snapshot.buildingTextures + numBuildings);
+    scene.rockets.resize(numRockets);
+    for (int i = 0; i < numRockets; ++i) {
+        scene.rockets[i].initialize(snapshot.rocketPositions[i], snapshot.rocketScales[i], buildingMesh.programID);
+        scene.rockets[i].setTexture(rocketTextures[snapshot.rocketTextures[i]]);
+    }
+    scene.bots.reserve(numBots);
+    for (int i = 0; i < numBots; ++i) {
+        scene.bots.push_back(MyBot());
+        scene.bots.back().initialize(botAsset, snapshot.botPositions[i]);
+    }
+
+    deferred.setLights(snapshot.lights, (int)header.numLights);
+    shadowMaps.invalidateStaticCasters();
+    return true;
+}
+
+// Memory of the buildings, against the per-instance boxes they used to be.
+// Rockets still have that layout, so they give the old figures.
+static void printBuildingMemory(const Buildings &buildings) {
+    size_t count = buildings.size();
+    size_t cpuEach = sizeof(glm::vec3) * 2 + sizeof(uint32_t);
+    size_t oldCpuEach = sizeof(Rocket);
+    size_t oldGpuEach = sizeof(Rocket::vertex_buffer_data) + sizeof(Rocket::color_buffer_data) +
+                        sizeof(Rocket::uv_buffer_data) + sizeof(Rocket::index_buffer_data);
+    std::cout << "Building memory: " << cpuEach << " B CPU and no GPU memory per building, plus one "
+              << buildingMesh.gpuBytes << " B mesh; " << count * cpuEach / 1024.0 << " KB CPU and "
+              << buildingMesh.gpuBytes / 1024.0 << " KB GPU for " << count << " (per-instance boxes: "
+              << oldCpuEach << " B CPU, " << oldGpuEach << " B GPU and 5 GL objects each; "
+              << count * oldCpuEach / 1024.0 << " KB CPU and " << count * oldGpuEach / 1024.0 << " KB GPU)"
+              << std::endl;
+}
+
+// Memory of a character type. The resident figures include the driver's
+// copies of the buffers where it keeps them in system memory.
+static void printBotAssetMemory(const BotAsset &asset, const char *name) {
+    size_t perBot = sizeof(MyBot) + asset.restStates.size() * sizeof(BotAsset::NodeState) +
+                    asset.jointNodes.size() * sizeof(glm::mat4);
+    std::cout << "Character " << name << ": " << asset.residentParsedBytes / (1024.0 * 1024.0)
+              << " MB resident with the parsed glTF, " << asset.residentBytes / (1024.0 * 1024.0)
+              << " MB after releasing it; keeps " << asset.cpuBytes / 1024.0 << " KB CPU and "
+              << asset.gpuBytes / 1024.0 << " KB GPU, plus " << perBot << " B per bot" << std::endl;
+}
+
+// Generates the city, or loads it with --load-scene, and reports how long that took
+static bool buildScene(Scene &scene, const std::vector<GLuint> &textures, const std::vector<GLuint> &rocketTextures) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (loadScenePath.empty()) {
+        if (!createScene(scene, textures, rocketTextures)) return false;
+    } else if (!loadScene(scene, textures, rocketTextures)) {
+        return false;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Scene " << (loadScenePath.empty() ? "generated" : "loaded from " + loadScenePath) << " in "
+              << ms << " ms" << std::endl;
+    printBuildingMemory(scene.buildings);
+    return true;
+}
+
+static void cleanupScene(Scene &scene) {
+    for (auto &rocket : scene.rockets) {
+        rocket.cleanup();
+    }
+    scene.buildings.clear();
+    scene.rockets.clear();
+    scene.bots.clear();
+}
+
+// Planes of a view-projection frustum with inward normals, as (normal, distance)
+static void getFrustumPlanes(const glm::mat4 &vp, glm::vec4 planes[6]) {
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; ++i) {
+        rows[i] = glm::vec4(vp[0][i], vp[1][i], vp[2][i], vp[3][i]);
+    }
+    for (int i = 0; i < 3; ++i) {
+        planes[2 * i] = rows[3] + rows[i];
+        planes[2 * i + 1] = rows[3] - rows[i];
+    }
+}
+
+// Distance from a point to the nearest point of a box
+static float getBoxDistance(const glm::vec3 &point, const glm::vec3 &boxMin, const glm::vec3 &boxMax) {
+    return glm::length(point - glm::clamp(point, boxMin, boxMax));
+}
+
+static bool isBoxInFrustum(const glm::vec4 planes[6], const glm::vec3 &boxMin, const glm::vec3 &boxMax) {
+    for (int i = 0; i < 6; ++i) {
+        // The corner furthest along the plane normal
+        glm::vec3 corner(planes[i].x > 0.0f ? boxMax.x : boxMin.x,
+                         planes[i].y > 0.0f ? boxMax.y : boxMin.y,
+                         planes[i].z > 0.0f ? boxMax.z : boxMin.z);
+        if (glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0.0f) return false;
+    }
+    return true;
+}
+
+// Current camera and animation state for the simulation stage
+static FrameInput getFrameInput(float time) {
+    FrameInput input;
+    input.time = time;
+    input.animate = playAnimation;
+    input.eyeCenter = eye_center;
+    input.lookat = lookat;
+    input.quality = governor.settings;
+    return input;
+}
+
+// Starts a new frame in the packet's arena. The renderer has released the
+// slot's previous frame, so nothing refers into the arena any more; the
+// containers drop their storage first, then the arena is reset wholesale.
+static void resetFramePacket(FramePacket &packet, size_t numBuildings, size_t numRockets, size_t numBots) {
+    ArenaAllocator<int> allocator(packet.arena);
+    packet.visibleBuildings = ArenaVector<int>(allocator);
+    packet.visibleRockets = ArenaVector<int>(allocator);
+    for (int c = 0; c < MAX_SHADOW_CASCADES; ++c) {
+        packet.shadowRockets[c] = ArenaVector<int>(allocator);
+    }
+    packet.botJointMatrices = ArenaVector<glm::mat4>(ArenaAllocator<glm::mat4>(packet.arena));
+    packet.botJointOffsets = ArenaVector<int>(allocator);
+    packet.arena->reset();
+
+    // Full size up front, growing would leave every smaller copy behind in the arena
+    packet.visibleBuildings.reserve(numBuildings);
+    packet.visibleRockets.reserve(numRockets);
+    for (int c = 0; c < packet.shadows.numCascades; ++c) {
+        packet.shadowRockets[c].reserve(numRockets);
+    }
+    packet.botJointMatrices.reserve(numBots * MAX_JOINTS);
+    packet.botJointOffsets.reserve(numBots + 1);
+}
+
+// Simulation stage, may run on the pipeline's worker thread. It must not call
+// GL or touch state the render stage reads: it writes the packet, the bots'
+// animation state and nothing else.
+static void simulateFrame(Scene &scene, FramePacket &packet) {
+    const FrameInput &input = packet.input;
+    packet.simulationStart = std::chrono::steady_clock::now();
+
+    // Camera
+    packet.view = glm::lookAt(input.eyeCenter, input.lookat, up);
+    packet.viewProjection = projectionMatrix * packet.view;
+    shadowMaps.fit(packet.view, FoV, (float)windowWidth / windowHeight, zNear, zFar, lightDirection,
+                   input.quality.shadowResolution, packet.shadows);
+    resetFramePacket(packet, scene.buildings.size(), scene.rockets.size(), scene.bots.size());
+
+    // Culling against the camera, its draw distance and the shadow cascades
+    glm::vec4 planes[6];
+    getFrustumPlanes(packet.viewProjection, planes);
+    glm::vec3 boxMin, boxMax;
+    float drawDistance = input.quality.drawDistance;
+    for (size_t i = 0; i < scene.buildings.size(); ++i) {
+        scene.buildings.getBounds(i, boxMin, boxMax);
+        if (isBoxInFrustum(planes, boxMin, boxMax) && getBoxDistance(input.eyeCenter, boxMin, boxMax) < drawDistance) {
+            packet.visibleBuildings.push_back((int)i);
         }
+    }
+    for (size_t i = 0; i < scene.rockets.size(); ++i) {
+        scene.rockets[i].getBounds(boxMin, boxMax);
+        if (isBoxInFrustum(planes, boxMin, boxMax) && getBoxDistance(input.eyeCenter, boxMin, boxMax) < drawDistance) {
+            packet.visibleRockets.push_back((int)i);
+        }
+        for (int c = 0; c < packet.shadows.numCascades; ++c) {
+            if (packet.shadows.isVisible(c, boxMin, boxMax)) packet.shadowRockets[c].push_back((int)i);
+        }
+    }
 
-        // Recursive into children nodes
-        for (size_t i = 0; i < node.children.size(); i++) {
-            assert((node.children[i] >= 0) && (node.children[i] < model.nodes.size()));
-            bindModelNodes(primitiveObjects, model, model.nodes[node.children[i]]);
+    // Bot animation. Distant bots are posed at 15 Hz, the furthest keep their
+    // pose. The distance is to the root joint of the pose on screen.
+    packet.botUpdateStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < scene.bots.size(); ++i) {
+        MyBot &bot = scene.bots[i];
+        float distance = glm::length(bot.rootPosition - input.eyeCenter);
+        float poseTime = input.time;
+        if (distance > input.quality.animationNear) poseTime = floorf(input.time * 15.0f) / 15.0f;
+        bool animate = input.animate && poseTime != bot.poseTime &&
+                       (distance <= input.quality.animationFar || bot.poseTime < 0.0f);
+        if (animate) {
+            bot.update(poseTime, *packet.arena);
+            bot.poseTime = poseTime;
         }
+        packet.botJointOffsets.push_back((int)packet.botJointMatrices.size());
+        bot.appendJointMatrices(packet.botJointMatrices);
     }
+    packet.botJointOffsets.push_back((int)packet.botJointMatrices.size());
+    packet.simulationEnd = std::chrono::steady_clock::now();
+}
 
-    std::vector<PrimitiveObject> bindModel(tinygltf::Model &model) {
-        std::vector<PrimitiveObject> primitiveObjects;
+// Largest frame and overflows of the frame arenas since they were created,
+// or since the measured frames of the last benchmark run started
+static void getFrameArenaStats(size_t &peakBytes, size_t &capacity, int &overflows) {
+    peakBytes = 0;
+    capacity = 0;
+    overflows = 0;
+    for (int i = 0; i < FRAME_PIPELINE_SLOTS; ++i) {
+        peakBytes = std::max(peakBytes, frameArenas[i].peak);
+        capacity = std::max(capacity, frameArenas[i].capacity);
+        overflows += frameArenas[i].overflows;
+    }
+}
 
-        const tinygltf::Scene &scene = model.scenes[model.defaultScene];
-        for (size_t i = 0; i < scene.nodes.size(); ++i) {
-            assert((scene.nodes[i] >= 0) && (scene.nodes[i] < model.nodes.size()));
-            bindModelNodes(primitiveObjects, model, model.nodes[scene.nodes[i]]);
+// Snapshots the current input and simulates it into the next free packet
+static void submitFrame(float time) {
+    int slot = pipeline.reserve();
+    framePackets[slot].input = getFrameInput(time);
+    pipeline.submit(slot);
+}
+
+// Writes the frame uniform block, once the shadow cascades of the frame are placed
+static void updateFrameUniforms(const FramePacket &packet) {
+    FrameUniforms frame;
+    frame.view = packet.view;
+    frame.projection = projectionMatrix;
+    frame.viewProjection = packet.viewProjection;
+    frame.inverseProjection = glm::inverse(projectionMatrix);
+    frame.inverseViewProjection = glm::inverse(packet.viewProjection);
+    for (int i = 0; i < MAX_SHADOW_CASCADES; ++i) {
+        frame.lightSpaceMatrices[i] = shadowMaps.lightSpaceMatrices[i];
+    }
+    shadowMaps.getCascadeSizes(frame.cascadeSizes);
+    skyIrradiance.getPadded(frame.shCoefficients);
+    frame.lightDirection = glm::vec4(lightDirection, 0.0f);
+    frame.pointLightPosition = glm::vec4(lightPosition, 1.0f);
+    frame.pointLightIntensity = glm::vec4(lightIntensity, 0.0f);
+    frame.renderSize = glm::vec4((float)hdrTarget.width, (float)hdrTarget.height,
+                                 1.0f / hdrTarget.targetWidth, 1.0f / hdrTarget.targetHeight);
+    frame.numCascades = shadowMaps.numCascades;
+    frame.shadowFilter = shadowMaps.filter;
+    frame.lightSize = shadowMaps.lightSize;
+    frame.padding = 0.0f;
+    frameUniforms.update(frame);
+}
+
+// Applies the render resolution and shadow cascade size of a frame. The
+// resolution only changes viewports, so it can follow the governor every frame.
+static void applyQuality(const QualitySettings &quality) {
+    float scale = renderScale * quality.renderScale;
+    int width = std::max(1, (int)(windowWidth * scale + 0.5f));
+    int height = std::max(1, (int)(windowHeight * scale + 0.5f));
+    deferred.setRenderSize(width, height);
+    ssao.setRenderSize(width, height);
+    hdrTarget.setRenderSize(width, height);
+    shadowMaps.setResolution(quality.shadowResolution);
+}
+
+// Render stage: draws a simulated frame into the default framebuffer
+static void renderFrame(Skybox &sky, Scene &scene, const FramePacket &packet) {
+    // The packet was simulated while the frame before rendered, or just now with --serial
+    profiler.addWorkerScope("Simulation", packet.simulationStart, packet.simulationEnd);
+    profiler.addWorkerScope("Bot update", packet.botUpdateStart, packet.simulationEnd);
+
+    applyQuality(packet.input.quality);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Disable face culling
+    glDisable(GL_CULL_FACE);
+
+    // Enable depth testing
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+
+    // Rendering
+    viewMatrix = packet.view;
+    glm::mat4 vp = packet.viewProjection;
+
+    // Render the shadow cascades
+    profiler.beginScope("Shadows", true);
+    shadowPassTimer.begin();
+    shadowMaps.filter = shadowFilter;
+    shadowMaps.apply(packet.shadows);
+    updateFrameUniforms(packet);
+    renderShadowCascades(scene, packet);
+    shadowPassTimer.end();
+    profiler.endScope();
+
+    if (useDeferred) {
+        scenePassTimer.begin();
+
+        // Fill the G-buffer
+        deferred.beginGeometryPass();
+        if (useDepthPrePass) {
+            profiler.beginScope("Depth pre-pass", true);
+            renderDepthPrePass(scene, packet);
+            profiler.endScope();
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+
+        if (countFragments) fragmentCounter.begin();
+        glUseProgram(deferred.boxProgram.programID);
+        profiler.beginScope("Buildings", true);
+        drawBuildings(scene.buildings, packet.visibleBuildings, vp, true);
+        profiler.endScope();
+        profiler.beginScope("Rockets", true);
+        drawObjects(scene.rockets, packet.visibleRockets, vp, [](Rocket &rocket) { rocket.renderGeometry(); });
+        profiler.endScope();
+        if (countFragments) fragmentCounter.end();
+
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        profiler.beginScope("Bot render", true);
+        drawBots(scene, packet, vp, [](MyBot &bot) { bot.renderGeometry(); });
+        profiler.endScope();
+        scenePassTimer.end();
+
+        // Ambient occlusion from the G-buffer, timed per preset inside
+        profiler.beginScope("SSAO", true);
+        if (ssao.preset != ssaoPreset) ssao.setPreset(ssaoPreset);
+        ssao.render(deferred.depthTexture, deferred.normalTexture);
+        profiler.endScope();
+
+        // Accumulate the point lights
+        lightingPassTimer.begin();
+        profiler.beginScope("Point lights", true);
+        deferred.renderLights();
+        profiler.endScope();
+
+        // The sky is drawn forward, then the composite shades the G-buffer over it
+        hdrTarget.begin();
+        profiler.beginScope("Skybox", true);
+        sky.render(vp);
+        profiler.endScope();
+        profiler.beginScope("Composite", true);
+        deferred.composite(hdrTarget.fbo, shadowMaps, ssao);
+        profiler.endScope();
+        lightingPassTimer.end();
+    } else {
+        // Forward fallback: every object shades itself
+        scenePassTimer.begin();
+        hdrTarget.begin();
+        if (useDepthPrePass) {
+            profiler.beginScope("Depth pre-pass", true);
+            renderDepthPrePass(scene, packet);
+            profiler.endScope();
+        }
+
+        // Render the skybox, only where no box is in front of it
+        profiler.beginScope("Skybox", true);
+        sky.render(vp);
+        profiler.endScope();
+
+        // Render the buildings
+        if (useDepthPrePass) {
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        if (countFragments) fragmentCounter.begin();
+        shadowMaps.bindForShading(SHADOW_TEXTURE_UNIT, SHADOW_DEPTH_TEXTURE_UNIT);
+        profiler.beginScope("Buildings", true);
+        glUseProgram(buildingMesh.programID);
+        drawBuildings(scene.buildings, packet.visibleBuildings, vp, true);
+        profiler.endScope();
+
+        /*// Render the buildings
+         for (auto &tree: trees) {
+             tree.render(vp);
+         }*/
+
+        profiler.beginScope("Rockets", true);
+        drawObjects(scene.rockets, packet.visibleRockets, vp, [](Rocket &rocket) { rocket.render(); });
+        profiler.endScope();
+        if (countFragments) fragmentCounter.end();
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+
+        // Render the bots
+        profiler.beginScope("Bot render", true);
+        drawBots(scene, packet, vp, [](MyBot &bot) { bot.render(); });
+        profiler.endScope();
+        scenePassTimer.end();
+    }
+
+    // Exposure, tone mapping and sRGB encoding into the window
+    profiler.beginScope("Resolve", true);
+    hdrTarget.resolve();
+    profiler.endScope();
+}
+
+// Camera and render settings at the start of an input recording
+static InputSessionState getSessionState() {
+    InputSessionState state;
+    state.eyeCenter = eye_center;
+    state.lookat = lookat;
+    state.viewAzimuth = viewAzimuth;
+    state.viewPolar = viewPolar;
+    state.useDeferred = useDeferred;
+    state.shadowFilter = shadowFilter;
+    state.ssaoPreset = ssaoPreset;
+    state.useDepthPrePass = useDepthPrePass;
+    state.tonemap = hdrTarget.tonemap;
+    state.exposure = hdrTarget.exposure;
+    return state;
+}
+
+static void setSessionState(const InputSessionState &state) {
+    eye_center = state.eyeCenter;
+    lookat = state.lookat;
+    viewAzimuth = state.viewAzimuth;
+    viewPolar = state.viewPolar;
+    useDeferred = state.useDeferred != 0;
+    shadowFilter = state.shadowFilter;
+    ssaoPreset = state.ssaoPreset;
+    useDepthPrePass = state.useDepthPrePass != 0;
+    hdrTarget.tonemap = state.tonemap;
+    hdrTarget.exposure = state.exposure;
+    firstMouse = true;
+}
+
+// Applies the replayed events that are due on this frame
+static void replayInput() {
+    InputEvent event;
+    while (inputLog.nextEvent(event)) {
+        if (event.type == INPUT_KEY) {
+            handleKey(event.key, event.scancode, event.action, event.mods);
+        } else if (event.type == INPUT_CURSOR) {
+            handleCursor(event.x, event.y);
+        } else if (event.type == INPUT_SCROLL) {
+            handleScroll(event.x, event.y);
+        }
+    }
+}
+
+// Interactive main loop, runs until the window is closed or a capture is complete
+static void runInteractive(Skybox &sky, Scene &scene) {
+    // Time and frame rate tracking
+    double lastTime = glfwGetTime();
+    float time = 0.0f; // Animation time
+    float fTime = 0.0f; // Time for measuring fps
+    unsigned long frames = 0;
+
+    // The first frame is simulated up front, after that each frame's input is
+    // simulated while the previous frame renders
+    submitFrame(time);
+
+    // Main loop
+    do {
+        profiler.beginFrame();
+        std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+
+        // Update states for animation
+        double currentTime = glfwGetTime();
+        float frameTime = float(currentTime - lastTime);
+        lastTime = currentTime;
+
+        // Captures advance the simulation by a fixed step so they are independent of render speed,
+        // and replays do so the recorded input lands on the same simulated frames
+        float deltaTime = captureFrames > 0 ? 1.0f / captureFps : frameTime;
+        if (inputLog.isReplaying()) {
+            if (captureFrames == 0) deltaTime = fixedFrameTime;
+            replayInput();
+            if (inputLog.isFinished()) {
+                std::cout << "Replay finished." << std::endl;
+                glfwSetWindowShouldClose(window, GL_TRUE);
+            }
+        }
+
+        if (playAnimation) {
+            time += deltaTime * playbackSpeed;
+        }
+
+        profiler.beginScope("Wait for simulation", false);
+        int slot = pipeline.acquire();
+        profiler.endScope();
+        submitFrame(time);  // Simulated while this frame renders
+        frameGpuTimer.begin();
+        renderFrame(sky, scene, framePackets[slot]);
+        frameGpuTimer.end();
+        pipeline.release(slot);
+        lastUniformStats = takeUniformStats();
+        lastStateStats = takeGLStateStats();
+        lastCallStats = takeGLCallStats();
+        glCallLog.write(lastCallStats);
+        if (validateState) validateGLState();
+
+        // Queue debug captures of the finished frame, and collect older ones
+        profiler.beginScope("Readback", false);
+        if (saveDepth) {
+            saveDepthTexture(hdrTarget.fbo, "depth_camera.png");
+            saveDepth = false;
+        }
+        if (saveScreenshot) {
+            readback.savePNG(0, READBACK_COLOR, windowWidth, windowHeight, "screenshot.png");
+            saveScreenshot = false;
+        }
+        if (captureFrames > 0) {
+            capture.submit(readback);
+            if (capture.isDone()) {
+                glfwSetWindowShouldClose(window, GL_TRUE);
+            }
         }
+        readback.update();
+        profiler.endScope();
 
-        return primitiveObjects;
-    }
+        // FPS tracking
+        frames++;
+        fTime += frameTime;
+        if (fTime > 2.0f) {
+            float fps = frames / fTime;
+            frames = 0;
+            fTime = 0;
 
-    void drawMesh(const std::vector<PrimitiveObject> &primitiveObjects,
-                  tinygltf::Model &model, tinygltf::Mesh &mesh) {
+            std::stringstream stream;
+            stream << std::fixed << std::setprecision(2) << "Final Project | Frames per second (FPS): " << fps
+                   << " | " << (useDeferred ? "Deferred" : "Forward")
+                   << " | Shadows: " << shadowFilterName(shadowFilter)
+                   << " " << shadowPassTimer.averageMs << " ms | Scene: " << scenePassTimer.averageMs << " ms"
+                   << " | Pre-pass: " << (useDepthPrePass ? "on" : "off")
+                   << " | " << tonemapName(hdrTarget.tonemap) << " x" << hdrTarget.exposure
+                   << " | Sim: " << pipeline.simulationMs << " ms";
+            if (usePipeline) stream << " (render waited " << pipeline.waitMs << " ms)";
+            else stream << " (serial)";
+            stream << " | Uniforms: " << lastUniformStats.uniformCalls << " calls, "
+                   << lastUniformStats.uniformBytes / 1024.0 << " KB + " << lastUniformStats.bufferUploads
+                   << " buffer writes, " << lastUniformStats.bufferBytes / 1024.0 << " KB"
+                   << " | State: " << lastStateStats.skipped << " of " << lastStateStats.calls << " calls skipped";
+#if GL_CALL_COUNTERS_ENABLED
+            stream << " | GL: " << lastCallStats.drawCalls << " draws, " << lastCallStats.primitives / 1000.0
+                   << "K prims, " << lastCallStats.programSwitches << " programs, "
+                   << lastCallStats.textureSwitches << " textures, " << lastCallStats.bufferUploadBytes / 1024.0
+                   << " KB buffers, " << lastCallStats.textureUploadBytes / 1024.0 << " KB textures";
+#endif
+            if (useDeferred) {
+                stream << " | Lighting: " << lightingPassTimer.averageMs << " ms"
+                       << " | SSAO: " << ssaoPresets[ssaoPreset].name;
+                if (ssao.isEnabled()) stream << " " << ssao.timers[ssaoPreset].averageMs << " ms";
+            }
+            if (countFragments) {
+                // Fragments shaded per screen pixel by the boxes, 1.0 means no overdraw
+                stream << " | Shaded fragments: " << (long long)fragmentCounter.averageCount << " ("
+                       << fragmentCounter.averageCount / (hdrTarget.width * hdrTarget.height) << " per pixel)";
+            }
+            if (governor.enabled) {
+                stream << " | Quality: " << hdrTarget.width << "x" << hdrTarget.height << ", "
+                       << governor.settings.shadowResolution << " shadows, draw " << governor.settings.drawDistance
+                       << " (CPU " << governor.cpuMs << " ms, GPU " << governor.gpuMs << " ms)";
+            }
+            glfwSetWindowTitle(window, stream.str().c_str());
+        }
 
-        for (size_t i = 0; i < mesh.primitives.size(); ++i)
-        {
-            GLuint vao = primitiveObjects[i].vao;
-            std::map<int, GLuint> vbos = primitiveObjects[i].vbos;
+        // Steps the quality for the frames submitted from now on
+        governor.update(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count(),
+                        frameGpuTimer.lastMs);
 
-            glBindVertexArray(vao);
+        // Swap buffers
+        profiler.beginScope("Swap", false);
+        glfwSwapBuffers(window);
+        profiler.endScope();
 
-            tinygltf::Primitive primitive = mesh.primitives[i];
-            tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
+        // Input polled now is stamped with, and replayed at, the start of the next frame
+        inputLog.advance(deltaTime);
+        glfwPollEvents();
+        profiler.endFrame();
 
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbos.at(indexAccessor.bufferView));
+    } while (!glfwWindowShouldClose(window));
 
-            glDrawElements(primitive.mode, indexAccessor.count,
-                           indexAccessor.componentType,
-                           BUFFER_OFFSET(indexAccessor.byteOffset));
+    // Drop the frame simulated ahead
+    pipeline.drain();
+}
 
-            glBindVertexArray(0);
-        }
-    }
+// Puts the camera on the benchmark path, t in [0, 1) over a run: one orbit
+// around the city while rising and sinking twice
+static void setBenchmarkCamera(float t) {
+    float angle = 2.0f * 3.14159265f * t;
+    eye_center = glm::vec3(900.0f * cos(angle), 400.0f + 200.0f * sin(2.0f * angle), 900.0f * sin(angle));
+    lookat = glm::vec3(0.0f, 50.0f, 0.0f);
+}
 
-    void drawModelNodes(const std::vector<PrimitiveObject>& primitiveObjects,
-                        tinygltf::Model &model, tinygltf::Node &node) {
-        // Draw the mesh at the node, and recursively do so for children nodes
-        if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
-            drawMesh(primitiveObjects, model, model.meshes[node.mesh]);
-        }
-        for (size_t i = 0; i < node.children.size(); i++) {
-            drawModelNodes(primitiveObjects, model, model.nodes[node.children[i]]);
-        }
+// Sets the camera and animation time of a benchmark frame, warm-up frames have negative numbers
+static void prepareBenchmarkFrame(int frame, float &time) {
+    if (!inputLog.isReplaying()) {
+        setBenchmarkCamera(frame < 0 ? 0.0f : (float)frame / benchFrames);
+    } else if (frame >= 0) {
+        replayInput();
+        inputLog.advance(fixedFrameTime);
     }
-    void drawModel(const std::vector<PrimitiveObject>& primitiveObjects,
-                   tinygltf::Model &model) {
-        // Draw all nodes
-        const tinygltf::Scene &scene = model.scenes[model.defaultScene];
-        for (size_t i = 0; i < scene.nodes.size(); ++i) {
-            drawModelNodes(primitiveObjects, model, model.nodes[scene.nodes[i]]);
-        }
+    if (playAnimation) {
+        time += fixedFrameTime * playbackSpeed;
     }
+}
 
-    void render(glm::mat4 cameraMatrix) {
-        glUseProgram(programID);
-
-        // Set camera
-        glm::mat4 mvp = cameraMatrix;
-        glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
+// Renders benchFrames frames for every combination of swept scene sizes, along
+// the scripted camera path or a replayed recording and at a fixed timestep,
+// and writes the statistics
+static void runBenchmark(Skybox &sky, Scene &scene, const std::vector<GLuint> &textures,
+                         const std::vector<GLuint> &rocketTextures, const InputSessionState &replayState) {
+    std::vector<int> buildingCounts = sweepBuildings.empty() ? std::vector<int>(1, numBuildings) : sweepBuildings;
+    std::vector<int> rocketCounts = sweepRockets.empty() ? std::vector<int>(1, numRockets) : sweepRockets;
+    std::vector<int> botCounts = sweepBots.empty() ? std::vector<int>(1, numBots) : sweepBots;
+
+    benchmark.initialize();
+    for (int buildingCount : buildingCounts) {
+        for (int rocketCount : rocketCounts) {
+            for (int botCount : botCounts) {
+                numBuildings = buildingCount;
+                numRockets = rocketCount;
+                numBots = botCount;
+                // A loaded city is already in place and never swept
+                if (loadScenePath.empty()) {
+                    cleanupScene(scene);
+                    if (!buildScene(scene, textures, rocketTextures)) {
+                        std::cerr << "Benchmark: skipped " << numBuildings << " buildings, " << numRockets
+                                  << " rockets, " << numBots << " bots" << std::endl;
+                        continue;
+                    }
+                }
+                benchmark.beginRun(numBuildings, numRockets, numBots, deferred.numLights);
+                std::cout << "Benchmark: " << numBuildings << " buildings, " << numRockets << " rockets, "
+                          << numBots << " bots" << std::endl;
+
+                // Every run replays the recording from its start, warm-up frames hold the first view
+                if (inputLog.isReplaying()) {
+                    setSessionState(replayState);
+                    inputLog.rewind();
+                }
 
-        // Set light data
-        glUniform3fv(lightPositionID, 1, &lightPosition[0]);
-        glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
+                // Each frame is simulated while the one before it renders
+                float time = 0.0f;
+                prepareBenchmarkFrame(-benchWarmupFrames, time);
+                submitFrame(time);
+                for (int frame = -benchWarmupFrames; frame < benchFrames; ++frame) {
+                    if (frame == 0) {
+                        // Pass timers average the measured frames only
+                        shadowPassTimer.averageMs = 0.0;
+                        scenePassTimer.averageMs = 0.0;
+                        lightingPassTimer.averageMs = 0.0;
+                        pipeline.simulationMs = 0.0;
+                        pipeline.waitMs = 0.0;
+                    }
+                    profiler.beginFrame();
+                    benchmark.beginFrame();
+                    std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+                    int slot = pipeline.acquire();
+                    if (frame == 0) {
+                        // Nothing is being simulated between acquire and submit, so
+                        // the arena figures of the run start here, warm-up excluded
+                        for (int i = 0; i < FRAME_PIPELINE_SLOTS; ++i) {
+                            frameArenas[i].resetStats();
+                        }
+                    }
+                    if (frame + 1 < benchFrames) {
+                        prepareBenchmarkFrame(frame + 1, time);
+                        submitFrame(time);
+                    }
+                    frameGpuTimer.begin();
+                    renderFrame(sky, scene, framePackets[slot]);
+                    frameGpuTimer.end();
+                    pipeline.release(slot);
+                    benchmark.endFrame(frame >= 0);
+                    governor.update(std::chrono::duration<double, std::milli>(
+                                        std::chrono::steady_clock::now() - frameStart).count(),
+                                    frameGpuTimer.lastMs);
+                    glCallLog.write(takeGLCallStats());
+                    if (validateState) validateGLState();
+                    profiler.endFrame();
+                }
 
-        for (const auto &skinObject : skinObjects) {
-            glUniformMatrix4fv(jointMatricesID, skinObject.jointMatrices.size(), GL_FALSE,
-                               glm::value_ptr(skinObject.jointMatrices[0]));
+                BenchmarkRun &run = benchmark.currentRun();
+                run.shadowMs = shadowPassTimer.averageMs;
+                run.sceneMs = scenePassTimer.averageMs;
+                run.lightingMs = lightingPassTimer.averageMs;
+                run.simulationMs = pipeline.simulationMs;
+                run.simulationWaitMs = pipeline.waitMs;
+                size_t arenaCapacity;
+                getFrameArenaStats(run.arenaPeakBytes, arenaCapacity, run.arenaOverflows);
+            }
         }
-
-        // Draw the GLTF model
-        drawModel(primitiveObjects, model);
     }
 
-    void cleanup() {
-        glDeleteProgram(programID);
-    }
+    benchmark.write(benchOutput, sceneSeed, windowWidth, windowHeight, useDeferred ? "deferred" : "forward",
+                    usePipeline);
+    benchmark.cleanup();
+}
 
-    glm::vec3 position;
-};
+static void printUsage(const char *program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --capture <frames>         Render a fixed number of frames at a fixed timestep and save them\n"
+              << "  --capture-format <format>  png (default), y4m or rgb\n"
+              << "  --capture-output <path>    PNG file prefix or stream file, may be a named pipe\n"
+              << "  --capture-fps <fps>        Simulated frame rate of the capture (default 30)\n"
+              << "  --profile <frames>         Record a CPU/GPU trace of the first frames (F key records 120 at any time)\n"
+              << "  --profile-output <path>    Chrome trace JSON file (default profile.json)\n"
+              << "  --srgb                     Request an sRGB window framebuffer for the final encoding\n"
+              << "  --serial                   Simulate and render each frame on the main thread, one after the other\n"
+              << "  --validate-gl-state        Check the GL state cache against the context every frame\n"
+              << "  --gl-stats <path>          Write draws, switches and uploads per frame as CSV (FP_GL_STATS builds)\n"
+              << "  --quality-target <ms>      Frame time the quality governor holds (default 66.7, the 15 FPS floor;\n"
+              << "                             0 disables it, benchmarks and captures default to 0)\n"
+              << "  --quality-log <path>       Write every quality decision as CSV\n"
+              << "  --render-scale <scale>     Render resolution relative to the window, 0.25 to 1 (default 1)\n"
+              << "  --sharpness <0-1>          Sharpening of the upscale below full resolution (default 0.5)\n"
+              << "  --seed <n>                 Seed of the city layout (default: clock, 1 for benchmarks)\n"
+              << "  --buildings <n>            Number of buildings (default 200, at most 750)\n"
+              << "  --rockets <n>              Number of rockets (default 20)\n"
+              << "  --bots <n>                 Number of bots (default 1), placed on the ground between the buildings\n"
+              << "  --save-scene <path>        Write the generated city to a binary snapshot\n"
+              << "  --load-scene <path>        Use the city of a snapshot instead of generating one. Its\n"
+              << "                             seed and counts replace --seed and the counts above.\n"
+              << "  --bench <frames>           Render frames offscreen along a fixed camera path and print timings as JSON\n"
+              << "  --bench-warmup <frames>    Frames rendered before measuring (default 30)\n"
+              << "  --bench-output <path>      Write the JSON to a file instead of stdout\n"
+              << "  --sweep-buildings <list>   Benchmark each comma-separated count, likewise\n"
+              << "  --sweep-rockets <list>     --sweep-rockets and --sweep-bots. Every combination is run.\n"
+              << "  --sweep-bots <list>\n"
+              << "  --record <path>            Log the camera input of the session to a binary file\n"
+              << "  --replay <path>            Play a logged session back at a fixed 60 Hz step. With --bench\n"
+              << "                             it replaces the scripted camera path." << std::endl;
+}
 
-bool isPositionInBuilding(const glm::vec3& position, const glm::vec3& size, const std::vector<Building>& buildings, float buffer) {
-    for (const auto& building : buildings) {
-        glm::vec3 buildingPos = building.getPosition();
-        glm::vec3 buildingSize = building.getSize();
-        if (position.x < buildingPos.x + buildingSize.x + buffer && position.x + size.x + buffer > buildingPos.x &&
-            position.z < buildingPos.z + buildingSize.z + buffer && position.z + size.z + buffer > buildingPos.z) {
-            return true;
+// Parses a comma-separated list of non-negative counts
+static bool parseCountList(const char *text, std::vector<int> &counts) {
+    std::stringstream stream(text);
+    std::string item;
+    counts.clear();
+    while (std::getline(stream, item, ',')) {
+        if (item.empty() || item.find_first_not_of("0123456789") != std::string::npos) return false;
+        counts.push_back(atoi(item.c_str()));
+    }
+    return !counts.empty();
+}
+
+// Returns false if the command line is invalid
+static bool parseArguments(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--capture" && hasValue) {
+            captureFrames = atoi(argv[++i]);
+        } else if (arg == "--capture-format" && hasValue) {
+            if (!parseCaptureFormat(argv[++i], captureFormat)) return false;
+        } else if (arg == "--capture-output" && hasValue) {
+            captureOutput = argv[++i];
+        } else if (arg == "--capture-fps" && hasValue) {
+            captureFps = atoi(argv[++i]);
+        } else if (arg == "--profile" && hasValue) {
+            profileFrames = atoi(argv[++i]);
+        } else if (arg == "--profile-output" && hasValue) {
+            profileOutput = argv[++i];
+        } else if (arg == "--srgb") {
+            useSRGBFramebuffer = true;
+        } else if (arg == "--gl-stats" && hasValue) {
+            glStatsOutput = argv[++i];
+        } else if (arg == "--validate-gl-state") {
+            validateState = true;
+        } else if (arg == "--serial") {
+            usePipeline = false;
+        } else if (arg == "--seed" && hasValue) {
+            sceneSeed = (unsigned int)strtoul(argv[++i], NULL, 10);
+            hasSceneSeed = true;
+        } else if (arg == "--buildings" && hasValue) {
+            numBuildings = atoi(argv[++i]);
+        } else if (arg == "--rockets" && hasValue) {
+            numRockets = atoi(argv[++i]);
+        } else if (arg == "--bots" && hasValue) {
+            numBots = atoi(argv[++i]);
+        } else if (arg == "--quality-target" && hasValue) {
+            qualityTargetMs = atof(argv[++i]);
+            hasQualityTarget = true;
+        } else if (arg == "--quality-log" && hasValue) {
+            qualityLogPath = argv[++i];
+        } else if (arg == "--render-scale" && hasValue) {
+            renderScale = (float)atof(argv[++i]);
+        } else if (arg == "--sharpness" && hasValue) {
+            upscaleSharpness = (float)atof(argv[++i]);
+        } else if (arg == "--save-scene" && hasValue) {
+            saveScenePath = argv[++i];
+        } else if (arg == "--load-scene" && hasValue) {
+            loadScenePath = argv[++i];
+        } else if (arg == "--bench" && hasValue) {
+            benchFrames = atoi(argv[++i]);
+        } else if (arg == "--bench-warmup" && hasValue) {
+            benchWarmupFrames = atoi(argv[++i]);
+        } else if (arg == "--bench-output" && hasValue) {
+            benchOutput = argv[++i];
+        } else if (arg == "--sweep-buildings" && hasValue) {
+            if (!parseCountList(argv[++i], sweepBuildings)) return false;
+        } else if (arg == "--sweep-rockets" && hasValue) {
+            if (!parseCountList(argv[++i], sweepRockets)) return false;
+        } else if (arg == "--sweep-bots" && hasValue) {
+            if (!parseCountList(argv[++i], sweepBots)) return false;
+        } else if (arg == "--record" && hasValue) {
+            recordPath = argv[++i];
+        } else if (arg == "--replay" && hasValue) {
+            replayPath = argv[++i];
+        } else {
+            return false;
         }
     }
-    return false;
+    if (captureFps <= 0 || benchWarmupFrames < 0 || qualityTargetMs < 0.0) return false;
+    if (renderScale < 0.25f || renderScale > 1.0f || upscaleSharpness < 0.0f || upscaleSharpness > 1.0f) return false;
+    if (!hasQualityTarget && (benchFrames > 0 || captureFrames > 0)) {
+        // Benchmarks and captures keep full quality unless a target is given
+        qualityTargetMs = 0.0;
+    }
+    if (numBuildings < 0 || numRockets < 0 || numBots < 0) return false;
+    // Larger cities do not fit the area, placement would give up part way
+    if (numBuildings > maxBuildings) return false;
+    for (int count : sweepBuildings) {
+        if (count > maxBuildings) return false;
+    }
+    if (!recordPath.empty() && (!replayPath.empty() || benchFrames > 0)) return false;
+    // A snapshot holds one city
+    bool sweeping = !sweepBuildings.empty() || !sweepRockets.empty() || !sweepBots.empty();
+    if ((!saveScenePath.empty() || !loadScenePath.empty()) && sweeping) return false;
+    if (benchFrames > 0 && !hasSceneSeed) {
+        // Benchmarks must be comparable between runs
+        sceneSeed = 1;
+        hasSceneSeed = true;
+    }
+    if (captureOutput.empty()) {
+        captureOutput = captureFormat == CAPTURE_Y4M ? "capture.y4m" :
+                        captureFormat == CAPTURE_RGB ? "capture.rgb" : "frame";
+    }
+    return true;
 }
 
-int main(void) {
+int main(int argc, char *argv[]) {
 
-    // Initialise GLFW
-    if (!glfwInit()) {
-        std::cerr << "Failed to initialize GLFW." << std::endl;
+    if (!parseArguments(argc, argv)) {
+        printUsage(argv[0]);
         return -1;
     }
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // For MacOS
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // Benchmarks run offscreen through EGL when it is available, otherwise in a hidden window
+    bool headless = benchFrames > 0 && createHeadlessContext(windowWidth, windowHeight);
+    if (!headless) {
+        // Initialise GLFW
+        if (!glfwInit()) {
+            std::cerr << "Failed to initialize GLFW." << std::endl;
+            return -1;
+        }
 
-    // Open a window and create its OpenGL context
-    window = glfwCreateWindow(1024, 768, "Final Project", NULL, NULL);
-    if (window == NULL) {
-        std::cerr << "Failed to open a GLFW window." << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // For MacOS
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        if (useSRGBFramebuffer) {
+            glfwWindowHint(GLFW_SRGB_CAPABLE, GL_TRUE);
+        }
+        if (benchFrames > 0) {
+            glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        }
 
-    // Ensure we can capture the escape key being pressed below
-    glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+        // Open a window and create its OpenGL context
+        window = glfwCreateWindow(windowWidth, windowHeight, "Final Project", NULL, NULL);
+        if (window == NULL) {
+            std::cerr << "Failed to open a GLFW window." << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
 
-    // Set the key callback
-    glfwSetKeyCallback(window, key_callback);
-    // Set input callbacks
-    glfwSetCursorPosCallback(window, cursor_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+        // Ensure we can capture the escape key being pressed below
+        glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 
+        // Set the key callback
+        glfwSetKeyCallback(window, key_callback);
+        // Set input callbacks
+        glfwSetCursorPosCallback(window, cursor_callback);
+        glfwSetScrollCallback(window, scroll_callback);
 
 
-    // Load OpenGL functions, gladLoadGL returns the loaded version, 0 on error.
-    int version = gladLoadGL(glfwGetProcAddress);
-    if (version == 0) {
-        std::cerr << "Failed to initialize OpenGL context." << std::endl;
-        return -1;
+
+        // Load OpenGL functions, gladLoadGL returns the loaded version, 0 on error.
+        int version = gladLoadGL(glfwGetProcAddress);
+        if (version == 0) {
+            std::cerr << "Failed to initialize OpenGL context." << std::endl;
+            return -1;
+        }
+
+        // The framebuffer can be larger than the window on high-DPI displays
+        glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
     }
 
     glEnable(GL_DEPTH_TEST);
@@ -1494,13 +2697,70 @@ int main(void) {
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
 
+    // Uniform blocks shared by every program, and counters of the uniform traffic
+    installUniformCounters();
+    installCallCounters();  // Before the state cache, so only calls reaching the driver are counted
+    installStateCache();
+
+    // Programs come from stored binaries when possible. The rest are all
+    // started here, so a driver that compiles in parallel has them at once.
+    initializeProgramCache(headless ? getHeadlessProcAddress : (GLADloadfunc)glfwGetProcAddress,
+                           "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\cache");
+    PrecompileShaders({
+            {"C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\skybox.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\skybox.frag"},
+            {"C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\box.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\box.frag"},
+            {"C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\depth.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\depth.frag"},
+            {"C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\bot.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\bot.frag"},
+            {"C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\bot_depth.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\depth.frag"},
+            {"C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\bot.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\gbuffer_bot.frag"},
+            {"C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\box.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\gbuffer_box.frag"},
+            {"C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\light_volume.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\light_volume.frag"},
+            {"C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\fullscreen.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\deferred_composite.frag"},
+            {"C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\fullscreen.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\ssao.frag"},
+            {"C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\fullscreen.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\ssao_blur.frag"},
+            {"C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\fullscreen.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\resolve.frag"},
+    });
+
+    if (!glStatsOutput.empty()) {
+        if (!GL_CALL_COUNTERS_ENABLED) {
+            std::cerr << "--gl-stats needs a build configured with -DFP_GL_STATS=ON." << std::endl;
+        } else {
+            glCallLog.open(glStatsOutput);
+        }
+    }
+    frameUniforms.initialize();
+    uniformRing.initialize(uniformRingSize);
+
+    // Prepare cascaded shadow maps for the directional light
+    shadowMaps.initialize(numShadowCascades, shadowMapWidth, shadowDistance);
+    depthProgramID = LoadShadersFromFile("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\depth.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\depth.frag");
+    if (depthProgramID == 0) {
+        std::cerr << "Failed to load depth shaders." << std::endl;
+    }
+    shadowPassTimer.initialize();
+    scenePassTimer.initialize();
+    fragmentCounter.initialize();
+    frameGpuTimer.initialize();
+    governor.initialize(qualityTargetMs, shadowMapWidth, zFar, qualityLogPath);
+
     Skybox sky;
+    const char *skyTexturePath = "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\background\\planet8.jpeg";
     sky.initialize(glm::vec3(eye_center.x, eye_center.y - 5000, eye_center.z), glm::vec3(5000, 5000, 5000),
-                   "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\background\\planet8.jpeg");
+                   skyTexturePath);
+
+    // Project the sky onto SH once, shaders then get ambient light for a few multiply-adds
+    if (!computeSkyIrradiance(skyTexturePath, sky.vertex_buffer_data, sky.uv_buffer_data, 6,
+                              skyIrradiance, cacheSkyIrradiance)) {
+        // Fall back to the old flat ambient term
+        for (int k = 0; k < 9; ++k) skyIrradiance.coefficients[k] = glm::vec3(0.0f);
+        skyIrradiance.coefficients[0] = glm::vec3(0.3f / 0.282095f);
+    }
 
 
     // Seed the random number generator
-    srand(static_cast<unsigned int>(time(0)));
+    if (!hasSceneSeed) {
+        sceneSeed = static_cast<unsigned int>(time(0));
+    }
 
     //Declare and initialize the textures vector
     std::vector<GLuint> textures;
@@ -1514,128 +2774,60 @@ int main(void) {
             "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\buildings\\facade9.jpg"));
     // Add more textures as needed
 
-    // Create multiple buildings
-    std::vector<Building> buildings;
-    int numBuildings = 200; // Adjust this number to add more buildings
-
-    for (int i = 0; i < numBuildings; ++i) {
-        buildings.push_back(Building());
-    }
-
-    float buffer = 40.0f; // Adjust this value to increase or decrease the buffer zone
-
-    for (int i = 0; i < numBuildings; ++i) {
-        // Increase the size range for buildings
-        float height = 10.0f + static_cast<float>(rand() % 100 + 1); // Random height between 10 and 110
-        float width = 10.0f + static_cast<float>(rand() % 20 + 1);   // Random width between 10 and 30
-        float depth = 10.0f + static_cast<float>(rand() % 20 + 1);   // Random depth between 10 and 30
-
-        glm::vec3 size(width, height, depth);
-        glm::vec3 position;
-
-        // Ensure buildings do not overlap
-        do {
-            position.x = static_cast<float>(rand() % 2000 - 1000); // Random x position between -1000 and 1000
-            position.z = static_cast<float>(rand() % 2000 - 1000); // Random z position between -1000 and 1000
-        } while (isPositionInBuilding(position, size, buildings, buffer));
-
-        buildings[i].initialize(position, size);
-        buildings[i].setTexture(textures[i % textures.size()]);
-    }
-
-
-    /* std::vector<GLuint> treeTextures;
-     treeTextures.push_back(LoadTextureTileBox(
-             "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\buildings\\tree3.png"));
-
-     std::vector<Rocket> trees;
-     int numTrees = 20; // Adjust this number to add more buildings
-
-     for (int i = 0; i < numTrees; ++i) {
-         trees.push_back(Rocket());
-     }
-
-     for (int i = 0; i < numTrees; ++i) {
-         // Increase the size range for buildings
-         // Increase the size range for buildings
-         float height_t = 25.0f ; // Random height between 10 and 110
-         float width_t = 25.0f;   // Random width between 10 and 30
-         float depth_t = 25.0f;   // Random depth between 10 and 30
-
-         glm::vec3 size_t(width_t, height_t, depth_t);
-         glm::vec3 position_t;
-
-         // Ensure trees do not overlap with buildings
-         do {
-             position_t.x = static_cast<float>(rand() % 2000 - 1000); // Random x position between -1000 and 1000
-             position_t.z = static_cast<float>(rand() % 2000 - 1000); // Random z position between -1000 and 1000
-         } while (isPositionInBuilding(position_t, size_t, buildings, buffer));
-
-         trees[i].initialize(position_t, size_t);
-         trees[i].setTexture(treeTextures[i % treeTextures.size()]);
-         std::cout << "Tree initialized at position: (" << position_t.x << ", 0, " << position_t.z << ") with size: (" << width_t << ", " << height_t << ", " << depth_t << ")" << std::endl;
-
- }*/
-
     std::vector<GLuint> rocketTextures;
     rocketTextures.push_back(LoadTextureTileBox(
             "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\buildings\\rocket.jpeg"));
 
-    std::vector<Rocket> rockets;
-    int numRockets = 20; // Adjust this number to add more buildings
+    // Every building draws this one box with one of the facades. Its forward
+    // program is also the rockets'.
+    buildingMesh.initialize(textures);
 
-    for (int i = 0; i < numRockets; ++i) {
-        rockets.push_back(Rocket());
+    // Character types are loaded once, the bots of a scene share them
+    if (botAsset.load("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\model\\bot\\bot.gltf")) {
+        printBotAssetMemory(botAsset, "bot.gltf");
     }
 
-    for (int i = 0; i < numRockets; ++i) {
-        // Increase the size range for buildings
-        // Increase the size range for buildings
-        float height_r = 25.0f ; // Random height between 10 and 110
-        float width_r = 25.0f;   // Random width between 10 and 30
-        float depth_r = 25.0f;   // Random depth between 10 and 30
-
-        glm::vec3 size_t(width_r, height_r, depth_r);
-        glm::vec3 position_r;
-
-        // Ensure trees do not overlap with buildings
-        do {
-            position_r.x = static_cast<float>(rand() % 2000 - 1000); // Random x position between -1000 and 1000
-            position_r.z = static_cast<float>(rand() % 2000 - 1000); // Random z position between -1000 and 1000
-            position_r.y = static_cast<float>(rand() % 1000 + 700);   // Random y position between 100 and 600 (sky level)
-        } while (isPositionInBuilding(position_r, size_t, buildings, buffer));
+    // Prepare the deferred renderer, the city then adds its point lights
+    deferred.initialize(windowWidth, windowHeight);
 
-        rockets[i].initialize(position_r, size_t);
-        rockets[i].setTexture(rocketTextures[i % rocketTextures.size()]);
+    // The benchmark builds its own scene for every swept size, unless it is loaded
+    Scene scene;
+    if (benchFrames == 0 || !loadScenePath.empty()) {
+        if (!buildScene(scene, textures, rocketTextures)) {
+            return -1;
+        }
+        std::cout << "Point lights: " << deferred.numLights << std::endl;
     }
 
-
-    /*// Seed the random number generator
-    srand(static_cast<unsigned int>(time(0)));
-
-    // Create multiple bots
-    std::vector<MyBot> bots;
-    int numBots = 20; // Adjust this number to add more bots
-
-    for (int i = 0; i < numBots; ++i) {
-        bots.push_back(MyBot());
+    // Screenshots and depth dumps are read back without stalling
+    if (captureFrames > 0) {
+        // Keep all but one core busy encoding frames
+        int numWorkers = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+        readback.initialize(numWorkers);
+        if (!capture.initialize(captureFormat, captureOutput, captureFrames, windowWidth, windowHeight,
+                                captureFps, READBACK_RING_SIZE + 2 * numWorkers)) {
+            return -1;
+        }
+        if (captureFormat == CAPTURE_RGB) {
+            std::cout << "Raw capture, encode with: ffmpeg -f rawvideo -pixel_format rgb24 -video_size "
+                      << windowWidth << "x" << windowHeight << " -framerate " << captureFps
+                      << " -i " << captureOutput << " capture.mp4" << std::endl;
+        }
+    } else {
+        readback.initialize();
     }
 
-    for (int i = 0; i < numBots; ++i) {
-
-        // Increase the range for position generation
-        float xPos = static_cast<float>(rand() % 2000 - 1000); // Random x position between -1000 and 1000
-        float zPos = static_cast<float>(rand() % 2000 - 1000); // Random z position between -1000 and 1000
-
-        bots[i].initialize(glm::vec3(xPos, 0.0f, zPos));
+    ssao.initialize(windowWidth, windowHeight, ssaoPreset);
+    lightingPassTimer.initialize();
 
-    }*/
+    // Scenes render linear radiance into the HDR target. sRGB writes stay on
+    // for the G-buffer albedo, the resolve decides about the window itself.
+    hdrTarget.initialize(windowWidth, windowHeight, useSRGBFramebuffer);
+    hdrTarget.sharpness = upscaleSharpness;
+    glEnable(GL_FRAMEBUFFER_SRGB);
 
-    // Create a single bot
-    MyBot bot;
-    float botXPos = static_cast<float>(rand() % 2000 - 1000); // Random x position between -1000 and 1000
-    float botZPos = static_cast<float>(rand() % 2000 - 1000); // Random z position between -1000 and 1000
-    bot.initialize(glm::vec3(botXPos, 0.0f, botZPos));
+    profiler.initialize();
+    profiler.start(profileFrames, profileOutput);
 
 // Camera setup
     eye_center.y = viewDistance * cos(viewPolar);
@@ -1644,94 +2836,76 @@ int main(void) {
 
     projectionMatrix = glm::perspective(glm::radians(FoV), 1024.0f / 768.0f, zNear, zFar);
 
-// Time and frame rate tracking
-    static double lastTime = glfwGetTime();
-    float time = 0.0f; // Animation time
-    float fTime = 0.0f; // Time for measuring fps
-    unsigned long frames = 0;
-
-
-// Main loop
-    do {
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // Disable face culling
-        glDisable(GL_CULL_FACE);
-
-        // Enable depth testing
-        glEnable(GL_DEPTH_TEST);
-        glDepthFunc(GL_LESS);
-
-        // Update states for animation
-        double currentTime = glfwGetTime();
-        float deltaTime = float(currentTime - lastTime);
-        lastTime = currentTime;
-
-        if (playAnimation) {
-            time += deltaTime * playbackSpeed;
-            bot.update(time);
-        }
-
-        // Rendering
-        viewMatrix = glm::lookAt(eye_center, lookat, up);
-        glm::mat4 vp = projectionMatrix * viewMatrix;
-
-        // Render the skybox
-        sky.render(vp);
-
-        // Render the buildings
-        for (auto &building : buildings) {
-            building.render(vp);
-        }
-
-        /*// Render the buildings
-         for (auto &tree: trees) {
-             tree.render(vp);
-         }*/
-
-        for (auto &rocket: rockets) {
-            rocket.render(vp);
+    // A replay starts from the recorded camera and settings instead
+    InputSessionState replayState;
+    if (!replayPath.empty()) {
+        if (!inputLog.startReplay(replayPath, replayState)) {
+            return -1;
         }
-
-        /*// Render the bots
-        int i = 0;
-        for (auto& bot : bots) {
-            i++;
-            std::cout << "Rendering bot number: (" << i << std::endl;
-            bot.render(vp);
-
-            std::cout << "Rendering bot at position: (" << bot.position.x << ", " << bot.position.y << ", " << bot.position.z << ")" << std::endl;
-        }*/
-
-        // Render the single bot
-        bot.render(vp);
-
-        // FPS tracking
-        frames++;
-        fTime += deltaTime;
-        if (fTime > 2.0f) {
-            float fps = frames / fTime;
-            frames = 0;
-            fTime = 0;
-
-            std::stringstream stream;
-            stream << std::fixed << std::setprecision(2) << "Final Project | Frames per second (FPS): " << fps;
-            glfwSetWindowTitle(window, stream.str().c_str());
+        setSessionState(replayState);
+    } else if (!recordPath.empty()) {
+        if (!inputLog.startRecording(recordPath, getSessionState())) {
+            return -1;
         }
+    }
 
-        // Swap buffers
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    for (int i = 0; i < FRAME_PIPELINE_SLOTS; ++i) {
+        frameArenas[i].initialize(FRAME_ARENA_CAPACITY);
+        framePackets[i].arena = &frameArenas[i];
+    }
+    pipeline.initialize(usePipeline, [&scene](int slot) { simulateFrame(scene, framePackets[slot]); });
 
-    } while (!glfwWindowShouldClose(window));
+    if (benchFrames > 0) {
+        runBenchmark(sky, scene, textures, rocketTextures, replayState);
+    } else {
+        runInteractive(sky, scene);
+    }
+    inputLog.stop();
+    pipeline.cleanup();
+
+    size_t arenaPeak, arenaCapacity;
+    int arenaOverflows;
+    getFrameArenaStats(arenaPeak, arenaCapacity, arenaOverflows);
+    std::cout << "Frame arenas: peak " << arenaPeak / 1024.0 << " KB of " << arenaCapacity / 1024 << " KB, "
+              << arenaOverflows << " allocations overflowed to the heap" << std::endl;
+    for (int i = 0; i < FRAME_PIPELINE_SLOTS; ++i) {
+        frameArenas[i].cleanup();
+    }
 
 // Clean up
     sky.cleanup();
+    shadowMaps.cleanup();
+    shadowPassTimer.cleanup();
+    scenePassTimer.cleanup();
+    lightingPassTimer.cleanup();
+    fragmentCounter.cleanup();
+    frameGpuTimer.cleanup();
+    governor.cleanup();
+    deferred.cleanup();
+    ssao.printTimings();
+    printProgramCacheStats();
+    ssao.cleanup();
+    hdrTarget.cleanup();
+    profiler.cleanup();
+    if (captureFrames > 0) {
+        capture.finish(readback);
+    }
+    readback.cleanup();
+    frameUniforms.cleanup();
+    uniformRing.cleanup();
+    glCallLog.close();
+    glDeleteProgram(depthProgramID);
 
-    bot.cleanup();
+    cleanupScene(scene);
+    buildingMesh.cleanup();
+    botAsset.cleanup();
 
 // Close OpenGL window and terminate GLFW
-    glfwTerminate();
+    if (headless) {
+        destroyHeadlessContext();
+    } else {
+        glfwTerminate();
+    }
     return 0;
 }
 
@@ -1746,7 +2920,32 @@ void update_view_matrix() {
 
     viewMatrix = glm::lookAt(eye_center, eye_center + glm::vec3(0.0f, 0.0f, -1.0f), up);
 }
+// GLFW input is logged while recording and ignored during a replay, apart
+// from Escape. The handlers below apply it and are also fed by the replay.
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode) {
+    if (inputLog.isReplaying()) {
+        if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
+            glfwSetWindowShouldClose(window, GL_TRUE);
+        }
+        return;
+    }
+    inputLog.recordKey(key, scancode, action, mode);
+    handleKey(key, scancode, action, mode);
+}
+
+void cursor_callback(GLFWwindow* window, double xpos, double ypos) {
+    if (inputLog.isReplaying()) return;
+    inputLog.recordCursor(xpos, ypos);
+    handleCursor(xpos, ypos);
+}
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+    if (inputLog.isReplaying()) return;
+    inputLog.recordScroll(xoffset, yoffset);
+    handleScroll(xoffset, yoffset);
+}
+
+static void handleKey(int key, int scancode, int action, int mode) {
     float moveSpeed = 10.0f; // Increase this value to speed up the camera movement
     float verticalBoundary = 1500.0f; // Define the vertical boundary for the camera
 
@@ -1796,26 +2995,73 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         //update_view_matrix();
     }
 
-    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+        shadowFilter = (shadowFilter + 1) % SHADOW_FILTER_COUNT;
+        std::cout << "Shadow filter: " << shadowFilterName(shadowFilter) << std::endl;
+    }
+
+    if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
+        saveDepth = true;
+    }
+
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        saveScreenshot = true;
+    }
+
+    if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
+        useDepthPrePass = !useDepthPrePass;
+        std::cout << "Depth pre-pass: " << (useDepthPrePass ? "on" : "off") << std::endl;
+    }
+
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        countFragments = !countFragments;
+        fragmentCounter.averageCount = 0.0;
+    }
+
+    if (key == GLFW_KEY_Y && action == GLFW_PRESS) {
+        ssaoPreset = (ssaoPreset + 1) % SSAO_PRESET_COUNT;
+        std::cout << "SSAO: " << ssaoPresets[ssaoPreset].name << std::endl;
+    }
+
+    if (key == GLFW_KEY_F && action == GLFW_PRESS) {
+        profiler.start(profileFrames > 0 ? profileFrames : 120, profileOutput);
+    }
+
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        hdrTarget.tonemap = (hdrTarget.tonemap + 1) % TONEMAP_COUNT;
+        std::cout << "Tone mapping: " << tonemapName(hdrTarget.tonemap) << std::endl;
+    }
+
+    // Exposure in half stops
+    if (key == GLFW_KEY_EQUAL && (action == GLFW_REPEAT || action == GLFW_PRESS)) {
+        hdrTarget.exposure *= 1.41421356f;
+    }
+    if (key == GLFW_KEY_MINUS && (action == GLFW_REPEAT || action == GLFW_PRESS)) {
+        hdrTarget.exposure /= 1.41421356f;
+    }
+
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        useDeferred = !useDeferred;
+        std::cout << "Renderer: " << (useDeferred ? "deferred" : "forward") << std::endl;
+    }
+
+    // Headless benchmarks have no window to close
+    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS && window != NULL) {
         glfwSetWindowShouldClose(window, GL_TRUE);
     }
 }
 
-void cursor_callback(GLFWwindow* window, double xpos, double ypos) {
-    static float lastX = 1024.0f / 2.0;
-    static float lastY = 768.0f / 2.0;
-    static bool firstMouse = true;
-
+static void handleCursor(double xpos, double ypos) {
     if (firstMouse) {
-        lastX = xpos;
-        lastY = ypos;
+        cursorLastX = xpos;
+        cursorLastY = ypos;
         firstMouse = false;
     }
 
-    float xoffset = xpos - lastX;
-    float yoffset = lastY - ypos; // Reversed since y-coordinates go from bottom to top
-    lastX = xpos;
-    lastY = ypos;
+    float xoffset = xpos - cursorLastX;
+    float yoffset = cursorLastY - ypos; // Reversed since y-coordinates go from bottom to top
+    cursorLastX = xpos;
+    cursorLastY = ypos;
 
     float sensitivity = 0.05f;
     xoffset *= sensitivity;
@@ -1829,7 +3075,7 @@ void cursor_callback(GLFWwindow* window, double xpos, double ypos) {
     update_view_matrix();
 }
 
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+static void handleScroll(double xoffset, double yoffset) {
     if (yoffset < 0) { // Scroll down
         eye_center.x += 0.95f; // Move the camera to the right
     } else if (yoffset > 0) { // Scroll up
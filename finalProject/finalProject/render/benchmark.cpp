@@ -0,0 +1,141 @@
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+void Benchmark::initialize()
+{
+	glGenQueries(2, queries);
+}
+
+void Benchmark::beginRun(int numBuildings, int numRockets, int numBots, int numPointLights)
+{
+	BenchmarkRun run;
+	run.numBuildings = numBuildings;
+	run.numRockets = numRockets;
+	run.numBots = numBots;
+	run.numPointLights = numPointLights;
+	run.shadowMs = 0.0;
+	run.sceneMs = 0.0;
+	run.lightingMs = 0.0;
+	run.simulationMs = 0.0;
+	run.simulationWaitMs = 0.0;
+	memset(&run.uniforms, 0, sizeof(run.uniforms));
+	memset(&run.state, 0, sizeof(run.state));
+	memset(&run.heap, 0, sizeof(run.heap));
+	run.arenaPeakBytes = 0;
+	run.arenaOverflows = 0;
+	runs.push_back(run);
+}
+
+void Benchmark::beginFrame()
+{
+	frameStart = std::chrono::steady_clock::now();
+	glQueryCounter(queries[0], GL_TIMESTAMP);
+}
+
+void Benchmark::endFrame(bool record)
+{
+	glQueryCounter(queries[1], GL_TIMESTAMP);
+	std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+	glFinish();
+	std::chrono::steady_clock::time_point finished = std::chrono::steady_clock::now();
+	UniformStats uniforms = takeUniformStats();
+	GLStateStats state = takeGLStateStats();
+	HeapStats heap = takeHeapStats();
+	if (!record) return;
+
+	GLuint64 gpuStart = 0, gpuEnd = 0;
+	glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &gpuStart);
+	glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &gpuEnd);
+
+	BenchmarkRun &run = runs.back();
+	run.frameMs.push_back(std::chrono::duration<double, std::milli>(finished - frameStart).count());
+	run.cpuMs.push_back(std::chrono::duration<double, std::milli>(submitted - frameStart).count());
+	run.gpuMs.push_back((gpuEnd - gpuStart) / 1.0e6);
+	run.uniforms.uniformCalls += uniforms.uniformCalls;
+	run.uniforms.uniformBytes += uniforms.uniformBytes;
+	run.uniforms.bufferUploads += uniforms.bufferUploads;
+	run.uniforms.bufferBytes += uniforms.bufferBytes;
+	run.uniforms.rangeBinds += uniforms.rangeBinds;
+	run.state.calls += state.calls;
+	run.state.skipped += state.skipped;
+	run.heap.allocations += heap.allocations;
+	run.heap.bytes += heap.bytes;
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const std::vector<double> &sorted, double p)
+{
+	if (sorted.empty()) return 0.0;
+	size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.5);
+	rank = std::min(std::max(rank, (size_t)1), sorted.size());
+	return sorted[rank - 1];
+}
+
+static void writeSeries(FILE *file, const char *name, const std::vector<double> &values)
+{
+	std::vector<double> sorted(values);
+	std::sort(sorted.begin(), sorted.end());
+	double sum = 0.0;
+	for (size_t i = 0; i < sorted.size(); ++i) sum += sorted[i];
+	double mean = sorted.empty() ? 0.0 : sum / sorted.size();
+
+	fprintf(file, "\"%s\": {\"mean\": %.3f, \"min\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}",
+	        name, mean, sorted.empty() ? 0.0 : sorted.front(), percentile(sorted, 50.0),
+	        percentile(sorted, 95.0), percentile(sorted, 99.0), sorted.empty() ? 0.0 : sorted.back());
+}
+
+bool Benchmark::write(const std::string &path, unsigned int seed, int width, int height, const char *renderer,
+                      bool pipelined) const
+{
+	FILE *file = path.empty() ? stdout : fopen(path.c_str(), "w");
+	if (!file) {
+		std::cerr << "Failed to write " << path << std::endl;
+		return false;
+	}
+
+	fprintf(file, "{\n  \"seed\": %u,\n  \"width\": %d,\n  \"height\": %d,\n  \"renderer\": \"%s\",\n"
+	        "  \"pipelined\": %s,\n  \"runs\": [\n", seed, width, height, renderer, pipelined ? "true" : "false");
+	for (size_t i = 0; i < runs.size(); ++i) {
+		const BenchmarkRun &run = runs[i];
+		fprintf(file, "    {\n      \"buildings\": %d, \"rockets\": %d, \"bots\": %d, \"pointLights\": %d, \"frames\": %d,\n",
+		        run.numBuildings, run.numRockets, run.numBots, run.numPointLights, (int)run.frameMs.size());
+		fprintf(file, "      ");
+		writeSeries(file, "frameMs", run.frameMs);
+		fprintf(file, ",\n      ");
+		writeSeries(file, "cpuMs", run.cpuMs);
+		fprintf(file, ",\n      ");
+		writeSeries(file, "gpuMs", run.gpuMs);
+		fprintf(file, ",\n      \"passesMs\": {\"shadows\": %.3f, \"scene\": %.3f, \"lighting\": %.3f},\n",
+		        run.shadowMs, run.sceneMs, run.lightingMs);
+		fprintf(file, "      \"simulationMs\": {\"stage\": %.3f, \"renderWait\": %.3f},\n",
+		        run.simulationMs, run.simulationWaitMs);
+		double frames = std::max((double)run.frameMs.size(), 1.0);
+		fprintf(file, "      \"uniformsPerFrame\": {\"calls\": %.1f, \"bytes\": %.0f, \"bufferUploads\": %.1f, "
+		        "\"bufferBytes\": %.0f, \"rangeBinds\": %.1f},\n",
+		        run.uniforms.uniformCalls / frames, run.uniforms.uniformBytes / frames,
+		        run.uniforms.bufferUploads / frames, run.uniforms.bufferBytes / frames,
+		        run.uniforms.rangeBinds / frames);
+		fprintf(file, "      \"stateCallsPerFrame\": {\"calls\": %.1f, \"skipped\": %.1f},\n",
+		        run.state.calls / frames, run.state.skipped / frames);
+		fprintf(file, "      \"heapPerFrame\": {\"allocations\": %.1f, \"bytes\": %.0f},\n",
+		        run.heap.allocations / frames, run.heap.bytes / frames);
+		fprintf(file, "      \"frameArena\": {\"peakBytes\": %llu, \"overflows\": %d}\n    }%s\n",
+		        (unsigned long long)run.arenaPeakBytes, run.arenaOverflows, i + 1 < runs.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+
+	if (file != stdout) {
+		fclose(file);
+		std::cout << "Benchmark results written to " << path << std::endl;
+	}
+	return true;
+}
+
+void Benchmark::cleanup()
+{
+	glDeleteQueries(2, queries);
+}
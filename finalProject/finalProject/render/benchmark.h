@@ -0,0 +1,80 @@
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <glad/gl.h>
+
+#include "uniformBuffers.h"
+#include "glState.h"
+#include "frameArena.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Scene size and results of one benchmark run
+struct BenchmarkRun {
+    int numBuildings;
+    int numRockets;
+    int numBots;
+    int numPointLights;
+
+    // Per frame, in milliseconds
+    std::vector<double> frameMs;    // Start of the frame until the GPU finished it
+    std::vector<double> cpuMs;      // Time spent submitting commands
+    std::vector<double> gpuMs;      // First to last GPU command of the frame
+
+    // Moving averages of the renderer's GPU pass timers at the end of the run
+    double shadowMs;
+    double sceneMs;
+    double lightingMs;
+
+    // Moving averages of the CPU simulation stage and of the render stage waiting for it
+    double simulationMs;
+    double simulationWaitMs;
+
+    // Uniform calls and uniform buffer traffic, summed over the measured frames
+    UniformStats uniforms;
+
+    // Cached state changes and the ones dropped as redundant, likewise
+    GLStateStats state;
+
+    // Heap allocations on every thread, likewise, and the frame arenas at the end of the run
+    HeapStats heap;
+    size_t arenaPeakBytes;          // Largest frame in any arena so far
+    int arenaOverflows;             // Allocations that did not fit, so far
+};
+
+// Frame timing for --bench. Every frame is finished with glFinish, so frames
+// do not overlap and the CPU and GPU parts can be told apart: the CPU time is
+// the submission, the GPU time comes from a pair of GL_TIMESTAMP queries
+// around the frame.
+struct Benchmark {
+    std::vector<BenchmarkRun> runs;
+
+    void initialize();
+
+    // Starts a run with the given scene size
+    void beginRun(int numBuildings, int numRockets, int numBots, int numPointLights);
+
+    void beginFrame();
+
+    // Waits for the GPU and collects the uniform, state and heap traffic of the frame. Frames
+    // with record == false (warm-up) are not kept.
+    void endFrame(bool record);
+
+    BenchmarkRun &currentRun() { return runs.back(); }
+
+    // Writes every run as JSON with mean and p50/p95/p99 per series, and the
+    // uniform, state and heap traffic per frame.
+    // An empty path writes to stdout.
+    bool write(const std::string &path, unsigned int seed, int width, int height, const char *renderer,
+               bool pipelined) const;
+
+    void cleanup();
+
+private:
+    GLuint queries[2];
+    std::chrono::steady_clock::time_point frameStart;
+};
+
+#endif
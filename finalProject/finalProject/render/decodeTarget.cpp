@@ -0,0 +1,50 @@
+#include "decodeTarget.h"
+
+#include <cstdlib>
+#include <cstring>
+
+// The target of this thread, handed out at most once
+static thread_local void *target = NULL;
+static thread_local size_t targetBytes = 0;
+static thread_local bool targetTaken = false;
+
+void setDecodeTarget(void *memory, size_t imageBytes)
+{
+	target = memory;
+	targetBytes = imageBytes;
+	targetTaken = false;
+}
+
+void clearDecodeTarget()
+{
+	target = NULL;
+	targetBytes = 0;
+	targetTaken = false;
+}
+
+void *decodeMalloc(size_t size)
+{
+	if (target != NULL && !targetTaken && (size == targetBytes || size == targetBytes + 1)) {
+		targetTaken = true;
+		return target;
+	}
+	return malloc(size);
+}
+
+void *decodeRealloc(void *memory, size_t oldSize, size_t newSize)
+{
+	if (memory != NULL && memory == target) {
+		// The target went to a buffer that grows, move it to the heap
+		void *grown = malloc(newSize);
+		if (grown != NULL) memcpy(grown, memory, oldSize < newSize ? oldSize : newSize);
+		return grown;
+	}
+	return realloc(memory, newSize);
+}
+
+void decodeFree(void *memory)
+{
+	// The target belongs to the caller
+	if (memory != NULL && memory == target) return;
+	free(memory);
+}
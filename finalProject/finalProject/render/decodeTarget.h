@@ -0,0 +1,23 @@
+#ifndef _DECODE_TARGET_H_
+#define _DECODE_TARGET_H_
+
+#include <cstddef>
+
+// Lets stb_image decode into memory of the caller's, e.g. a mapped pixel
+// unpack buffer. stb_image always allocates its output itself, so headers.h
+// routes its STBI_MALLOC, STBI_REALLOC_SIZED and STBI_FREE through here.
+//
+// While a target is set on a thread, the first allocation stb_image makes on
+// that thread of the image size (width * height * channels, one byte more
+// for JPEG) is given the target instead of heap memory. For the JPEG and PNG
+// files we load that allocation is the decoded image. Callers compare the
+// returned pixels with the target: any other pointer came from the heap, is
+// copied and freed as usual.
+void setDecodeTarget(void *memory, size_t imageBytes);  // memory holds imageBytes + 1
+void clearDecodeTarget();
+
+void *decodeMalloc(size_t size);
+void *decodeRealloc(void *memory, size_t oldSize, size_t newSize);
+void decodeFree(void *memory);
+
+#endif
@@ -0,0 +1,270 @@
+#include "deferred.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <iostream>
+
+static GLuint createTarget(GLenum internalFormat, GLenum format, GLenum type, int width, int height)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return texture;
+}
+
+static void checkFramebuffer(const char *name)
+{
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << name << " framebuffer is not complete." << std::endl;
+	}
+}
+
+void DeferredRenderer::initialize(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+	targetWidth = width;
+	targetHeight = height;
+	numLights = 0;
+	createTargets();
+
+	// Unit box for the light volumes, wound counter-clockwise from the outside
+	static const GLfloat boxVertices[] = {
+		-1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,   1.0f, 1.0f, -1.0f,   -1.0f, 1.0f, -1.0f,
+		-1.0f, -1.0f, 1.0f,    1.0f, -1.0f, 1.0f,    1.0f, 1.0f, 1.0f,    -1.0f, 1.0f, 1.0f,
+	};
+	static const GLuint boxIndices[] = {
+		0, 3, 2,  0, 2, 1,    // -Z
+		4, 5, 6,  4, 6, 7,    // +Z
+		0, 4, 7,  0, 7, 3,    // -X
+		1, 2, 6,  1, 6, 5,    // +X
+		0, 1, 5,  0, 5, 4,    // -Y
+		3, 7, 6,  3, 6, 2,    // +Y
+	};
+
+	glGenVertexArrays(1, &lightVAO);
+	glBindVertexArray(lightVAO);
+
+	glGenBuffers(1, &lightVertexBufferID);
+	glBindBuffer(GL_ARRAY_BUFFER, lightVertexBufferID);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(boxVertices), boxVertices, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+	// Per-instance light data
+	glGenBuffers(1, &lightInstanceBufferID);
+	glBindBuffer(GL_ARRAY_BUFFER, lightInstanceBufferID);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(PointLight), (void*)0);
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(PointLight), (void*)sizeof(glm::vec4));
+	glVertexAttribDivisor(2, 1);
+
+	glGenBuffers(1, &lightIndexBufferID);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lightIndexBufferID);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(boxIndices), boxIndices, GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+	glGenVertexArrays(1, &emptyVAO);
+
+	// Programs
+	lightProgramID = LoadShadersFromFile("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\light_volume.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\light_volume.frag");
+	if (lightProgramID == 0) {
+		std::cerr << "Failed to load light volume shaders." << std::endl;
+	}
+	lightNormalMapID = glGetUniformLocation(lightProgramID, "normalMap");
+	lightDepthMapID = glGetUniformLocation(lightProgramID, "depthMap");
+
+	compositeProgramID = LoadShadersFromFile("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\fullscreen.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\deferred_composite.frag");
+	if (compositeProgramID == 0) {
+		std::cerr << "Failed to load composite shaders." << std::endl;
+	}
+	compositeAlbedoMapID = glGetUniformLocation(compositeProgramID, "albedoMap");
+	compositeNormalMapID = glGetUniformLocation(compositeProgramID, "normalMap");
+	compositeDepthMapID = glGetUniformLocation(compositeProgramID, "depthMap");
+	compositeLightMapID = glGetUniformLocation(compositeProgramID, "lightMap");
+	compositeAOMapID = glGetUniformLocation(compositeProgramID, "aoMap");
+	compositeAOSizeID = glGetUniformLocation(compositeProgramID, "aoSize");
+	compositeAOEnabledID = glGetUniformLocation(compositeProgramID, "aoEnabled");
+	glUseProgram(compositeProgramID);
+	setShadowSamplers(compositeProgramID, SHADOW_TEXTURE_UNIT, SHADOW_DEPTH_TEXTURE_UNIT);
+
+	boxProgram.programID = LoadShadersFromFile("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\box.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\gbuffer_box.frag");
+	if (boxProgram.programID == 0) {
+		std::cerr << "Failed to load G-buffer shaders." << std::endl;
+	}
+	boxProgram.textureSamplerID = glGetUniformLocation(boxProgram.programID, "textureSampler");
+	glUseProgram(boxProgram.programID);
+	glUniform1i(boxProgram.textureSamplerID, 0);
+}
+
+void DeferredRenderer::createTargets()
+{
+	// G-buffer
+	albedoTexture = createTarget(GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, targetWidth, targetHeight);
+	normalTexture = createTarget(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, targetWidth, targetHeight);
+	depthTexture = createTarget(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, targetWidth, targetHeight);
+
+	glGenFramebuffers(1, &gBufferFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, gBufferFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+	checkFramebuffer("G-buffer");
+
+	// Light accumulation. Its depth is a copy of the G-buffer depth, so the light
+	// pass can depth test while sampling the G-buffer depth without a feedback loop.
+	lightTexture = createTarget(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, targetWidth, targetHeight);
+	glGenRenderbuffers(1, &lightDepthRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, lightDepthRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, targetWidth, targetHeight);
+
+	glGenFramebuffers(1, &lightFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, lightFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lightTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, lightDepthRenderbuffer);
+	checkFramebuffer("Light accumulation");
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DeferredRenderer::deleteTargets()
+{
+	glDeleteFramebuffers(1, &gBufferFBO);
+	glDeleteFramebuffers(1, &lightFBO);
+	glDeleteTextures(1, &albedoTexture);
+	glDeleteTextures(1, &normalTexture);
+	glDeleteTextures(1, &depthTexture);
+	glDeleteTextures(1, &lightTexture);
+	glDeleteRenderbuffers(1, &lightDepthRenderbuffer);
+}
+
+void DeferredRenderer::setRenderSize(int width, int height)
+{
+	this->width = std::min(std::max(width, 1), targetWidth);
+	this->height = std::min(std::max(height, 1), targetHeight);
+}
+
+void DeferredRenderer::setLights(const std::vector<PointLight> &lights)
+{
+	setLights(lights.empty() ? NULL : &lights[0], (int)lights.size());
+}
+
+void DeferredRenderer::setLights(const PointLight *lights, int count)
+{
+	numLights = count;
+	glBindBuffer(GL_ARRAY_BUFFER, lightInstanceBufferID);
+	glBufferData(GL_ARRAY_BUFFER, count * sizeof(PointLight), lights, GL_STATIC_DRAW);
+}
+
+void DeferredRenderer::beginGeometryPass()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, gBufferFBO);
+	glViewport(0, 0, width, height);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void DeferredRenderer::renderLights()
+{
+	// Copy the scene depth for the light volume depth test
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, gBufferFBO);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, lightFBO);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, lightFBO);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	if (numLights == 0) return;
+
+	// Draw the back faces of each volume where they lie behind the scene
+	// surface. This also works with the camera inside a volume.
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_FRONT);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_GEQUAL);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_DEPTH_CLAMP);
+
+	glUseProgram(lightProgramID);
+
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, normalTexture);
+	glUniform1i(lightNormalMapID, 3);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glUniform1i(lightDepthMapID, 4);
+
+	glBindVertexArray(lightVAO);
+	glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (void*)0, numLights);
+
+	glDisable(GL_DEPTH_CLAMP);
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+	glCullFace(GL_BACK);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_BLEND);
+}
+
+void DeferredRenderer::composite(GLuint targetFBO, const CascadedShadowMap &shadows, const SSAO &ssao)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+	glDisable(GL_DEPTH_TEST);
+
+	glUseProgram(compositeProgramID);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, albedoTexture);
+	glUniform1i(compositeAlbedoMapID, 0);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, normalTexture);
+	glUniform1i(compositeNormalMapID, 3);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glUniform1i(compositeDepthMapID, 4);
+	glActiveTexture(GL_TEXTURE5);
+	glBindTexture(GL_TEXTURE_2D, lightTexture);
+	glUniform1i(compositeLightMapID, 5);
+	glUniform1i(compositeAOEnabledID, ssao.isEnabled());
+	if (ssao.isEnabled()) {
+		glActiveTexture(GL_TEXTURE0 + SSAO_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D, ssao.getResult());
+		glUniform1i(compositeAOMapID, SSAO_TEXTURE_UNIT);
+		glUniform2f(compositeAOSizeID, (float)ssao.aoWidth, (float)ssao.aoHeight);
+	}
+	shadows.bindForShading(SHADOW_TEXTURE_UNIT, SHADOW_DEPTH_TEXTURE_UNIT);
+
+	glBindVertexArray(emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	// Later forward passes depth test against the deferred geometry
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, gBufferFBO);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFBO);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, targetFBO);
+
+	glEnable(GL_DEPTH_TEST);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void DeferredRenderer::cleanup()
+{
+	deleteTargets();
+	glDeleteBuffers(1, &lightVertexBufferID);
+	glDeleteBuffers(1, &lightIndexBufferID);
+	glDeleteBuffers(1, &lightInstanceBufferID);
+	glDeleteVertexArrays(1, &lightVAO);
+	glDeleteVertexArrays(1, &emptyVAO);
+	glDeleteProgram(lightProgramID);
+	glDeleteProgram(compositeProgramID);
+	glDeleteProgram(boxProgram.programID);
+}
@@ -0,0 +1,100 @@
+#ifndef _DEFERRED_H_
+#define _DEFERRED_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "shadowMap.h"
+#include "ssao.h"
+
+// A point light accumulated by the deferred light pass
+struct PointLight {
+    glm::vec4 positionRadius;   // xyz = world position, w = radius of influence
+    glm::vec4 color;            // rgb = color * intensity
+};
+
+// Program that writes textured boxes into the G-buffer. The matrices come
+// from the object uniforms.
+struct GeometryProgram {
+    GLuint programID;
+    GLint textureSamplerID;
+};
+
+// Deferred shading: geometry is written once into a compact G-buffer, point
+// lights are accumulated with instanced light volumes, and a composite pass
+// adds the shadowed sun and ambient light.
+//
+// The targets keep the size given to initialize(). A lower render resolution
+// is drawn into their bottom-left corner, see screenUV() in
+// shader/frame_uniforms.glsl.
+struct DeferredRenderer {
+    int width;                  // Render resolution
+    int height;
+    int targetWidth;            // Size of the targets
+    int targetHeight;
+
+    // G-buffer: albedo (SRGB8_ALPHA8, so linear albedo keeps its dark precision),
+    // octahedral normal (RG16) and depth (D24S8). GL_FRAMEBUFFER_SRGB must be
+    // enabled while it is written.
+    GLuint gBufferFBO;
+    GLuint albedoTexture;
+    GLuint normalTexture;
+    GLuint depthTexture;
+
+    // Point light accumulation (RGBA16F). Its depth buffer receives a copy of
+    // the G-buffer depth so light volumes are depth tested against the scene.
+    GLuint lightFBO;
+    GLuint lightTexture;
+    GLuint lightDepthRenderbuffer;
+
+    // Light volumes: a unit box instanced once per light
+    GLuint lightVAO;
+    GLuint lightVertexBufferID;
+    GLuint lightIndexBufferID;
+    GLuint lightInstanceBufferID;
+    int numLights;
+
+    GLuint lightProgramID;
+    GLint lightNormalMapID;
+    GLint lightDepthMapID;
+
+    GLuint compositeProgramID;
+    GLint compositeAlbedoMapID;
+    GLint compositeNormalMapID;
+    GLint compositeDepthMapID;
+    GLint compositeLightMapID;
+    GLint compositeAOMapID;
+    GLint compositeAOSizeID;
+    GLint compositeAOEnabledID;
+
+    GLuint emptyVAO;            // Core profile needs a VAO bound for the full-screen triangle
+    GeometryProgram boxProgram; // Shared by every building and rocket
+
+    void initialize(int width, int height);
+
+    // Renders the following frames at another resolution, clamped to the target size
+    void setRenderSize(int width, int height);
+
+    void setLights(const std::vector<PointLight> &lights);
+    void setLights(const PointLight *lights, int count);    // E.g. straight from a mapped scene snapshot
+
+    // Binds and clears the G-buffer
+    void beginGeometryPass();
+
+    // Accumulates every point light into the light buffer. The camera, and
+    // the sun and sky light of the composite, come from the frame uniforms.
+    void renderLights();
+
+    // Shades the G-buffer into targetFBO and copies its depth there. Sky light
+    // is darkened by the SSAO result when it is enabled.
+    void composite(GLuint targetFBO, const CascadedShadowMap &shadows, const SSAO &ssao);
+
+    void cleanup();
+
+private:
+    void createTargets();
+    void deleteTargets();
+};
+
+#endif
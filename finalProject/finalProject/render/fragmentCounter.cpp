@@ -0,0 +1,52 @@
+#include "fragmentCounter.h"
+
+void FragmentCounter::initialize()
+{
+	glGenQueries(GPU_TIMER_LATENCY, queries);
+	for (int i = 0; i < GPU_TIMER_LATENCY; ++i) {
+		pending[i] = false;
+	}
+	current = 0;
+	lastCount = 0;
+	averageCount = 0.0;
+}
+
+void FragmentCounter::collect(int slot, bool wait)
+{
+	if (!pending[slot]) return;
+
+	if (!wait) {
+		GLint available = 0;
+		glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return;
+	}
+
+	GLuint64 count = 0;
+	glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &count);
+	pending[slot] = false;
+
+	lastCount = count;
+	averageCount = (averageCount == 0.0) ? (double)count : averageCount * 0.9 + count * 0.1;
+}
+
+void FragmentCounter::begin()
+{
+	collect(current, true);
+	glBeginQuery(GL_SAMPLES_PASSED, queries[current]);
+}
+
+void FragmentCounter::end()
+{
+	glEndQuery(GL_SAMPLES_PASSED);
+	pending[current] = true;
+	current = (current + 1) % GPU_TIMER_LATENCY;
+
+	for (int i = 1; i < GPU_TIMER_LATENCY; ++i) {
+		collect((current + i) % GPU_TIMER_LATENCY, false);
+	}
+}
+
+void FragmentCounter::cleanup()
+{
+	glDeleteQueries(GPU_TIMER_LATENCY, queries);
+}
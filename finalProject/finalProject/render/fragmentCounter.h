@@ -0,0 +1,29 @@
+#ifndef _FRAGMENT_COUNTER_H_
+#define _FRAGMENT_COUNTER_H_
+
+#include <glad/gl.h>
+
+#include "gpuTimer.h"
+
+// Counts the fragments that pass the depth test in a block of draw calls with
+// GL_SAMPLES_PASSED queries, i.e. how many fragments were shaded. Results are
+// read back GPU_TIMER_LATENCY frames later, like GpuTimer. Only one counter
+// may be running at a time.
+struct FragmentCounter {
+    GLuint queries[GPU_TIMER_LATENCY];
+    bool pending[GPU_TIMER_LATENCY];
+    int current;
+
+    GLuint64 lastCount;     // Most recent finished count
+    double averageCount;    // Exponential moving average of the counts
+
+    void initialize();
+    void begin();
+    void end();
+    void cleanup();
+
+private:
+    void collect(int slot, bool wait);
+};
+
+#endif
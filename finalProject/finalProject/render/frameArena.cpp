@@ -0,0 +1,115 @@
+#include "frameArena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+void FrameArena::initialize(size_t capacity)
+{
+	cleanup();
+	this->capacity = capacity;
+	block = (char *)::operator new(capacity);
+	offset = 0;
+	used = 0;
+	peak = 0;
+	overflows = 0;
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment)
+{
+	used += bytes;
+	peak = std::max(peak, used);
+
+	size_t start = (offset + alignment - 1) & ~(alignment - 1);
+	if (block != NULL && start + bytes <= capacity) {
+		offset = start + bytes;
+		return block + start;
+	}
+
+	// The heap aligns to max_align_t, enough for anything the frame stores
+	void *memory = ::operator new(bytes);
+	overflowBlocks.push_back(memory);
+	overflows++;
+	return memory;
+}
+
+void FrameArena::reset()
+{
+	if (!overflowBlocks.empty()) {
+		for (void *memory : overflowBlocks) ::operator delete(memory);
+		overflowBlocks.clear();
+
+		// Room for the largest frame so far, with some headroom
+		::operator delete(block);
+		capacity = peak + peak / 4;
+		block = (char *)::operator new(capacity);
+	}
+	offset = 0;
+	used = 0;
+}
+
+void FrameArena::resetStats()
+{
+	peak = used;
+	overflows = 0;
+}
+
+void FrameArena::cleanup()
+{
+	for (void *memory : overflowBlocks) ::operator delete(memory);
+	overflowBlocks.clear();
+	::operator delete(block);
+	block = NULL;
+	capacity = 0;
+	offset = 0;
+	used = 0;
+}
+
+// Counting replacement of the global allocation functions. The standard
+// library's nothrow forms forward to these, the sized deallocation forms
+// are replaced below as well.
+static std::atomic<long long> heapAllocations(0);
+static std::atomic<long long> heapBytes(0);
+
+void *operator new(size_t size)
+{
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	heapBytes.fetch_add((long long)size, std::memory_order_relaxed);
+	void *memory = malloc(size > 0 ? size : 1);
+	if (memory == NULL) throw std::bad_alloc();
+	return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+	free(memory);
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete[](void *memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+	free(memory);
+}
+
+HeapStats takeHeapStats()
+{
+	HeapStats stats;
+	stats.allocations = heapAllocations.exchange(0, std::memory_order_relaxed);
+	stats.bytes = heapBytes.exchange(0, std::memory_order_relaxed);
+	return stats;
+}
@@ -0,0 +1,85 @@
+#ifndef _FRAME_ARENA_H_
+#define _FRAME_ARENA_H_
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// Initial size of each frame arena, it grows to the peak use when a frame overflows
+#define FRAME_ARENA_CAPACITY (256 * 1024)
+
+// Linear allocator for the transient data of one frame: culling lists, joint
+// matrices and scratch transforms. Allocating bumps an offset into one block,
+// freeing does nothing, and reset() releases the whole frame at once. An
+// allocation that does not fit goes to the heap and counts as an overflow;
+// the next reset() frees it and grows the block to the peak, so later frames
+// fit again. An arena is used by one thread at a time.
+struct FrameArena {
+    size_t capacity;
+    size_t used;            // Bytes handed out this frame, overflows included
+    size_t peak;            // Largest use of a frame since initialize() or resetStats()
+    int overflows;          // Allocations that went to the heap since then
+
+    FrameArena() : capacity(0), used(0), peak(0), overflows(0), block(NULL), offset(0) {}
+
+    void initialize(size_t capacity);
+    void *allocate(size_t bytes, size_t alignment);
+
+    // Ends the frame. Every pointer handed out becomes invalid.
+    void reset();
+
+    // Starts the peak over from the current frame's use and clears the
+    // overflow count. The block keeps its size.
+    void resetStats();
+
+    void cleanup();
+
+private:
+    char *block;
+    size_t offset;
+    std::vector<void *> overflowBlocks;
+
+    FrameArena(const FrameArena &);
+    FrameArena &operator=(const FrameArena &);
+};
+
+// STL allocator over a frame arena. Containers using it must be given new
+// storage, e.g. by assigning them an empty container, before the arena is
+// reset. Assignment carries the arena along, so a default-constructed
+// container can be bound to an arena by assigning it an empty one.
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    FrameArena *arena;
+
+    ArenaAllocator() : arena(NULL) {}
+    explicit ArenaAllocator(FrameArena *arena) : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t count) { return (T *)arena->allocate(count * sizeof(T), alignof(T)); }
+    void deallocate(T *, size_t) {}
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena == b.arena; }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena != b.arena; }
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+// Heap traffic since the last takeHeapStats(), counted on every thread by
+// the replacement of the global operator new
+struct HeapStats {
+    long long allocations;
+    long long bytes;
+};
+
+// Returns the counts so far and starts over, call once per frame
+HeapStats takeHeapStats();
+
+#endif
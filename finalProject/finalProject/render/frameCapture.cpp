@@ -0,0 +1,203 @@
+#include "frameCapture.h"
+
+#include <stb/stb_image_write.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+static double now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool parseCaptureFormat(const char *name, CaptureFormat &format)
+{
+	if (strcmp(name, "png") == 0) format = CAPTURE_PNG;
+	else if (strcmp(name, "y4m") == 0) format = CAPTURE_Y4M;
+	else if (strcmp(name, "rgb") == 0) format = CAPTURE_RGB;
+	else return false;
+	return true;
+}
+
+bool FrameCapture::initialize(CaptureFormat format, const std::string &path, int numFrames,
+                              int width, int height, int fps, int maxInFlight)
+{
+	this->format = format;
+	this->path = path;
+	this->numFrames = numFrames;
+	this->width = width;
+	this->height = height;
+	this->fps = fps;
+	this->maxInFlight = maxInFlight;
+	submitted = 0;
+	written = 0;
+	dropped = 0;
+	waits = 0;
+	inFlight = 0;
+	file = NULL;
+
+	if (format != CAPTURE_PNG) {
+		file = fopen(path.c_str(), "wb");
+		if (file == NULL) {
+			std::cerr << "Failed to open capture output " << path << std::endl;
+			return false;
+		}
+		if (format == CAPTURE_Y4M) {
+			fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, fps);
+		}
+	}
+
+	startTime = now();
+	writer = std::thread(&FrameCapture::writerLoop, this);
+	return true;
+}
+
+void FrameCapture::submit(AsyncReadback &readback)
+{
+	{
+		// Bound the memory held by frames that are not on disk yet
+		std::unique_lock<std::mutex> lock(mutex);
+		bool waited = false;
+		while (inFlight >= maxInFlight) {
+			lock.unlock();
+			glFlush();
+			readback.update();
+			lock.lock();
+			if (inFlight < maxInFlight) break;
+			waited = true;
+			frameWritten.wait_for(lock, std::chrono::milliseconds(1));
+		}
+		if (waited) waits++;
+		inFlight++;
+	}
+
+	int frame = submitted++;
+	readback.request(0, READBACK_COLOR, width, height, [this, frame, &readback](ReadbackImage &image) {
+		if (image.pixels.empty()) {
+			// The writer passes over the empty frame, so the stream stays in order
+			std::lock_guard<std::mutex> lock(mutex);
+			dropped++;
+			encoded[frame].clear();
+			frameReady.notify_one();
+			return;
+		}
+
+		std::shared_ptr<ReadbackImage> pending = std::make_shared<ReadbackImage>();
+		pending->width = image.width;
+		pending->height = image.height;
+		pending->format = image.format;
+		pending->pixels.swap(image.pixels);
+
+		readback.enqueue([this, frame, pending]() {
+			std::vector<unsigned char> output;
+			encode(frame, *pending, output);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			encoded[frame].swap(output);
+			frameReady.notify_one();
+		});
+	});
+}
+
+void FrameCapture::encode(int frame, const ReadbackImage &image, std::vector<unsigned char> &output) const
+{
+	int w = image.width;
+	int h = image.height;
+
+	if (format == CAPTURE_Y4M) {
+		// BT.601 studio range, one full resolution plane per channel
+		static const char header[] = "FRAME\n";
+		size_t headerSize = sizeof(header) - 1;
+		size_t planeSize = (size_t)w * h;
+		output.resize(headerSize + 3 * planeSize);
+		memcpy(output.data(), header, headerSize);
+		unsigned char *yPlane = &output[headerSize];
+		unsigned char *uPlane = yPlane + planeSize;
+		unsigned char *vPlane = uPlane + planeSize;
+
+		for (int y = 0; y < h; ++y) {
+			const unsigned char *src = &image.pixels[(size_t)(h - 1 - y) * w * 4];
+			size_t row = (size_t)y * w;
+			for (int x = 0; x < w; ++x) {
+				int r = src[4 * x], g = src[4 * x + 1], b = src[4 * x + 2];
+				yPlane[row + x] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+				uPlane[row + x] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+				vPlane[row + x] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+			}
+		}
+		return;
+	}
+
+	// PNG and raw frames are top row first rgb24
+	std::vector<unsigned char> rgb((size_t)w * h * 3);
+	for (int y = 0; y < h; ++y) {
+		const unsigned char *src = &image.pixels[(size_t)(h - 1 - y) * w * 4];
+		unsigned char *dst = &rgb[(size_t)y * w * 3];
+		for (int x = 0; x < w; ++x) {
+			dst[3 * x] = src[4 * x];
+			dst[3 * x + 1] = src[4 * x + 1];
+			dst[3 * x + 2] = src[4 * x + 2];
+		}
+	}
+
+	if (format == CAPTURE_RGB) {
+		output.swap(rgb);
+		return;
+	}
+
+	// Every PNG is its own file, so the workers write them directly
+	char filename[32];
+	snprintf(filename, sizeof(filename), "_%05d.png", frame);
+	std::string framePath = path + filename;
+	if (!stbi_write_png(framePath.c_str(), w, h, 3, rgb.data(), w * 3)) {
+		std::cerr << "Failed to write " << framePath << std::endl;
+	}
+}
+
+void FrameCapture::writerLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		frameReady.wait(lock, [this]() { return encoded.count(written) > 0 || written >= numFrames; });
+		if (encoded.count(written) == 0) break;
+
+		std::vector<unsigned char> data;
+		data.swap(encoded[written]);
+		encoded.erase(written);
+
+		lock.unlock();
+		if (file != NULL && !data.empty()) {
+			fwrite(data.data(), 1, data.size(), file);
+		}
+		lock.lock();
+
+		written++;
+		inFlight--;
+		frameWritten.notify_all();
+	}
+}
+
+void FrameCapture::finish(AsyncReadback &readback)
+{
+	readback.flush();
+
+	{
+		// The capture may end early if the window was closed
+		std::lock_guard<std::mutex> lock(mutex);
+		numFrames = submitted;
+	}
+	frameReady.notify_all();
+	writer.join();
+
+	if (file != NULL) {
+		fclose(file);
+		file = NULL;
+	}
+
+	double elapsed = now() - startTime;
+	std::cout << "Captured " << written - dropped << " frames to " << path << (format == CAPTURE_PNG ? "_*.png" : "")
+	          << " in " << elapsed << " s (" << (elapsed > 0.0 ? written / elapsed : 0.0) << " frames/s, "
+	          << waits << " waits for encoders, " << readback.stalls << " readback stalls, "
+	          << dropped << " dropped)" << std::endl;
+}
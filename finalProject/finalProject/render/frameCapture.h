@@ -0,0 +1,67 @@
+#ifndef _FRAME_CAPTURE_H_
+#define _FRAME_CAPTURE_H_
+
+#include "readback.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum CaptureFormat {
+    CAPTURE_PNG = 0,    // One lossless PNG per frame, <path>_00000.png
+    CAPTURE_Y4M = 1,    // YUV4MPEG2 stream in 4:4:4, readable by ffmpeg and most players
+    CAPTURE_RGB = 2     // Raw top-down rgb24 frames, e.g. for ffmpeg -f rawvideo
+};
+
+// Parses "png", "y4m" or "rgb". Returns false for anything else.
+bool parseCaptureFormat(const char *name, CaptureFormat &format);
+
+// Records the default framebuffer for a fixed number of frames. Frames come
+// back through AsyncReadback, are converted and compressed on its worker
+// threads, and a writer thread appends them to the output in frame order.
+// The output path of a stream can also be a named pipe.
+struct FrameCapture {
+    CaptureFormat format;
+    std::string path;
+    int width;
+    int height;
+    int fps;
+    int numFrames;
+    int maxInFlight;        // Frames allowed between readback and disk before submit() waits
+
+    int submitted;
+    int written;            // Including dropped frames
+    int dropped;            // Frames whose readback failed, nothing is written for them
+    int waits;              // Times the render thread had to wait for the encoders
+    double startTime;
+
+    // Opens the output. Returns false if the file cannot be created.
+    bool initialize(CaptureFormat format, const std::string &path, int numFrames,
+                    int width, int height, int fps, int maxInFlight);
+
+    // Reads back the current default framebuffer as the next frame
+    void submit(AsyncReadback &readback);
+
+    bool isDone() const { return submitted >= numFrames; }
+
+    // Waits for every frame to be written, closes the output and prints statistics
+    void finish(AsyncReadback &readback);
+
+private:
+    FILE *file;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable frameReady;
+    std::condition_variable frameWritten;
+    std::map<int, std::vector<unsigned char> > encoded;    // Finished frames waiting for their turn
+    int inFlight;
+
+    void encode(int frame, const ReadbackImage &image, std::vector<unsigned char> &output) const;
+    void writerLoop();
+};
+
+#endif
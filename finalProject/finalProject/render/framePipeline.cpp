@@ -0,0 +1,138 @@
+#include "framePipeline.h"
+
+#include <chrono>
+
+static double now()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void accumulate(double &average, double value)
+{
+	average = (average == 0.0) ? value : average * 0.9 + value * 0.1;
+}
+
+void FramePipeline::initialize(bool threaded, const std::function<void(int slot)> &simulate)
+{
+	this->threaded = threaded;
+	this->simulate = simulate;
+	for (int i = 0; i < FRAME_PIPELINE_SLOTS; ++i) {
+		states[i] = SLOT_FREE;
+		slotMs[i] = 0.0;
+	}
+	nextReserve = 0;
+	nextSimulate = 0;
+	nextAcquire = 0;
+	simulationMs = 0.0;
+	waitMs = 0.0;
+	stopping = false;
+
+	if (threaded) {
+		worker = std::thread(&FramePipeline::workerLoop, this);
+	}
+}
+
+int FramePipeline::reserve()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	int slot = nextReserve;
+	changed.wait(lock, [this, slot] { return states[slot] == SLOT_FREE; });
+	states[slot] = SLOT_RESERVED;
+	nextReserve = (nextReserve + 1) % FRAME_PIPELINE_SLOTS;
+	return slot;
+}
+
+void FramePipeline::run(int slot)
+{
+	double start = now();
+	simulate(slot);
+	slotMs[slot] = now() - start;
+}
+
+void FramePipeline::submit(int slot)
+{
+	if (!threaded) {
+		run(slot);
+		states[slot] = SLOT_READY;
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		states[slot] = SLOT_QUEUED;
+	}
+	changed.notify_all();
+}
+
+int FramePipeline::acquire()
+{
+	double start = now();
+	int slot;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		slot = nextAcquire;
+		changed.wait(lock, [this, slot] { return states[slot] == SLOT_READY; });
+		states[slot] = SLOT_RENDERING;
+		nextAcquire = (nextAcquire + 1) % FRAME_PIPELINE_SLOTS;
+	}
+	accumulate(waitMs, now() - start);
+	accumulate(simulationMs, slotMs[slot]);
+	return slot;
+}
+
+void FramePipeline::release(int slot)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		states[slot] = SLOT_FREE;
+	}
+	changed.notify_all();
+}
+
+void FramePipeline::drain()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this] {
+		for (int i = 0; i < FRAME_PIPELINE_SLOTS; ++i) {
+			if (states[i] == SLOT_QUEUED) return false;
+		}
+		return true;
+	});
+	for (int i = 0; i < FRAME_PIPELINE_SLOTS; ++i) {
+		states[i] = SLOT_FREE;
+	}
+	nextReserve = nextSimulate = nextAcquire = 0;
+	lock.unlock();
+	changed.notify_all();
+}
+
+void FramePipeline::workerLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		// drain() may rewind nextSimulate while the worker is idle
+		changed.wait(lock, [this] { return stopping || states[nextSimulate] == SLOT_QUEUED; });
+		if (stopping) break;
+		int slot = nextSimulate;
+
+		lock.unlock();
+		run(slot);
+		lock.lock();
+
+		states[slot] = SLOT_READY;
+		nextSimulate = (nextSimulate + 1) % FRAME_PIPELINE_SLOTS;
+		changed.notify_all();
+	}
+}
+
+void FramePipeline::cleanup()
+{
+	if (threaded && worker.joinable()) {
+		drain();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		changed.notify_all();
+		worker.join();
+	}
+}
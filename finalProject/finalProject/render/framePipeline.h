@@ -0,0 +1,69 @@
+#ifndef _FRAME_PIPELINE_H_
+#define _FRAME_PIPELINE_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Frame packets in flight: one being rendered, one being simulated
+#define FRAME_PIPELINE_SLOTS 2
+
+// Runs the simulation stage of a frame on a worker thread while the GL thread
+// renders the previous one. The caller owns an array of FRAME_PIPELINE_SLOTS
+// frame packets; the pipeline only hands out slot indices, in frame order.
+// A packet is written by the simulation only, then read by the renderer only,
+// so neither needs a lock. Latency is bounded to one frame: reserve() waits
+// while the renderer still holds the packet of two frames ago.
+struct FramePipeline {
+    bool threaded;              // False runs the simulation inline in submit()
+
+    // Moving averages, updated on the GL thread
+    double simulationMs;        // Time spent in the simulation callback
+    double waitMs;              // Time the renderer waited for a packet
+
+    FramePipeline() : threaded(false), simulationMs(0.0), waitMs(0.0), stopping(false) {}
+
+    void initialize(bool threaded, const std::function<void(int slot)> &simulate);
+
+    // Returns the slot the next frame is simulated into, once it is free. The
+    // caller fills in the frame inputs and passes it to submit().
+    int reserve();
+    void submit(int slot);
+
+    // Waits for the oldest submitted frame and returns its slot for rendering
+    int acquire();
+    void release(int slot);
+
+    // Waits for the submitted frames and drops the ones not rendered yet, e.g.
+    // before the scene they refer to is rebuilt
+    void drain();
+
+    void cleanup();
+
+private:
+    enum SlotState {
+        SLOT_FREE,
+        SLOT_RESERVED,
+        SLOT_QUEUED,
+        SLOT_READY,
+        SLOT_RENDERING
+    };
+
+    std::function<void(int slot)> simulate;
+    SlotState states[FRAME_PIPELINE_SLOTS];
+    double slotMs[FRAME_PIPELINE_SLOTS];    // Simulation time of each packet
+    int nextReserve;
+    int nextSimulate;
+    int nextAcquire;
+    bool stopping;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    void run(int slot);
+    void workerLoop();
+};
+
+#endif
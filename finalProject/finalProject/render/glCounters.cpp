@@ -0,0 +1,253 @@
+#include "glCounters.h"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef FP_GL_STATS
+
+static GLCallStats stats;
+static GLuint pixelUnpackBuffer = 0;    // Texture uploads read from it when bound
+
+static long long countPrimitives(GLenum mode, GLsizei count)
+{
+	switch (mode) {
+	case GL_TRIANGLES: return count / 3;
+	case GL_TRIANGLE_STRIP:
+	case GL_TRIANGLE_FAN: return count > 2 ? count - 2 : 0;
+	case GL_LINES: return count / 2;
+	case GL_LINE_STRIP: return count > 1 ? count - 1 : 0;
+	case GL_LINE_LOOP: return count;
+	default: return count;
+	}
+}
+
+static long long bytesPerPixel(GLenum format, GLenum type)
+{
+	switch (type) {
+	case GL_UNSIGNED_SHORT_5_6_5:
+	case GL_UNSIGNED_SHORT_4_4_4_4:
+	case GL_UNSIGNED_SHORT_5_5_5_1: return 2;
+	case GL_UNSIGNED_INT_24_8:
+	case GL_UNSIGNED_INT_10F_11F_11F_REV:
+	case GL_UNSIGNED_INT_5_9_9_9_REV:
+	case GL_UNSIGNED_INT_2_10_10_10_REV: return 4;
+	case GL_FLOAT_32_UNSIGNED_INT_24_8_REV: return 8;
+	}
+
+	long long components = 4;
+	switch (format) {
+	case GL_RED:
+	case GL_RED_INTEGER:
+	case GL_DEPTH_COMPONENT: components = 1; break;
+	case GL_RG:
+	case GL_RG_INTEGER: components = 2; break;
+	case GL_RGB:
+	case GL_BGR:
+	case GL_RGB_INTEGER: components = 3; break;
+	}
+
+	switch (type) {
+	case GL_UNSIGNED_BYTE:
+	case GL_BYTE: return components;
+	case GL_UNSIGNED_SHORT:
+	case GL_SHORT:
+	case GL_HALF_FLOAT: return components * 2;
+	default: return components * 4;
+	}
+}
+
+// A texture call with no pixels and no pixel buffer only allocates
+static void countTextureUpload(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type,
+                               const void *pixels)
+{
+	if (pixels == NULL && pixelUnpackBuffer == 0) return;
+	stats.textureUploadBytes += (long long)width * height * depth * bytesPerPixel(format, type);
+}
+
+// The glad entry points the wrappers forward to
+static PFNGLDRAWARRAYSPROC drawArrays;
+static PFNGLDRAWELEMENTSPROC drawElements;
+static PFNGLDRAWARRAYSINSTANCEDPROC drawArraysInstanced;
+static PFNGLDRAWELEMENTSINSTANCEDPROC drawElementsInstanced;
+static PFNGLUSEPROGRAMPROC useProgram;
+static PFNGLBINDTEXTUREPROC bindTexture;
+static PFNGLBINDBUFFERPROC bindBuffer;
+static PFNGLBUFFERDATAPROC bufferData;
+static PFNGLBUFFERSUBDATAPROC bufferSubData;
+static PFNGLMAPBUFFERRANGEPROC mapBufferRange;
+static PFNGLTEXIMAGE2DPROC texImage2D;
+static PFNGLTEXIMAGE3DPROC texImage3D;
+static PFNGLTEXSUBIMAGE2DPROC texSubImage2D;
+static PFNGLTEXSUBIMAGE3DPROC texSubImage3D;
+
+static void GLAD_API_PTR countedDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	stats.drawCalls++;
+	stats.primitives += countPrimitives(mode, count);
+	drawArrays(mode, first, count);
+}
+
+static void GLAD_API_PTR countedDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices)
+{
+	stats.drawCalls++;
+	stats.primitives += countPrimitives(mode, count);
+	drawElements(mode, count, type, indices);
+}
+
+static void GLAD_API_PTR countedDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instancecount)
+{
+	stats.drawCalls++;
+	stats.primitives += countPrimitives(mode, count) * instancecount;
+	drawArraysInstanced(mode, first, count, instancecount);
+}
+
+static void GLAD_API_PTR countedDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices,
+                                                      GLsizei instancecount)
+{
+	stats.drawCalls++;
+	stats.primitives += countPrimitives(mode, count) * instancecount;
+	drawElementsInstanced(mode, count, type, indices, instancecount);
+}
+
+static void GLAD_API_PTR countedUseProgram(GLuint program)
+{
+	stats.programSwitches++;
+	useProgram(program);
+}
+
+static void GLAD_API_PTR countedBindTexture(GLenum target, GLuint texture)
+{
+	stats.textureSwitches++;
+	bindTexture(target, texture);
+}
+
+static void GLAD_API_PTR countedBindBuffer(GLenum target, GLuint buffer)
+{
+	if (target == GL_PIXEL_UNPACK_BUFFER) pixelUnpackBuffer = buffer;
+	bindBuffer(target, buffer);
+}
+
+static void GLAD_API_PTR countedBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+{
+	// NULL only allocates (or orphans)
+	if (data != NULL) stats.bufferUploadBytes += size;
+	bufferData(target, size, data, usage);
+}
+
+static void GLAD_API_PTR countedBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+{
+	stats.bufferUploadBytes += size;
+	bufferSubData(target, offset, size, data);
+}
+
+static void *GLAD_API_PTR countedMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length,
+                                                GLbitfield access)
+{
+	// Counted as written in full, which is what the renderer's mappings do
+	if (access & GL_MAP_WRITE_BIT) stats.bufferUploadBytes += length;
+	return mapBufferRange(target, offset, length, access);
+}
+
+static void GLAD_API_PTR countedTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width,
+                                           GLsizei height, GLint border, GLenum format, GLenum type,
+                                           const void *pixels)
+{
+	countTextureUpload(width, height, 1, format, type, pixels);
+	texImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+}
+
+static void GLAD_API_PTR countedTexImage3D(GLenum target, GLint level, GLint internalformat, GLsizei width,
+                                           GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type,
+                                           const void *pixels)
+{
+	countTextureUpload(width, height, depth, format, type, pixels);
+	texImage3D(target, level, internalformat, width, height, depth, border, format, type, pixels);
+}
+
+static void GLAD_API_PTR countedTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset,
+                                              GLsizei width, GLsizei height, GLenum format, GLenum type,
+                                              const void *pixels)
+{
+	countTextureUpload(width, height, 1, format, type, pixels);
+	texSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+}
+
+static void GLAD_API_PTR countedTexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset,
+                                              GLint zoffset, GLsizei width, GLsizei height, GLsizei depth,
+                                              GLenum format, GLenum type, const void *pixels)
+{
+	countTextureUpload(width, height, depth, format, type, pixels);
+	texSubImage3D(target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels);
+}
+
+void installCallCounters()
+{
+	if (drawArrays != NULL) return;
+	drawArrays = glad_glDrawArrays;
+	drawElements = glad_glDrawElements;
+	drawArraysInstanced = glad_glDrawArraysInstanced;
+	drawElementsInstanced = glad_glDrawElementsInstanced;
+	useProgram = glad_glUseProgram;
+	bindTexture = glad_glBindTexture;
+	bindBuffer = glad_glBindBuffer;
+	bufferData = glad_glBufferData;
+	bufferSubData = glad_glBufferSubData;
+	mapBufferRange = glad_glMapBufferRange;
+	texImage2D = glad_glTexImage2D;
+	texImage3D = glad_glTexImage3D;
+	texSubImage2D = glad_glTexSubImage2D;
+	texSubImage3D = glad_glTexSubImage3D;
+
+	GLint unpack = 0;
+	glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpack);
+	pixelUnpackBuffer = (GLuint)unpack;
+
+	glad_glDrawArrays = countedDrawArrays;
+	glad_glDrawElements = countedDrawElements;
+	glad_glDrawArraysInstanced = countedDrawArraysInstanced;
+	glad_glDrawElementsInstanced = countedDrawElementsInstanced;
+	glad_glUseProgram = countedUseProgram;
+	glad_glBindTexture = countedBindTexture;
+	glad_glBindBuffer = countedBindBuffer;
+	glad_glBufferData = countedBufferData;
+	glad_glBufferSubData = countedBufferSubData;
+	glad_glMapBufferRange = countedMapBufferRange;
+	glad_glTexImage2D = countedTexImage2D;
+	glad_glTexImage3D = countedTexImage3D;
+	glad_glTexSubImage2D = countedTexSubImage2D;
+	glad_glTexSubImage3D = countedTexSubImage3D;
+}
+
+GLCallStats takeGLCallStats()
+{
+	GLCallStats result = stats;
+	memset(&stats, 0, sizeof(stats));
+	return result;
+}
+
+#endif
+
+bool GLCallLog::open(const std::string &path)
+{
+	frame = 0;
+	file = fopen(path.c_str(), "w");
+	if (!file) {
+		std::cerr << "Failed to write " << path << std::endl;
+		return false;
+	}
+	fprintf(file, "frame,drawCalls,primitives,programSwitches,textureSwitches,bufferUploadBytes,textureUploadBytes\n");
+	return true;
+}
+
+void GLCallLog::write(const GLCallStats &stats)
+{
+	if (!file) return;
+	fprintf(file, "%d,%d,%lld,%d,%d,%lld,%lld\n", frame++, stats.drawCalls, stats.primitives,
+	        stats.programSwitches, stats.textureSwitches, stats.bufferUploadBytes, stats.textureUploadBytes);
+}
+
+void GLCallLog::close()
+{
+	if (file) fclose(file);
+	file = NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef _GL_COUNTERS_H_
+#define _GL_COUNTERS_H_
+
+#include <glad/gl.h>
+
+#include <cstdio>
+#include <string>
+
+// Work a frame hands to the driver
+struct GLCallStats {
+    int drawCalls;
+    long long primitives;           // Triangles, lines or points, times the instances
+    int programSwitches;            // glUseProgram calls
+    int textureSwitches;            // glBindTexture calls
+    long long bufferUploadBytes;    // glBufferData/glBufferSubData data and mapped writes
+    long long textureUploadBytes;   // glTex(Sub)Image pixels, from memory or a pixel buffer
+};
+
+// Opt-in instrumentation build (cmake -DFP_GL_STATS=ON). The counting wrappers
+// sit between the renderer and the glad entry points, under the state cache,
+// so only calls that reach the driver are counted. Without FP_GL_STATS both
+// functions compile to nothing.
+#ifdef FP_GL_STATS
+#define GL_CALL_COUNTERS_ENABLED 1
+
+// Replaces the draw, program, texture and upload entry points loaded by glad
+// with counting wrappers. Call once after gladLoadGL, before installStateCache.
+void installCallCounters();
+
+// Returns the counts so far and starts over, call once per frame
+GLCallStats takeGLCallStats();
+#else
+#define GL_CALL_COUNTERS_ENABLED 0
+
+inline void installCallCounters() {}
+inline GLCallStats takeGLCallStats() { GLCallStats stats = {}; return stats; }
+#endif
+
+// One CSV row per frame, for --gl-stats <path>. The first row also holds
+// everything uploaded while loading.
+struct GLCallLog {
+    FILE *file;
+    int frame;
+
+    bool open(const std::string &path);
+    void write(const GLCallStats &stats);
+    void close();
+};
+
+#endif
@@ -0,0 +1,512 @@
+#include "glState.h"
+
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+// Value of a binding the cache does not know, the next call always goes through
+static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+// Capabilities the renderer toggles
+static const GLenum cachedCapabilities[] = {
+	GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_DEPTH_CLAMP, GL_FRAMEBUFFER_SRGB, GL_POLYGON_OFFSET_FILL,
+	GL_SCISSOR_TEST,
+};
+static const int numCachedCapabilities = sizeof(cachedCapabilities) / sizeof(cachedCapabilities[0]);
+
+struct UniformBinding {
+	GLuint buffer;
+	GLintptr offset;
+	GLsizeiptr size;    // 0 for glBindBufferBase, as glGet reports it
+};
+
+// Shadow copy of the context state
+struct CachedState {
+	GLuint program;
+	GLuint vertexArray;
+	GLuint arrayBuffer;
+	GLuint uniformBuffer;
+	GLuint pixelPackBuffer;
+	GLuint pixelUnpackBuffer;
+	GLuint drawFramebuffer;
+	GLuint readFramebuffer;
+	GLuint activeUnit;
+	GLuint textures2D[MAX_CACHED_TEXTURE_UNITS];
+	GLuint textures2DArray[MAX_CACHED_TEXTURE_UNITS];
+	GLuint samplers[MAX_CACHED_TEXTURE_UNITS];
+	UniformBinding uniformBindings[MAX_CACHED_UNIFORM_BINDINGS];
+	GLuint capabilities[numCachedCapabilities];     // GL_TRUE, GL_FALSE or UNKNOWN
+	GLuint depthFunc;
+	GLuint depthMask;
+	GLuint cullFace;
+
+	// The element buffer belongs to the vertex array, so it is kept per array
+	std::unordered_map<GLuint, GLuint> elementBuffers;
+};
+
+static CachedState state;
+static GLStateStats stats;
+static bool installed = false;
+static int numTextureUnits = 0;
+
+// Counts a cached call, returns true if it can be dropped
+static bool redundant(bool same)
+{
+	stats.calls++;
+	if (same) stats.skipped++;
+	return same;
+}
+
+static int capabilityIndex(GLenum cap)
+{
+	for (int i = 0; i < numCachedCapabilities; ++i) {
+		if (cachedCapabilities[i] == cap) return i;
+	}
+	return -1;
+}
+
+static GLuint *bufferBinding(GLenum target)
+{
+	switch (target) {
+	case GL_ARRAY_BUFFER: return &state.arrayBuffer;
+	case GL_UNIFORM_BUFFER: return &state.uniformBuffer;
+	case GL_PIXEL_PACK_BUFFER: return &state.pixelPackBuffer;
+	case GL_PIXEL_UNPACK_BUFFER: return &state.pixelUnpackBuffer;
+	case GL_ELEMENT_ARRAY_BUFFER: {
+		auto found = state.elementBuffers.find(state.vertexArray);
+		if (found == state.elementBuffers.end()) {
+			found = state.elementBuffers.insert(std::make_pair(state.vertexArray, UNKNOWN)).first;
+		}
+		return &found->second;
+	}
+	default: return NULL;
+	}
+}
+
+static GLuint *textureBinding(GLenum target)
+{
+	if (state.activeUnit >= (GLuint)numTextureUnits) return NULL;
+	switch (target) {
+	case GL_TEXTURE_2D: return &state.textures2D[state.activeUnit];
+	case GL_TEXTURE_2D_ARRAY: return &state.textures2DArray[state.activeUnit];
+	default: return NULL;
+	}
+}
+
+// The glad entry points the wrappers forward to
+static PFNGLUSEPROGRAMPROC useProgram;
+static PFNGLBINDVERTEXARRAYPROC bindVertexArray;
+static PFNGLBINDBUFFERPROC bindBuffer;
+static PFNGLBINDBUFFERBASEPROC bindBufferBase;
+static PFNGLBINDBUFFERRANGEPROC bindBufferRange;
+static PFNGLBINDFRAMEBUFFERPROC bindFramebuffer;
+static PFNGLACTIVETEXTUREPROC activeTexture;
+static PFNGLBINDTEXTUREPROC bindTexture;
+static PFNGLBINDSAMPLERPROC bindSampler;
+static PFNGLENABLEPROC enable;
+static PFNGLDISABLEPROC disable;
+static PFNGLDEPTHFUNCPROC depthFunc;
+static PFNGLDEPTHMASKPROC depthMask;
+static PFNGLCULLFACEPROC cullFace;
+static PFNGLDELETEPROGRAMPROC deleteProgram;
+static PFNGLDELETEVERTEXARRAYSPROC deleteVertexArrays;
+static PFNGLDELETEBUFFERSPROC deleteBuffers;
+static PFNGLDELETEFRAMEBUFFERSPROC deleteFramebuffers;
+static PFNGLDELETETEXTURESPROC deleteTextures;
+static PFNGLDELETESAMPLERSPROC deleteSamplers;
+
+static void GLAD_API_PTR cachedUseProgram(GLuint program)
+{
+	if (redundant(state.program == program)) return;
+	state.program = program;
+	useProgram(program);
+}
+
+static void GLAD_API_PTR cachedBindVertexArray(GLuint array)
+{
+	if (redundant(state.vertexArray == array)) return;
+	state.vertexArray = array;
+	bindVertexArray(array);
+}
+
+static void GLAD_API_PTR cachedBindBuffer(GLenum target, GLuint buffer)
+{
+	GLuint *binding = bufferBinding(target);
+	if (binding == NULL) {
+		bindBuffer(target, buffer);
+		return;
+	}
+	if (redundant(*binding == buffer)) return;
+	*binding = buffer;
+	bindBuffer(target, buffer);
+}
+
+static void GLAD_API_PTR cachedBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	if (target != GL_UNIFORM_BUFFER || index >= MAX_CACHED_UNIFORM_BINDINGS) {
+		if (target == GL_UNIFORM_BUFFER) state.uniformBuffer = buffer;
+		bindBufferBase(target, index, buffer);
+		return;
+	}
+	UniformBinding &binding = state.uniformBindings[index];
+	if (redundant(binding.buffer == buffer && binding.offset == 0 && binding.size == 0 &&
+	              state.uniformBuffer == buffer)) return;
+	binding.buffer = buffer;
+	binding.offset = 0;
+	binding.size = 0;
+	state.uniformBuffer = buffer;
+	bindBufferBase(target, index, buffer);
+}
+
+static void GLAD_API_PTR cachedBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset,
+                                               GLsizeiptr size)
+{
+	if (target != GL_UNIFORM_BUFFER || index >= MAX_CACHED_UNIFORM_BINDINGS) {
+		if (target == GL_UNIFORM_BUFFER) state.uniformBuffer = buffer;
+		bindBufferRange(target, index, buffer, offset, size);
+		return;
+	}
+	UniformBinding &binding = state.uniformBindings[index];
+	// Binding a range also selects the buffer for GL_UNIFORM_BUFFER, so that has to match too
+	if (redundant(binding.buffer == buffer && binding.offset == offset && binding.size == size &&
+	              state.uniformBuffer == buffer)) return;
+	binding.buffer = buffer;
+	binding.offset = offset;
+	binding.size = size;
+	state.uniformBuffer = buffer;
+	bindBufferRange(target, index, buffer, offset, size);
+}
+
+static void GLAD_API_PTR cachedBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	if (redundant((!draw || state.drawFramebuffer == framebuffer) &&
+	              (!read || state.readFramebuffer == framebuffer))) return;
+	if (draw) state.drawFramebuffer = framebuffer;
+	if (read) state.readFramebuffer = framebuffer;
+	bindFramebuffer(target, framebuffer);
+}
+
+static void GLAD_API_PTR cachedActiveTexture(GLenum texture)
+{
+	GLuint unit = texture - GL_TEXTURE0;
+	if (redundant(state.activeUnit == unit)) return;
+	state.activeUnit = unit;
+	activeTexture(texture);
+}
+
+static void GLAD_API_PTR cachedBindTexture(GLenum target, GLuint texture)
+{
+	GLuint *binding = textureBinding(target);
+	if (binding == NULL) {
+		bindTexture(target, texture);
+		return;
+	}
+	if (redundant(*binding == texture)) return;
+	*binding = texture;
+	bindTexture(target, texture);
+}
+
+static void GLAD_API_PTR cachedBindSampler(GLuint unit, GLuint sampler)
+{
+	if (unit >= (GLuint)numTextureUnits) {
+		bindSampler(unit, sampler);
+		return;
+	}
+	if (redundant(state.samplers[unit] == sampler)) return;
+	state.samplers[unit] = sampler;
+	bindSampler(unit, sampler);
+}
+
+static void GLAD_API_PTR cachedEnable(GLenum cap)
+{
+	int index = capabilityIndex(cap);
+	if (index < 0) {
+		enable(cap);
+		return;
+	}
+	if (redundant(state.capabilities[index] == GL_TRUE)) return;
+	state.capabilities[index] = GL_TRUE;
+	enable(cap);
+}
+
+static void GLAD_API_PTR cachedDisable(GLenum cap)
+{
+	int index = capabilityIndex(cap);
+	if (index < 0) {
+		disable(cap);
+		return;
+	}
+	if (redundant(state.capabilities[index] == GL_FALSE)) return;
+	state.capabilities[index] = GL_FALSE;
+	disable(cap);
+}
+
+static void GLAD_API_PTR cachedDepthFunc(GLenum func)
+{
+	if (redundant(state.depthFunc == func)) return;
+	state.depthFunc = func;
+	depthFunc(func);
+}
+
+static void GLAD_API_PTR cachedDepthMask(GLboolean flag)
+{
+	GLuint value = flag ? GL_TRUE : GL_FALSE;
+	if (redundant(state.depthMask == value)) return;
+	state.depthMask = value;
+	depthMask(flag);
+}
+
+static void GLAD_API_PTR cachedCullFace(GLenum mode)
+{
+	if (redundant(state.cullFace == mode)) return;
+	state.cullFace = mode;
+	cullFace(mode);
+}
+
+// Deleting a bound object resets the binding to 0 in this context. Names can
+// be handed out again afterwards, so nothing may still refer to a freed name.
+
+static void GLAD_API_PTR cachedDeleteProgram(GLuint program)
+{
+	// A current program stays in use until replaced, forget it to be safe
+	if (program != 0 && state.program == program) state.program = UNKNOWN;
+	deleteProgram(program);
+}
+
+static void GLAD_API_PTR cachedDeleteVertexArrays(GLsizei n, const GLuint *arrays)
+{
+	for (GLsizei i = 0; i < n; ++i) {
+		if (arrays[i] == 0) continue;
+		if (state.vertexArray == arrays[i]) state.vertexArray = 0;
+		state.elementBuffers.erase(arrays[i]);
+	}
+	deleteVertexArrays(n, arrays);
+}
+
+static void GLAD_API_PTR cachedDeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+	for (GLsizei i = 0; i < n; ++i) {
+		GLuint buffer = buffers[i];
+		if (buffer == 0) continue;
+		if (state.arrayBuffer == buffer) state.arrayBuffer = 0;
+		if (state.uniformBuffer == buffer) state.uniformBuffer = 0;
+		if (state.pixelPackBuffer == buffer) state.pixelPackBuffer = 0;
+		if (state.pixelUnpackBuffer == buffer) state.pixelUnpackBuffer = 0;
+		for (int j = 0; j < MAX_CACHED_UNIFORM_BINDINGS; ++j) {
+			if (state.uniformBindings[j].buffer == buffer) state.uniformBindings[j].buffer = UNKNOWN;
+		}
+		// Vertex arrays that are not bound keep referring to the deleted buffer
+		for (auto &element : state.elementBuffers) {
+			if (element.second == buffer) element.second = element.first == state.vertexArray ? 0 : UNKNOWN;
+		}
+	}
+	deleteBuffers(n, buffers);
+}
+
+static void GLAD_API_PTR cachedDeleteFramebuffers(GLsizei n, const GLuint *framebuffers)
+{
+	for (GLsizei i = 0; i < n; ++i) {
+		if (framebuffers[i] == 0) continue;
+		if (state.drawFramebuffer == framebuffers[i]) state.drawFramebuffer = 0;
+		if (state.readFramebuffer == framebuffers[i]) state.readFramebuffer = 0;
+	}
+	deleteFramebuffers(n, framebuffers);
+}
+
+static void GLAD_API_PTR cachedDeleteTextures(GLsizei n, const GLuint *textures)
+{
+	for (GLsizei i = 0; i < n; ++i) {
+		if (textures[i] == 0) continue;
+		for (int unit = 0; unit < numTextureUnits; ++unit) {
+			if (state.textures2D[unit] == textures[i]) state.textures2D[unit] = 0;
+			if (state.textures2DArray[unit] == textures[i]) state.textures2DArray[unit] = 0;
+		}
+	}
+	deleteTextures(n, textures);
+}
+
+static void GLAD_API_PTR cachedDeleteSamplers(GLsizei count, const GLuint *samplers)
+{
+	for (GLsizei i = 0; i < count; ++i) {
+		if (samplers[i] == 0) continue;
+		for (int unit = 0; unit < numTextureUnits; ++unit) {
+			if (state.samplers[unit] == samplers[i]) state.samplers[unit] = 0;
+		}
+	}
+	deleteSamplers(count, samplers);
+}
+
+static GLuint getInteger(GLenum name)
+{
+	GLint value = 0;
+	glGetIntegerv(name, &value);
+	return (GLuint)value;
+}
+
+// Reads the cached state back from the context. The per-unit texture
+// bindings can only be queried through the active unit, so it is switched
+// with the real entry point and restored.
+static void readState(CachedState &actual)
+{
+	actual.program = getInteger(GL_CURRENT_PROGRAM);
+	actual.vertexArray = getInteger(GL_VERTEX_ARRAY_BINDING);
+	actual.arrayBuffer = getInteger(GL_ARRAY_BUFFER_BINDING);
+	actual.uniformBuffer = getInteger(GL_UNIFORM_BUFFER_BINDING);
+	actual.pixelPackBuffer = getInteger(GL_PIXEL_PACK_BUFFER_BINDING);
+	actual.pixelUnpackBuffer = getInteger(GL_PIXEL_UNPACK_BUFFER_BINDING);
+	actual.drawFramebuffer = getInteger(GL_DRAW_FRAMEBUFFER_BINDING);
+	actual.readFramebuffer = getInteger(GL_READ_FRAMEBUFFER_BINDING);
+	actual.activeUnit = getInteger(GL_ACTIVE_TEXTURE) - GL_TEXTURE0;
+	for (int unit = 0; unit < numTextureUnits; ++unit) {
+		activeTexture(GL_TEXTURE0 + unit);
+		actual.textures2D[unit] = getInteger(GL_TEXTURE_BINDING_2D);
+		actual.textures2DArray[unit] = getInteger(GL_TEXTURE_BINDING_2D_ARRAY);
+		actual.samplers[unit] = getInteger(GL_SAMPLER_BINDING);
+	}
+	activeTexture(GL_TEXTURE0 + actual.activeUnit);
+	for (int i = 0; i < MAX_CACHED_UNIFORM_BINDINGS; ++i) {
+		GLint64 offset = 0, size = 0;
+		GLint buffer = 0;
+		glGetIntegeri_v(GL_UNIFORM_BUFFER_BINDING, i, &buffer);
+		glGetInteger64i_v(GL_UNIFORM_BUFFER_START, i, &offset);
+		glGetInteger64i_v(GL_UNIFORM_BUFFER_SIZE, i, &size);
+		actual.uniformBindings[i].buffer = (GLuint)buffer;
+		actual.uniformBindings[i].offset = (GLintptr)offset;
+		actual.uniformBindings[i].size = (GLsizeiptr)size;
+	}
+	for (int i = 0; i < numCachedCapabilities; ++i) {
+		actual.capabilities[i] = glIsEnabled(cachedCapabilities[i]) ? GL_TRUE : GL_FALSE;
+	}
+	actual.depthFunc = getInteger(GL_DEPTH_FUNC);
+	actual.depthMask = getInteger(GL_DEPTH_WRITEMASK) ? GL_TRUE : GL_FALSE;
+	actual.cullFace = getInteger(GL_CULL_FACE_MODE);
+
+	// Only the element buffer of the bound vertex array can be queried
+	actual.elementBuffers.clear();
+	actual.elementBuffers[actual.vertexArray] = getInteger(GL_ELEMENT_ARRAY_BUFFER_BINDING);
+}
+
+void installStateCache()
+{
+	if (installed) return;
+	installed = true;
+
+	useProgram = glad_glUseProgram;
+	bindVertexArray = glad_glBindVertexArray;
+	bindBuffer = glad_glBindBuffer;
+	bindBufferBase = glad_glBindBufferBase;
+	bindBufferRange = glad_glBindBufferRange;
+	bindFramebuffer = glad_glBindFramebuffer;
+	activeTexture = glad_glActiveTexture;
+	bindTexture = glad_glBindTexture;
+	bindSampler = glad_glBindSampler;
+	enable = glad_glEnable;
+	disable = glad_glDisable;
+	depthFunc = glad_glDepthFunc;
+	depthMask = glad_glDepthMask;
+	cullFace = glad_glCullFace;
+	deleteProgram = glad_glDeleteProgram;
+	deleteVertexArrays = glad_glDeleteVertexArrays;
+	deleteBuffers = glad_glDeleteBuffers;
+	deleteFramebuffers = glad_glDeleteFramebuffers;
+	deleteTextures = glad_glDeleteTextures;
+	deleteSamplers = glad_glDeleteSamplers;
+
+	GLint units = 0;
+	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &units);
+	numTextureUnits = units < MAX_CACHED_TEXTURE_UNITS ? units : MAX_CACHED_TEXTURE_UNITS;
+	readState(state);
+
+	glad_glUseProgram = cachedUseProgram;
+	glad_glBindVertexArray = cachedBindVertexArray;
+	glad_glBindBuffer = cachedBindBuffer;
+	glad_glBindBufferBase = cachedBindBufferBase;
+	glad_glBindBufferRange = cachedBindBufferRange;
+	glad_glBindFramebuffer = cachedBindFramebuffer;
+	glad_glActiveTexture = cachedActiveTexture;
+	glad_glBindTexture = cachedBindTexture;
+	glad_glBindSampler = cachedBindSampler;
+	glad_glEnable = cachedEnable;
+	glad_glDisable = cachedDisable;
+	glad_glDepthFunc = cachedDepthFunc;
+	glad_glDepthMask = cachedDepthMask;
+	glad_glCullFace = cachedCullFace;
+	glad_glDeleteProgram = cachedDeleteProgram;
+	glad_glDeleteVertexArrays = cachedDeleteVertexArrays;
+	glad_glDeleteBuffers = cachedDeleteBuffers;
+	glad_glDeleteFramebuffers = cachedDeleteFramebuffers;
+	glad_glDeleteTextures = cachedDeleteTextures;
+	glad_glDeleteSamplers = cachedDeleteSamplers;
+}
+
+GLStateStats takeGLStateStats()
+{
+	GLStateStats result = stats;
+	memset(&stats, 0, sizeof(stats));
+	return result;
+}
+
+// Reports a binding whose cached value is known and differs from the context
+static int compare(const char *name, int index, GLuint cached, GLuint actual)
+{
+	if (cached == UNKNOWN || cached == actual) return 0;
+	std::cerr << "GL state out of sync: " << name;
+	if (index >= 0) std::cerr << "[" << index << "]";
+	std::cerr << " cached " << cached << ", context " << actual << std::endl;
+	return 1;
+}
+
+int validateGLState()
+{
+	if (!installed) return 0;
+
+	CachedState actual;
+	readState(actual);
+
+	int mismatches = 0;
+	mismatches += compare("GL_CURRENT_PROGRAM", -1, state.program, actual.program);
+	mismatches += compare("GL_VERTEX_ARRAY_BINDING", -1, state.vertexArray, actual.vertexArray);
+	mismatches += compare("GL_ARRAY_BUFFER_BINDING", -1, state.arrayBuffer, actual.arrayBuffer);
+	mismatches += compare("GL_UNIFORM_BUFFER_BINDING", -1, state.uniformBuffer, actual.uniformBuffer);
+	mismatches += compare("GL_PIXEL_PACK_BUFFER_BINDING", -1, state.pixelPackBuffer, actual.pixelPackBuffer);
+	mismatches += compare("GL_PIXEL_UNPACK_BUFFER_BINDING", -1, state.pixelUnpackBuffer, actual.pixelUnpackBuffer);
+	mismatches += compare("GL_DRAW_FRAMEBUFFER_BINDING", -1, state.drawFramebuffer, actual.drawFramebuffer);
+	mismatches += compare("GL_READ_FRAMEBUFFER_BINDING", -1, state.readFramebuffer, actual.readFramebuffer);
+	mismatches += compare("GL_ACTIVE_TEXTURE", -1, state.activeUnit, actual.activeUnit);
+	for (int unit = 0; unit < numTextureUnits; ++unit) {
+		mismatches += compare("GL_TEXTURE_BINDING_2D", unit, state.textures2D[unit], actual.textures2D[unit]);
+		mismatches += compare("GL_TEXTURE_BINDING_2D_ARRAY", unit, state.textures2DArray[unit],
+		                      actual.textures2DArray[unit]);
+		mismatches += compare("GL_SAMPLER_BINDING", unit, state.samplers[unit], actual.samplers[unit]);
+	}
+	for (int i = 0; i < MAX_CACHED_UNIFORM_BINDINGS; ++i) {
+		const UniformBinding &cached = state.uniformBindings[i];
+		const UniformBinding &bound = actual.uniformBindings[i];
+		mismatches += compare("GL_UNIFORM_BUFFER_BINDING", i, cached.buffer, bound.buffer);
+		if (cached.buffer != UNKNOWN && (cached.offset != bound.offset || cached.size != bound.size)) {
+			std::cerr << "GL state out of sync: GL_UNIFORM_BUFFER_START/SIZE[" << i << "] cached "
+			          << cached.offset << "+" << cached.size << ", context " << bound.offset << "+"
+			          << bound.size << std::endl;
+			mismatches++;
+		}
+	}
+	for (int i = 0; i < numCachedCapabilities; ++i) {
+		mismatches += compare("glIsEnabled", (int)cachedCapabilities[i], state.capabilities[i],
+		                      actual.capabilities[i]);
+	}
+	mismatches += compare("GL_DEPTH_FUNC", -1, state.depthFunc, actual.depthFunc);
+	mismatches += compare("GL_DEPTH_WRITEMASK", -1, state.depthMask, actual.depthMask);
+	mismatches += compare("GL_CULL_FACE_MODE", -1, state.cullFace, actual.cullFace);
+	auto element = state.elementBuffers.find(actual.vertexArray);
+	if (element != state.elementBuffers.end()) {
+		mismatches += compare("GL_ELEMENT_ARRAY_BUFFER_BINDING", -1, element->second,
+		                      actual.elementBuffers[actual.vertexArray]);
+	}
+
+	// Keep what is known about the other vertex arrays, and go on from the context's values
+	actual.elementBuffers.insert(state.elementBuffers.begin(), state.elementBuffers.end());
+	state = actual;
+	return mismatches;
+}
@@ -0,0 +1,35 @@
+#ifndef _GL_STATE_H_
+#define _GL_STATE_H_
+
+#include <glad/gl.h>
+
+// Texture units whose bindings are cached, units above pass straight through
+#define MAX_CACHED_TEXTURE_UNITS 16
+// Indexed uniform buffer binding points that are cached
+#define MAX_CACHED_UNIFORM_BINDINGS 8
+
+// State changes counted since the last takeGLStateStats()
+struct GLStateStats {
+    int calls;      // Cached calls made by the renderer
+    int skipped;    // Of those, the ones that matched the cache and never reached the driver
+};
+
+// Replaces the glad entry points that change the program, vertex array,
+// buffer, framebuffer, texture and sampler bindings, the capabilities and the
+// depth and cull state with wrappers that keep a shadow copy of that state
+// and drop calls that would not change it. Deletions clear the names they
+// free from the copy. Call once after gladLoadGL, the copy is then read back
+// from the context.
+void installStateCache();
+
+// Returns the counts so far and starts over, call once per frame
+GLStateStats takeGLStateStats();
+
+// Debug check: compares the shadow copy against glGet* and prints every
+// binding that went out of sync, then takes the context's values. Anything
+// that changes this state behind the wrappers (another context, a library
+// holding its own function pointers) shows up here. Returns the number of
+// mismatches.
+int validateGLState();
+
+#endif
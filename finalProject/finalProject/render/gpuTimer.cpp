@@ -0,0 +1,107 @@
+#include "gpuTimer.h"
+
+void GpuTimer::initialize()
+{
+	glGenQueries(GPU_TIMER_LATENCY, queries);
+	for (int i = 0; i < GPU_TIMER_LATENCY; ++i) {
+		pending[i] = false;
+	}
+	current = 0;
+	lastMs = 0.0;
+	averageMs = 0.0;
+}
+
+void GpuTimer::collect(int slot, bool wait)
+{
+	if (!pending[slot]) return;
+
+	if (!wait) {
+		GLint available = 0;
+		glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return;
+	}
+
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+	pending[slot] = false;
+
+	lastMs = elapsed / 1.0e6;
+	averageMs = (averageMs == 0.0) ? lastMs : averageMs * 0.9 + lastMs * 0.1;
+}
+
+void GpuTimer::begin()
+{
+	// The query in this slot was issued GPU_TIMER_LATENCY frames ago, so it is
+	// practically always finished by now
+	collect(current, true);
+	glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+}
+
+void GpuTimer::end()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	pending[current] = true;
+	current = (current + 1) % GPU_TIMER_LATENCY;
+
+	// Pick up any older results that are ready without waiting
+	for (int i = 1; i < GPU_TIMER_LATENCY; ++i) {
+		collect((current + i) % GPU_TIMER_LATENCY, false);
+	}
+}
+
+void GpuTimer::cleanup()
+{
+	glDeleteQueries(GPU_TIMER_LATENCY, queries);
+}
+
+void GpuFrameTimer::initialize()
+{
+	glGenQueries(GPU_TIMER_LATENCY * 2, queries);
+	for (int i = 0; i < GPU_TIMER_LATENCY; ++i) {
+		pending[i] = false;
+	}
+	current = 0;
+	lastMs = 0.0;
+	averageMs = 0.0;
+}
+
+void GpuFrameTimer::collect(int slot, bool wait)
+{
+	if (!pending[slot]) return;
+
+	if (!wait) {
+		GLint available = 0;
+		glGetQueryObjectiv(queries[slot * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return;
+	}
+
+	GLuint64 start = 0, end = 0;
+	glGetQueryObjectui64v(queries[slot * 2], GL_QUERY_RESULT, &start);
+	glGetQueryObjectui64v(queries[slot * 2 + 1], GL_QUERY_RESULT, &end);
+	pending[slot] = false;
+
+	lastMs = (end - start) / 1.0e6;
+	averageMs = (averageMs == 0.0) ? lastMs : averageMs * 0.9 + lastMs * 0.1;
+}
+
+void GpuFrameTimer::begin()
+{
+	collect(current, true);
+	glQueryCounter(queries[current * 2], GL_TIMESTAMP);
+}
+
+void GpuFrameTimer::end()
+{
+	glQueryCounter(queries[current * 2 + 1], GL_TIMESTAMP);
+	pending[current] = true;
+	current = (current + 1) % GPU_TIMER_LATENCY;
+
+	for (int i = 1; i < GPU_TIMER_LATENCY; ++i) {
+		collect((current + i) % GPU_TIMER_LATENCY, false);
+	}
+}
+
+void GpuFrameTimer::cleanup()
+{
+	glDeleteQueries(GPU_TIMER_LATENCY * 2, queries);
+}
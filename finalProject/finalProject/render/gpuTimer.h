@@ -0,0 +1,48 @@
+#ifndef _GPU_TIMER_H_
+#define _GPU_TIMER_H_
+
+#include <glad/gl.h>
+
+#define GPU_TIMER_LATENCY 4
+
+// Measures the GPU time of a block of commands with GL_TIME_ELAPSED queries.
+// Results are read back a few frames later so the CPU never waits on the GPU.
+// Only one timer may be running at a time.
+struct GpuTimer {
+    GLuint queries[GPU_TIMER_LATENCY];
+    bool pending[GPU_TIMER_LATENCY];
+    int current;
+
+    double lastMs;      // Most recent finished measurement
+    double averageMs;   // Exponential moving average of the measurements
+
+    void initialize();
+    void begin();
+    void end();
+    void cleanup();
+
+private:
+    void collect(int slot, bool wait);
+};
+
+// Measures the GPU time of whole frames between two GL_TIMESTAMP queries,
+// which unlike GL_TIME_ELAPSED may enclose the pass timers. While the GPU
+// keeps up it idles between commands, so the span then follows the CPU.
+struct GpuFrameTimer {
+    GLuint queries[GPU_TIMER_LATENCY * 2];
+    bool pending[GPU_TIMER_LATENCY];
+    int current;
+
+    double lastMs;
+    double averageMs;
+
+    void initialize();
+    void begin();
+    void end();
+    void cleanup();
+
+private:
+    void collect(int slot, bool wait);
+};
+
+#endif
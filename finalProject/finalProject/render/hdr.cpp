@@ -0,0 +1,129 @@
+#include "hdr.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <iostream>
+
+const char *tonemapName(int tonemap)
+{
+	switch (tonemap) {
+	case TONEMAP_REINHARD: return "Reinhard";
+	case TONEMAP_ACES: return "ACES";
+	default: return "Unknown";
+	}
+}
+
+void HDRTarget::initialize(int width, int height, bool useSRGBFramebuffer)
+{
+	this->width = width;
+	this->height = height;
+	targetWidth = width;
+	targetHeight = height;
+	outputWidth = width;
+	outputHeight = height;
+	exposure = 1.0f;
+	tonemap = TONEMAP_ACES;
+	sharpness = 0.5f;
+
+	createTargets();
+
+	// The window system may ignore the request for an sRGB back buffer
+	srgbFramebuffer = false;
+	if (useSRGBFramebuffer) {
+		GLint encoding = GL_LINEAR;
+		glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_BACK_LEFT, GL_FRAMEBUFFER_ATTACHMENT_COLOR_ENCODING, &encoding);
+		srgbFramebuffer = encoding == GL_SRGB;
+		if (!srgbFramebuffer) {
+			std::cout << "Default framebuffer is not sRGB, encoding in the resolve shader instead." << std::endl;
+		}
+	}
+
+	glGenVertexArrays(1, &emptyVAO);
+	programID = LoadShadersFromFile("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\fullscreen.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\resolve.frag");
+	if (programID == 0) {
+		std::cerr << "Failed to load resolve shaders." << std::endl;
+	}
+	hdrMapID = glGetUniformLocation(programID, "hdrMap");
+	exposureID = glGetUniformLocation(programID, "exposure");
+	tonemapID = glGetUniformLocation(programID, "tonemap");
+	encodeSRGBID = glGetUniformLocation(programID, "encodeSRGB");
+	sharpnessID = glGetUniformLocation(programID, "sharpness");
+}
+
+void HDRTarget::createTargets()
+{
+	// Filtered, so a render resolution below the window is scaled up smoothly
+	glGenTextures(1, &colorTexture);
+	glBindTexture(GL_TEXTURE_2D, colorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, targetWidth, targetHeight, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenRenderbuffers(1, &depthRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, targetWidth, targetHeight);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "HDR framebuffer is not complete." << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void HDRTarget::deleteTargets()
+{
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteTextures(1, &colorTexture);
+	glDeleteRenderbuffers(1, &depthRenderbuffer);
+}
+
+void HDRTarget::setRenderSize(int width, int height)
+{
+	this->width = std::min(std::max(width, 1), targetWidth);
+	this->height = std::min(std::max(height, 1), targetHeight);
+}
+
+void HDRTarget::begin()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, width, height);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void HDRTarget::resolve()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, outputWidth, outputHeight);
+	glDisable(GL_DEPTH_TEST);
+
+	// GL_FRAMEBUFFER_SRGB is left enabled for the sRGB G-buffer, but must not
+	// encode a second time when the shader already did
+	if (!srgbFramebuffer) glDisable(GL_FRAMEBUFFER_SRGB);
+
+	glUseProgram(programID);
+	glUniform1f(exposureID, exposure);
+	glUniform1i(tonemapID, tonemap);
+	glUniform1i(encodeSRGBID, !srgbFramebuffer);
+	glUniform1f(sharpnessID, (width < outputWidth || height < outputHeight) ? sharpness : 0.0f);
+	glActiveTexture(GL_TEXTURE0 + HDR_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, colorTexture);
+	glUniform1i(hdrMapID, HDR_TEXTURE_UNIT);
+
+	glBindVertexArray(emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	glEnable(GL_FRAMEBUFFER_SRGB);
+	glEnable(GL_DEPTH_TEST);
+}
+
+void HDRTarget::cleanup()
+{
+	deleteTargets();
+	glDeleteVertexArrays(1, &emptyVAO);
+	glDeleteProgram(programID);
+}
@@ -0,0 +1,74 @@
+#ifndef _HDR_H_
+#define _HDR_H_
+
+#include <glad/gl.h>
+
+// Texture unit the resolve pass samples the HDR colour from
+#define HDR_TEXTURE_UNIT 0
+
+enum {
+    TONEMAP_REINHARD = 0,
+    TONEMAP_ACES = 1,
+    TONEMAP_COUNT = 2
+};
+
+const char *tonemapName(int tonemap);
+
+// Floating point scene target. Every scene shader writes linear radiance into
+// it, and one resolve pass into the default framebuffer applies exposure, tone
+// mapping and the sRGB encoding, so that work is done once per pixel instead
+// of once per shaded fragment.
+//
+// The target is allocated once at the window size. A lower render resolution
+// only shrinks the viewport to its bottom-left corner, so it can change every
+// frame without reallocating, and the resolve scales that corner up to the
+// window with contrast adaptive sharpening.
+struct HDRTarget {
+    int width;                  // Render resolution
+    int height;
+    int targetWidth;            // Size of the attachments, the largest render resolution
+    int targetHeight;
+    int outputWidth;            // Default framebuffer, the resolve scales up to it
+    int outputHeight;
+
+    GLuint fbo;
+    GLuint colorTexture;        // RGBA16F
+    GLuint depthRenderbuffer;   // D24S8, same format as the G-buffer so its depth can be blitted in
+
+    float exposure;
+    int tonemap;
+    float sharpness;            // 0 to 1, applied when the render resolution is below the output
+
+    // True when the default framebuffer is sRGB and GL_FRAMEBUFFER_SRGB does the
+    // encoding in hardware. Otherwise the resolve shader applies the curve.
+    bool srgbFramebuffer;
+
+    GLuint programID;
+    GLuint emptyVAO;
+    GLint hdrMapID;
+    GLint exposureID;
+    GLint tonemapID;
+    GLint encodeSRGBID;
+    GLint sharpnessID;
+
+    // useSRGBFramebuffer is only honoured if the default framebuffer really is sRGB
+    void initialize(int width, int height, bool useSRGBFramebuffer);
+
+    // Renders the following frames at another resolution, clamped to the target size
+    void setRenderSize(int width, int height);
+
+    // Binds and clears the target
+    void begin();
+
+    // Tone maps the target into the default framebuffer. Reads the render
+    // resolution from the frame uniforms.
+    void resolve();
+
+    void cleanup();
+
+private:
+    void createTargets();
+    void deleteTargets();
+};
+
+#endif
@@ -2,6 +2,12 @@
 #define TINYGLTF_NO_STB_IMAGE
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 
+// stb_image allocates through these, so textures can decode into mapped buffers
+#include <render/decodeTarget.h>
+#define STBI_MALLOC(size) decodeMalloc(size)
+#define STBI_REALLOC_SIZED(memory, oldSize, newSize) decodeRealloc(memory, oldSize, newSize)
+#define STBI_FREE(memory) decodeFree(memory)
+
 // Include your STB implementations
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -21,9 +27,35 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <render/shader.h>
+#include <render/programCache.h>
+#include <render/shadowMap.h>
+#include <render/uniformBuffers.h>
+#include <render/glState.h>
+#include <render/glCounters.h>
+#include <render/gpuTimer.h>
+#include <render/fragmentCounter.h>
+#include <render/deferred.h>
+#include <render/ssao.h>
+#include <render/hdr.h>
+#include <render/profiler.h>
+#include <render/benchmark.h>
+#include <render/headless.h>
+#include <render/inputLog.h>
+#include <render/framePipeline.h>
+#include <render/sphericalHarmonics.h>
+#include <render/readback.h>
+#include <render/frameCapture.h>
+#include <render/sceneSnapshot.h>
+#include <render/qualityGovernor.h>
+#include <render/frameArena.h>
+#include <render/processMemory.h>
+#include <render/mappedFile.h>
 
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <thread>
+#include <chrono>
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <iomanip>
@@ -0,0 +1,107 @@
+#include "headless.h"
+
+#include <iostream>
+
+#ifdef FP_HAVE_EGL
+
+#include <glad/gl.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+static EGLSurface surface = EGL_NO_SURFACE;
+
+GLADapiproc getHeadlessProcAddress(const char *name)
+{
+	return (GLADapiproc)eglGetProcAddress(name);
+}
+
+bool createHeadlessContext(int width, int height)
+{
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay) {
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+#endif
+	if (display == EGL_NO_DISPLAY) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		std::cerr << "Failed to initialize EGL." << std::endl;
+		return false;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0) {
+		std::cerr << "No EGL config with a pbuffer." << std::endl;
+		return false;
+	}
+
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+	const EGLint surfaceAttributes[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+	surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+	if (context == EGL_NO_CONTEXT || surface == EGL_NO_SURFACE || !eglMakeCurrent(display, surface, surface, context)) {
+		std::cerr << "Failed to create an OpenGL 3.3 core context with EGL." << std::endl;
+		destroyHeadlessContext();
+		return false;
+	}
+
+	if (gladLoadGL(getHeadlessProcAddress) == 0) {
+		std::cerr << "Failed to initialize OpenGL context." << std::endl;
+		destroyHeadlessContext();
+		return false;
+	}
+	std::cout << "Headless context: " << glGetString(GL_RENDERER) << std::endl;
+	return true;
+}
+
+void destroyHeadlessContext()
+{
+	if (display == EGL_NO_DISPLAY) return;
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+	if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+	eglTerminate(display);
+	display = EGL_NO_DISPLAY;
+	context = EGL_NO_CONTEXT;
+	surface = EGL_NO_SURFACE;
+}
+
+#else
+
+bool createHeadlessContext(int width, int height)
+{
+	std::cerr << "Built without EGL, no headless context available." << std::endl;
+	return false;
+}
+
+void destroyHeadlessContext()
+{
+}
+
+GLADapiproc getHeadlessProcAddress(const char *name)
+{
+	return NULL;
+}
+
+#endif
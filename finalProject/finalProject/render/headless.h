@@ -0,0 +1,18 @@
+#ifndef _HEADLESS_H_
+#define _HEADLESS_H_
+
+#include <glad/gl.h>
+
+// Offscreen OpenGL 3.3 core context for benchmarks, without a window or a
+// display server. Built on EGL (FP_HAVE_EGL): the Mesa surfaceless platform
+// when present, so it runs on llvmpipe without a GPU, otherwise the default
+// EGL display. A pbuffer of the given size stands in for the default
+// framebuffer. Returns false if EGL is unavailable or no context can be made.
+bool createHeadlessContext(int width, int height);
+
+void destroyHeadlessContext();
+
+// Entry point lookup of the headless context, for functions glad does not load
+GLADapiproc getHeadlessProcAddress(const char *name);
+
+#endif
@@ -0,0 +1,188 @@
+#include "inputLog.h"
+
+#include <cstring>
+#include <iostream>
+
+#define INPUT_LOG_MAGIC "FPIN"
+#define INPUT_LOG_VERSION 1
+
+// Records and the header are stored in the byte order of the recording
+// machine, which is little-endian on every platform the project runs on
+template <typename T>
+static void writeValue(FILE *file, T value)
+{
+	fwrite(&value, sizeof(T), 1, file);
+}
+
+template <typename T>
+static bool readValue(const std::vector<unsigned char> &data, size_t &offset, T &value)
+{
+	if (offset + sizeof(T) > data.size()) return false;
+	memcpy(&value, &data[offset], sizeof(T));
+	offset += sizeof(T);
+	return true;
+}
+
+bool InputLog::startRecording(const std::string &path, const InputSessionState &state)
+{
+	stop();
+	file = fopen(path.c_str(), "wb");
+	if (file == NULL) {
+		std::cerr << "Failed to create input log " << path << std::endl;
+		return false;
+	}
+	fwrite(INPUT_LOG_MAGIC, 1, 4, file);
+	writeValue<uint32_t>(file, INPUT_LOG_VERSION);
+	fwrite(&state, sizeof(state), 1, file);
+
+	time = 0.0;
+	recording = true;
+	std::cout << "Recording input to " << path << std::endl;
+	return true;
+}
+
+bool InputLog::startReplay(const std::string &path, InputSessionState &state)
+{
+	stop();
+	FILE *input = fopen(path.c_str(), "rb");
+	if (input == NULL) {
+		std::cerr << "Failed to open input log " << path << std::endl;
+		return false;
+	}
+	std::vector<unsigned char> data;
+	unsigned char buffer[4096];
+	size_t count;
+	while ((count = fread(buffer, 1, sizeof(buffer), input)) > 0) {
+		data.insert(data.end(), buffer, buffer + count);
+	}
+	fclose(input);
+
+	size_t offset = 0;
+	uint32_t version = 0;
+	if (data.size() < 4 || memcmp(&data[0], INPUT_LOG_MAGIC, 4) != 0) {
+		std::cerr << path << " is not an input log." << std::endl;
+		return false;
+	}
+	offset = 4;
+	if (!readValue(data, offset, version) || version != INPUT_LOG_VERSION || !readValue(data, offset, state)) {
+		std::cerr << "Unsupported input log " << path << std::endl;
+		return false;
+	}
+
+	events.clear();
+	while (offset < data.size()) {
+		InputEvent event = {};
+		uint8_t type;
+		if (!readValue(data, offset, type) || !readValue(data, offset, event.time)) break;
+		event.type = type;
+		bool complete = true;
+		if (type == INPUT_KEY) {
+			int16_t key, scancode;
+			uint8_t action, mods;
+			complete = readValue(data, offset, key) && readValue(data, offset, scancode) &&
+			           readValue(data, offset, action) && readValue(data, offset, mods);
+			event.key = key;
+			event.scancode = scancode;
+			event.action = action;
+			event.mods = mods;
+		} else if (type == INPUT_CURSOR || type == INPUT_SCROLL) {
+			complete = readValue(data, offset, event.x) && readValue(data, offset, event.y);
+		} else if (type != INPUT_END) {
+			complete = false;
+		}
+		if (!complete) {
+			std::cerr << "Input log " << path << " is truncated, replaying " << events.size() << " events." << std::endl;
+			break;
+		}
+		events.push_back(event);
+	}
+
+	time = 0.0;
+	nextIndex = 0;
+	replaying = true;
+	std::cout << "Replaying " << events.size() << " input events (" << duration() << " s) from " << path << std::endl;
+	return true;
+}
+
+void InputLog::stop()
+{
+	if (recording) {
+		InputEvent end = {};
+		end.time = (float)time;
+		end.type = INPUT_END;
+		write(end);
+		fclose(file);
+		file = NULL;
+		recording = false;
+	}
+	replaying = false;
+}
+
+void InputLog::write(const InputEvent &event)
+{
+	writeValue<uint8_t>(file, (uint8_t)event.type);
+	writeValue<float>(file, event.time);
+	if (event.type == INPUT_KEY) {
+		writeValue<int16_t>(file, (int16_t)event.key);
+		writeValue<int16_t>(file, (int16_t)event.scancode);
+		writeValue<uint8_t>(file, (uint8_t)event.action);
+		writeValue<uint8_t>(file, (uint8_t)event.mods);
+	} else if (event.type == INPUT_CURSOR || event.type == INPUT_SCROLL) {
+		writeValue<double>(file, event.x);
+		writeValue<double>(file, event.y);
+	}
+}
+
+void InputLog::recordKey(int key, int scancode, int action, int mods)
+{
+	if (!recording) return;
+	InputEvent event = {};
+	event.time = (float)time;
+	event.type = INPUT_KEY;
+	event.key = key;
+	event.scancode = scancode;
+	event.action = action;
+	event.mods = mods;
+	write(event);
+}
+
+void InputLog::recordCursor(double x, double y)
+{
+	if (!recording) return;
+	InputEvent event = {};
+	event.time = (float)time;
+	event.type = INPUT_CURSOR;
+	event.x = x;
+	event.y = y;
+	write(event);
+}
+
+void InputLog::recordScroll(double xoffset, double yoffset)
+{
+	if (!recording) return;
+	InputEvent event = {};
+	event.time = (float)time;
+	event.type = INPUT_SCROLL;
+	event.x = xoffset;
+	event.y = yoffset;
+	write(event);
+}
+
+bool InputLog::nextEvent(InputEvent &event)
+{
+	if (!replaying || nextIndex >= events.size()) return false;
+	if (events[nextIndex].time > (float)time) return false;
+	event = events[nextIndex++];
+	return true;
+}
+
+void InputLog::rewind()
+{
+	time = 0.0;
+	nextIndex = 0;
+}
+
+float InputLog::duration() const
+{
+	return events.empty() ? 0.0f : events.back().time;
+}
@@ -0,0 +1,94 @@
+#ifndef _INPUT_LOG_H_
+#define _INPUT_LOG_H_
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+enum InputEventType {
+    INPUT_KEY = 0,
+    INPUT_CURSOR = 1,
+    INPUT_SCROLL = 2,
+    INPUT_END = 3       // Written when a recording stops, marks the session length
+};
+
+// One GLFW callback, stamped with the simulated time it applies at
+struct InputEvent {
+    float time;         // Seconds since the start of the session
+    int type;
+    int key;            // Key events only
+    int scancode;
+    int action;
+    int mods;
+    double x;           // Cursor position or scroll offsets
+    double y;
+};
+
+// Everything the recorded input acts on, restored before a replay starts
+struct InputSessionState {
+    glm::vec3 eyeCenter;
+    glm::vec3 lookat;
+    float viewAzimuth;
+    float viewPolar;
+    int32_t useDeferred;
+    int32_t shadowFilter;
+    int32_t ssaoPreset;
+    int32_t useDepthPrePass;
+    int32_t tonemap;
+    float exposure;
+};
+
+// Records GLFW input events to a binary log and plays them back. The log
+// keeps its own simulated clock, advanced once per frame by the caller, so a
+// replay at fixed frame deltas delivers every event on the frame it was
+// recorded for. The file is a header with the session state followed by
+// variable size little-endian records of 5 to 21 bytes.
+struct InputLog {
+    double time;        // Simulated session time
+
+    InputLog() : time(0.0), file(NULL), recording(false), replaying(false), nextIndex(0) {}
+
+    // Creates the log and writes the starting state. Returns false if the file cannot be created.
+    bool startRecording(const std::string &path, const InputSessionState &state);
+
+    // Reads a whole log into memory. Returns false if it is missing or malformed.
+    bool startReplay(const std::string &path, InputSessionState &state);
+
+    // Ends the session, a recording is closed with an end marker
+    void stop();
+
+    bool isRecording() const { return recording; }
+    bool isReplaying() const { return replaying; }
+
+    void advance(float deltaTime) { time += deltaTime; }
+
+    void recordKey(int key, int scancode, int action, int mods);
+    void recordCursor(double x, double y);
+    void recordScroll(double xoffset, double yoffset);
+
+    // Pops the next replayed event that is due at the current time
+    bool nextEvent(InputEvent &event);
+
+    // True once the replay clock has passed the end of the recording
+    bool isFinished() const { return replaying && nextIndex >= events.size(); }
+
+    // Restarts the replay from the first event
+    void rewind();
+
+    // Length of the loaded recording in seconds
+    float duration() const;
+
+private:
+    FILE *file;
+    bool recording;
+    bool replaying;
+    std::vector<InputEvent> events;
+    size_t nextIndex;
+
+    void write(const InputEvent &event);
+};
+
+#endif
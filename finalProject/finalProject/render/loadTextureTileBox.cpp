@@ -1,7 +1,14 @@
 
+// The file is mapped, its header gives the image size, and stb_image decodes
+// straight into a mapped pixel unpack buffer (see decodeTarget.h) that the
+// texture is uploaded from. No full-size copy is made on the CPU. If stb
+// decodes elsewhere after all, the image is copied into the buffer once.
 static GLuint LoadTextureTileBox(const char *texture_file_path) {
-    int w, h, channels;
-    uint8_t* img = stbi_load(texture_file_path, &w, &h, &channels, 3);
+    int w = 0, h = 0, channels;
+    MappedFile file;
+    bool valid = file.open(texture_file_path) &&
+                 stbi_info_from_memory(file.data, (int)file.size, &w, &h, &channels);
+
     GLuint texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
@@ -12,14 +19,58 @@ static GLuint LoadTextureTileBox(const char *texture_file_path) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    if (img) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, img);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
+    if (!valid) {
         std::cout << "Failed to load texture " << texture_file_path << std::endl;
+        return texture;
+    }
+
+    // Decoded rows are tightly packed, one spare byte for the JPEG decoder
+    size_t imageBytes = (size_t)w * h * 3;
+    GLuint unpackBuffer;
+    glGenBuffers(1, &unpackBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, imageBytes + 1, NULL, GL_STREAM_DRAW);
+    unsigned char *pixels = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, imageBytes + 1,
+                                                              GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (pixels != NULL) setDecodeTarget(pixels, imageBytes);
+    uint8_t *img = stbi_load_from_memory(file.data, (int)file.size, &w, &h, &channels, 3);
+    clearDecodeTarget();
+    file.close();
+
+    bool mapped = pixels != NULL;
+    if (mapped) {
+        if (img != NULL && img != pixels) {
+            std::cout << "Texture " << texture_file_path << " was not decoded in place, copying it" << std::endl;
+            memcpy(pixels, img, imageBytes);
+        }
+        mapped = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
     }
-    stbi_image_free(img);
+
+    // Images are sRGB encoded, sampling them returns linear colours
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (img == NULL) {
+        std::cout << "Failed to load texture " << texture_file_path << std::endl;
+    } else if (mapped) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, BUFFER_OFFSET(0));
+    }
+
+    // The driver keeps the buffer until the upload is done
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &unpackBuffer);
+
+    if (img != NULL && !mapped) {
+        if (img == pixels) {
+            // The decoded image went with the buffer
+            std::cout << "Failed to upload texture " << texture_file_path << std::endl;
+        } else {
+            // Straight from the decoded rows
+            std::cout << "Failed to map the upload buffer for " << texture_file_path << std::endl;
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, img);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (img != NULL && img != pixels) stbi_image_free(img);
+    if (img != NULL) glGenerateMipmap(GL_TEXTURE_2D);
 
     return texture;
 }
-
@@ -0,0 +1,31 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+
+// A whole file mapped read-only into memory. Pages are read from the file
+// cache as they are touched, nothing is copied into a buffer of our own.
+// The data stays valid until close().
+struct MappedFile {
+    const unsigned char *data;
+    size_t size;
+
+    MappedFile();
+    ~MappedFile();
+
+    // Fails, with a message, for missing or empty files
+    bool open(const std::string &path);
+    void close();
+
+private:
+#ifdef _WIN32
+    void *file;
+    void *mapping;
+#endif
+
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include "processMemory.h"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define PSAPI_VERSION 2     // GetProcessMemoryInfo from kernel32, no psapi.lib
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <malloc.h>
+#include <unistd.h>
+#endif
+
+size_t getResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return (size_t)counters.WorkingSetSize;
+	}
+	return 0;
+#elif defined(__linux__)
+	// Total and resident pages
+	FILE *file = fopen("/proc/self/statm", "r");
+	if (!file) return 0;
+	unsigned long total = 0, resident = 0;
+	int fields = fscanf(file, "%lu %lu", &total, &resident);
+	fclose(file);
+	if (fields != 2) return 0;
+	return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#else
+	return 0;
+#endif
+}
+
+void releaseFreeHeap()
+{
+#if defined(__linux__) && defined(__GLIBC__)
+	malloc_trim(0);
+#endif
+}
@@ -0,0 +1,14 @@
+#ifndef _PROCESS_MEMORY_H_
+#define _PROCESS_MEMORY_H_
+
+#include <cstddef>
+
+// Resident set size of the process in bytes: the working set on Windows,
+// /proc/self/statm on Linux. Returns 0 where neither is available.
+size_t getResidentBytes();
+
+// Hands freed heap memory back to the system where the C library keeps it
+// (glibc), so that a resident size taken afterwards reflects the release
+void releaseFreeHeap();
+
+#endif
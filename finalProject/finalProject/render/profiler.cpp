@@ -0,0 +1,194 @@
+#include "profiler.h"
+
+#include <cstdio>
+#include <iostream>
+
+void Profiler::initialize()
+{
+	numFrames = 0;
+	recordedFrames = 0;
+	current = 0;
+	frameNumber = 0;
+	submittedFrames = 0;
+	frameOpen = false;
+	epoch = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < PROFILER_LATENCY; ++i) {
+		glGenQueries(PROFILER_MAX_GPU_SCOPES * 2, frames[i].queries);
+		frames[i].numQueries = 0;
+		frames[i].pending = false;
+	}
+
+	// Line the GPU clock up with the CPU clock once. Both drift a little, which
+	// is fine for a trace of a few seconds.
+	GLint64 gpuTime = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+	gpuOffset = now() - gpuTime / 1000.0;
+}
+
+double Profiler::now() const
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::start(int numFrames, const std::string &outputPath)
+{
+	if (isRecording() || numFrames <= 0) return;
+	this->numFrames = numFrames;
+	this->outputPath = outputPath;
+	recordedFrames = 0;
+	submittedFrames = 0;
+	events.clear();
+	std::cout << "Profiling " << numFrames << " frames into " << outputPath << std::endl;
+}
+
+void Profiler::beginFrame()
+{
+	if (!isRecording() || submittedFrames >= numFrames) return;
+
+	// This slot was submitted PROFILER_LATENCY frames ago
+	Frame &frame = frames[current];
+	if (frame.pending) collect(frame);
+
+	frame.scopes.clear();
+	frame.open.clear();
+	frame.numQueries = 0;
+	frame.number = frameNumber;
+	frameOpen = true;
+	beginScope("Frame", true);
+}
+
+void Profiler::endFrame()
+{
+	++frameNumber;
+	if (!frameOpen) return;
+
+	endScope();
+	frameOpen = false;
+	frames[current].pending = true;
+	current = (current + 1) % PROFILER_LATENCY;
+
+	if (++submittedFrames >= numFrames) {
+		// Last frame of the recording, wait for the remaining queries
+		for (int i = 0; i < PROFILER_LATENCY; ++i) {
+			Frame &frame = frames[(current + i) % PROFILER_LATENCY];
+			if (frame.pending) collect(frame);
+		}
+		write();
+		numFrames = 0;
+	}
+}
+
+void Profiler::beginScope(const char *name, bool gpu)
+{
+	if (!frameOpen) return;
+	Frame &frame = frames[current];
+
+	Scope scope;
+	scope.name = name;
+	scope.start = now();
+	scope.end = scope.start;
+	scope.query = -1;
+	scope.worker = false;
+	if (gpu && frame.numQueries + 2 <= PROFILER_MAX_GPU_SCOPES * 2) {
+		scope.query = frame.numQueries;
+		frame.numQueries += 2;
+		glQueryCounter(frame.queries[scope.query], GL_TIMESTAMP);
+	}
+	frame.open.push_back((int)frame.scopes.size());
+	frame.scopes.push_back(scope);
+}
+
+void Profiler::endScope()
+{
+	if (!frameOpen) return;
+	Frame &frame = frames[current];
+	if (frame.open.empty()) return;
+
+	Scope &scope = frame.scopes[frame.open.back()];
+	frame.open.pop_back();
+	if (scope.query >= 0) {
+		glQueryCounter(frame.queries[scope.query + 1], GL_TIMESTAMP);
+	}
+	scope.end = now();
+}
+
+void Profiler::addWorkerScope(const char *name, std::chrono::steady_clock::time_point start,
+                              std::chrono::steady_clock::time_point end)
+{
+	if (!frameOpen) return;
+	Scope scope;
+	scope.name = name;
+	scope.start = std::chrono::duration<double, std::micro>(start - epoch).count();
+	scope.end = std::chrono::duration<double, std::micro>(end - epoch).count();
+	scope.query = -1;
+	scope.worker = true;
+	frames[current].scopes.push_back(scope);
+}
+
+void Profiler::collect(Frame &frame)
+{
+	for (size_t i = 0; i < frame.scopes.size(); ++i) {
+		const Scope &scope = frame.scopes[i];
+		TraceEvent event;
+		event.name = scope.name;
+		event.gpu = false;
+		event.worker = scope.worker;
+		event.frame = frame.number;
+		event.start = scope.start;
+		event.duration = scope.end - scope.start;
+		events.push_back(event);
+
+		if (scope.query >= 0) {
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(frame.queries[scope.query], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(frame.queries[scope.query + 1], GL_QUERY_RESULT, &end);
+			event.gpu = true;
+			event.start = begin / 1000.0 + gpuOffset;
+			event.duration = (end - begin) / 1000.0;
+			events.push_back(event);
+		}
+	}
+	frame.pending = false;
+	++recordedFrames;
+}
+
+void Profiler::write()
+{
+	FILE *file = fopen(outputPath.c_str(), "w");
+	if (!file) {
+		std::cerr << "Failed to write " << outputPath << std::endl;
+		return;
+	}
+
+	// Complete ("X") events, CPU scopes on thread 1, GPU scopes on thread 2
+	// and the simulation worker's scopes on thread 3
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}},\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":3,\"args\":{\"name\":\"Simulation\"}}");
+	for (size_t i = 0; i < events.size(); ++i) {
+		const TraceEvent &event = events[i];
+		fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%d}}",
+		        event.name, event.gpu ? "gpu" : "cpu", event.gpu ? 2 : event.worker ? 3 : 1, event.start, event.duration, event.frame);
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	std::cout << "Profile of " << recordedFrames << " frames (" << events.size() << " events) written to "
+	          << outputPath << std::endl;
+}
+
+void Profiler::cleanup()
+{
+	if (isRecording()) {
+		for (int i = 0; i < PROFILER_LATENCY; ++i) {
+			if (frames[i].pending) collect(frames[i]);
+		}
+		write();
+		numFrames = 0;
+	}
+	for (int i = 0; i < PROFILER_LATENCY; ++i) {
+		glDeleteQueries(PROFILER_MAX_GPU_SCOPES * 2, frames[i].queries);
+	}
+}
@@ -0,0 +1,92 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <glad/gl.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Frames recorded before the queries of a frame are read back
+#define PROFILER_LATENCY 4
+
+// GPU scopes per frame, further scopes are recorded on the CPU only
+#define PROFILER_MAX_GPU_SCOPES 64
+
+// A finished scope, in microseconds on the CPU clock
+struct TraceEvent {
+    const char *name;
+    bool gpu;
+    bool worker;        // Timed on the simulation thread
+    int frame;
+    double start;
+    double duration;
+};
+
+// Frame profiler with nested CPU scopes and GPU scopes. GPU scopes are
+// bracketed by GL_TIMESTAMP queries, which unlike GL_TIME_ELAPSED may nest
+// and overlap the pass timers. Each frame owns a query pool in a ring of
+// PROFILER_LATENCY frames, so results are collected long after the GPU
+// finished them. After numFrames frames the scopes are written as a Chrome
+// trace (chrome://tracing or ui.perfetto.dev).
+struct Profiler {
+    std::string outputPath;
+    int numFrames;          // Frames to record, 0 when idle
+    int recordedFrames;     // Frames whose scopes have all been collected
+
+    void initialize();
+
+    // Starts recording the next numFrames frames
+    void start(int numFrames, const std::string &outputPath);
+    bool isRecording() const { return numFrames > 0; }
+
+    void beginFrame();
+    void endFrame();
+
+    // Scopes must be closed in reverse order. Names must outlive the profiler.
+    void beginScope(const char *name, bool gpu);
+    void endScope();
+
+    // Adds a CPU scope timed by another thread to the current frame. These
+    // go on a track of their own, they overlap the scopes of the GL thread.
+    void addWorkerScope(const char *name, std::chrono::steady_clock::time_point start,
+                        std::chrono::steady_clock::time_point end);
+
+    // Writes a partial trace if recording was interrupted
+    void cleanup();
+
+private:
+    struct Scope {
+        const char *name;
+        double start;
+        double end;
+        int query;          // First of two timestamp queries, -1 for CPU scopes
+        bool worker;
+    };
+
+    struct Frame {
+        std::vector<Scope> scopes;
+        std::vector<int> open;
+        GLuint queries[PROFILER_MAX_GPU_SCOPES * 2];
+        int numQueries;
+        int number;
+        bool pending;
+    };
+
+    Frame frames[PROFILER_LATENCY];
+    int current;
+    int frameNumber;
+    int submittedFrames;
+    bool frameOpen;
+
+    std::chrono::steady_clock::time_point epoch;
+    double gpuOffset;       // Added to GPU timestamps (us) to land on the CPU clock
+
+    std::vector<TraceEvent> events;
+
+    double now() const;
+    void collect(Frame &frame);
+    void write();
+};
+
+#endif
@@ -0,0 +1,271 @@
+#include "programCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Tokens of ARB_get_program_binary and KHR_parallel_shader_compile, which the
+// 3.3 core glad header does not have
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void (GLAD_API_PTR *GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei *length,
+                                                  GLenum *binaryFormat, void *binary);
+typedef void (GLAD_API_PTR *ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void *binary,
+                                               GLsizei length);
+typedef void (GLAD_API_PTR *ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+typedef void (GLAD_API_PTR *MaxShaderCompilerThreadsProc)(GLuint count);
+
+static GetProgramBinaryProc getProgramBinary;
+static ProgramBinaryProc programBinary;
+static ProgramParameteriProc programParameteri;
+static bool parallelCompile = false;
+
+static std::string cacheDirectory;
+static std::string driverString;
+static ProgramCacheStats stats;
+
+// File header: magic, version, binary format, key, length, then the binary
+static const char fileMagic[4] = { 'F', 'P', 'P', 'B' };
+static const uint32_t fileVersion = 1;
+
+struct ProgramBinary {
+	GLenum format;
+	std::vector<char> data;
+};
+static std::unordered_map<uint64_t, ProgramBinary> binaries;
+
+static bool hasExtension(const char *name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i) {
+		const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+		if (extension && strcmp(extension, name) == 0) return true;
+	}
+	return false;
+}
+
+static void makeDirectory(const std::string &path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+// 64-bit FNV-1a
+static uint64_t hashBytes(uint64_t hash, const char *data, size_t size)
+{
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static std::string binaryPath(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return cacheDirectory + "/" + name;
+}
+
+static bool readBinaryFile(uint64_t key, ProgramBinary &binary)
+{
+	FILE *file = fopen(binaryPath(key).c_str(), "rb");
+	if (!file) return false;
+
+	char magic[4];
+	uint32_t version = 0, format = 0, length = 0;
+	uint64_t storedKey = 0;
+	bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, fileMagic, 4) == 0 &&
+	          fread(&version, sizeof(version), 1, file) == 1 && version == fileVersion &&
+	          fread(&format, sizeof(format), 1, file) == 1 &&
+	          fread(&storedKey, sizeof(storedKey), 1, file) == 1 && storedKey == key &&
+	          fread(&length, sizeof(length), 1, file) == 1 && length > 0;
+	if (ok) {
+		binary.format = format;
+		binary.data.resize(length);
+		ok = fread(&binary.data[0], 1, length, file) == length;
+	}
+	fclose(file);
+	return ok;
+}
+
+static void writeBinaryFile(uint64_t key, const ProgramBinary &binary)
+{
+	FILE *file = fopen(binaryPath(key).c_str(), "wb");
+	if (!file) return;
+	uint32_t format = binary.format;
+	uint32_t length = (uint32_t)binary.data.size();
+	fwrite(fileMagic, 1, 4, file);
+	fwrite(&fileVersion, sizeof(fileVersion), 1, file);
+	fwrite(&format, sizeof(format), 1, file);
+	fwrite(&key, sizeof(key), 1, file);
+	fwrite(&length, sizeof(length), 1, file);
+	fwrite(&binary.data[0], 1, length, file);
+	fclose(file);
+}
+
+void initializeProgramCache(GLADloadfunc load, const std::string &directory)
+{
+	cacheDirectory = directory;
+	memset(&stats, 0, sizeof(stats));
+
+	const char *strings[] = {
+		(const char *)glGetString(GL_VENDOR), (const char *)glGetString(GL_RENDERER),
+		(const char *)glGetString(GL_VERSION), (const char *)glGetString(GL_SHADING_LANGUAGE_VERSION),
+	};
+	driverString.clear();
+	for (const char *string : strings) {
+		if (string) driverString += string;
+		driverString += '\n';
+	}
+
+	// Core since 4.1, which drivers often hand out for a 3.3 request. A
+	// driver may expose the entry points yet offer no format to store.
+	GLint major = 0, minor = 0, numFormats = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	bool core = major > 4 || (major == 4 && minor >= 1);
+	if (load != NULL && (core || hasExtension("GL_ARB_get_program_binary"))) {
+		getProgramBinary = (GetProgramBinaryProc)load("glGetProgramBinary");
+		programBinary = (ProgramBinaryProc)load("glProgramBinary");
+		programParameteri = (ProgramParameteriProc)load("glProgramParameteri");
+		if (getProgramBinary && programBinary && programParameteri) {
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+			while (glGetError() != GL_NO_ERROR) {}
+		}
+	}
+	if (numFormats <= 0) {
+		getProgramBinary = NULL;
+		programBinary = NULL;
+		programParameteri = NULL;
+	} else {
+		makeDirectory(cacheDirectory);
+	}
+
+	// Compiles in the background start with glMaxShaderCompilerThreads, the driver picks the count
+	MaxShaderCompilerThreadsProc maxThreads = NULL;
+	if (load != NULL && hasExtension("GL_KHR_parallel_shader_compile")) {
+		maxThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+	} else if (load != NULL && hasExtension("GL_ARB_parallel_shader_compile")) {
+		maxThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsARB");
+	}
+	if (maxThreads) {
+		maxThreads(0xFFFFFFFFu);
+		parallelCompile = true;
+	}
+
+	std::cout << "Program cache: " << (programBinary ? "binaries in " + cacheDirectory : "no binary formats")
+	          << ", " << (parallelCompile ? "parallel" : "serial") << " shader compiles" << std::endl;
+}
+
+bool hasParallelShaderCompile()
+{
+	return parallelCompile;
+}
+
+uint64_t getProgramKey(const std::string &vertexCode, const std::string &fragmentCode)
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = hashBytes(hash, driverString.c_str(), driverString.size() + 1);
+	hash = hashBytes(hash, vertexCode.c_str(), vertexCode.size() + 1);
+	hash = hashBytes(hash, fragmentCode.c_str(), fragmentCode.size() + 1);
+	return hash;
+}
+
+void prepareProgramBinary(GLuint programID)
+{
+	if (programParameteri) programParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool hasProgramBinary(uint64_t key)
+{
+	if (!programBinary) return false;
+	if (binaries.count(key)) return true;
+	FILE *file = fopen(binaryPath(key).c_str(), "rb");
+	if (file) fclose(file);
+	return file != NULL;
+}
+
+GLuint loadProgramBinary(uint64_t key)
+{
+	if (!programBinary) return 0;
+
+	bool fromDisk = false;
+	auto found = binaries.find(key);
+	if (found == binaries.end()) {
+		ProgramBinary binary;
+		if (!readBinaryFile(key, binary)) return 0;
+		found = binaries.insert(std::make_pair(key, binary)).first;
+		fromDisk = true;
+	}
+
+	// Binaries are refused after driver or hardware changes the key missed
+	const ProgramBinary &binary = found->second;
+	GLuint programID = glCreateProgram();
+	programBinary(programID, binary.format, &binary.data[0], (GLsizei)binary.data.size());
+	GLint linked = GL_FALSE;
+	glGetProgramiv(programID, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		glDeleteProgram(programID);
+		binaries.erase(found);
+		remove(binaryPath(key).c_str());
+		stats.rejected++;
+		return 0;
+	}
+
+	if (fromDisk) stats.diskHits++;
+	else stats.memoryHits++;
+	return programID;
+}
+
+void storeProgramBinary(uint64_t key, GLuint programID)
+{
+	stats.compiled++;
+	if (!getProgramBinary) return;
+
+	GLint length = 0;
+	glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	ProgramBinary binary;
+	binary.data.resize(length);
+	GLsizei written = 0;
+	getProgramBinary(programID, length, &written, &binary.format, &binary.data[0]);
+	if (written <= 0) return;
+	binary.data.resize(written);
+
+	writeBinaryFile(key, binary);
+	binaries[key] = binary;
+}
+
+ProgramCacheStats &getProgramCacheStats()
+{
+	return stats;
+}
+
+void printProgramCacheStats()
+{
+	std::cout << "Shader programs: " << stats.compiled << " compiled, " << stats.diskHits << " from disk, "
+	          << stats.memoryHits << " reused, " << stats.rejected << " rejected binaries, " << stats.ms << " ms"
+	          << std::endl;
+}
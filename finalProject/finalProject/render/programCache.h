@@ -0,0 +1,51 @@
+#ifndef _PROGRAM_CACHE_H_
+#define _PROGRAM_CACHE_H_
+
+#include <glad/gl.h>
+#include <stdint.h>
+#include <string>
+
+// Where the programs of a run came from, see printProgramCacheStats()
+struct ProgramCacheStats {
+    int compiled;       // Built from source
+    int diskHits;       // Loaded from a binary stored by an earlier run
+    int memoryHits;     // Loaded from a binary of this run, for repeated sources
+    int rejected;       // Stored binaries the driver refused, compiled again
+    double ms;          // Time spent building and loading programs
+};
+
+// Linked program binaries (ARB_get_program_binary, core since 4.1) kept in
+// memory and under a directory, so later loads of the same program skip the
+// driver's compiler. glad only loads 3.3 core, so the entry points, and
+// glMaxShaderCompilerThreadsKHR of KHR_parallel_shader_compile, are looked up
+// with load. Call once after gladLoadGL. Without binary support every load
+// compiles as before.
+void initializeProgramCache(GLADloadfunc load, const std::string &directory);
+
+// True if the driver compiles in the background, so programs started
+// together build in parallel
+bool hasParallelShaderCompile();
+
+// Identifies a program: a hash of the expanded sources, which includes any
+// #defines they start with, and of the driver's vendor, renderer and version
+// strings, so a driver update never gets old binaries
+uint64_t getProgramKey(const std::string &vertexCode, const std::string &fragmentCode);
+
+// Asks the driver to keep the binary of a program about to be linked
+void prepareProgramBinary(GLuint programID);
+
+// Returns a program made from the stored binary for key, or 0 if there is
+// none or the driver rejected it, in which case the file is removed
+GLuint loadProgramBinary(uint64_t key);
+
+// True if loadProgramBinary may succeed without compiling
+bool hasProgramBinary(uint64_t key);
+
+// Keeps the binary of a freshly linked program and counts the compile
+void storeProgramBinary(uint64_t key, GLuint programID);
+
+ProgramCacheStats &getProgramCacheStats();
+
+void printProgramCacheStats();
+
+#endif
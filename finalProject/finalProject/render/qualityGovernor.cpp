@@ -0,0 +1,154 @@
+#include "qualityGovernor.h"
+
+#include <algorithm>
+#include <iostream>
+
+// Frames over the target before stepping down, and well under it before
+// stepping up. Raising waits much longer so the governor does not oscillate.
+static const int overHoldFrames = 15;
+static const int underHoldFrames = 90;
+static const int cooldownFrames = 30;
+static const double headroom = 0.75;    // Raise only when both times are under this share of the target
+
+static const float renderScales[QUALITY_LEVELS] = { 1.0f, 0.85f, 0.7f, 0.5f };
+static const float shadowScales[QUALITY_LEVELS] = { 1.0f, 0.75f, 0.5f, 0.25f };
+static const float drawDistances[QUALITY_LEVELS] = { 0.0f, 2500.0f, 1800.0f, 1200.0f };  // 0 is the full distance
+static const float animationNear[QUALITY_LEVELS] = { 1e30f, 600.0f, 300.0f, 150.0f };
+static const float animationFar[QUALITY_LEVELS] = { 1e30f, 1500.0f, 800.0f, 400.0f };
+
+// Knobs to lower, in order, for each bottleneck
+static const int gpuKnobs[] = { QUALITY_SHADOW_RESOLUTION, QUALITY_RENDER_SCALE, QUALITY_DRAW_DISTANCE };
+static const int cpuKnobs[] = { QUALITY_ANIMATION_LOD, QUALITY_DRAW_DISTANCE };
+
+const char *qualityKnobName(int knob)
+{
+	switch (knob) {
+	case QUALITY_RENDER_SCALE: return "render scale";
+	case QUALITY_SHADOW_RESOLUTION: return "shadow resolution";
+	case QUALITY_DRAW_DISTANCE: return "draw distance";
+	case QUALITY_ANIMATION_LOD: return "animation LOD";
+	}
+	return "unknown";
+}
+
+void QualityGovernor::initialize(double targetMs, int shadowResolution, float drawDistance, const std::string &logPath)
+{
+	this->targetMs = targetMs;
+	enabled = targetMs > 0.0;
+	cpuMs = 0.0;
+	gpuMs = 0.0;
+	fullShadowResolution = shadowResolution;
+	fullDrawDistance = drawDistance;
+	frame = 0;
+	overFrames = 0;
+	underFrames = 0;
+	cooldown = cooldownFrames;
+	atMinimum = false;
+	lowered.clear();
+	for (int i = 0; i < QUALITY_KNOB_COUNT; ++i) levels[i] = 0;
+	applyLevels();
+
+	log = NULL;
+	if (!logPath.empty()) {
+		log = fopen(logPath.c_str(), "w");
+		if (!log) {
+			std::cerr << "Failed to open " << logPath << std::endl;
+		} else {
+			fprintf(log, "frame,cpu_ms,gpu_ms,target_ms,decision,knob,level,render_scale,shadow_resolution,"
+			             "draw_distance,animation_near,animation_far\n");
+		}
+	}
+}
+
+void QualityGovernor::applyLevels()
+{
+	settings.renderScale = renderScales[levels[QUALITY_RENDER_SCALE]];
+	settings.shadowResolution = (int)(fullShadowResolution * shadowScales[levels[QUALITY_SHADOW_RESOLUTION]]);
+	settings.drawDistance = levels[QUALITY_DRAW_DISTANCE] == 0 ? fullDrawDistance :
+	                        std::min(fullDrawDistance, drawDistances[levels[QUALITY_DRAW_DISTANCE]]);
+	settings.animationNear = animationNear[levels[QUALITY_ANIMATION_LOD]];
+	settings.animationFar = animationFar[levels[QUALITY_ANIMATION_LOD]];
+}
+
+void QualityGovernor::step(int knob, int delta, const char *reason)
+{
+	levels[knob] += delta;
+	applyLevels();
+	overFrames = 0;
+	underFrames = 0;
+	cooldown = cooldownFrames;
+
+	std::cout << "Quality: " << (delta > 0 ? "lowered " : "raised ") << qualityKnobName(knob) << " to level "
+	          << levels[knob] << " (" << reason << ", CPU " << cpuMs << " ms, GPU " << gpuMs << " ms, target "
+	          << targetMs << " ms)" << std::endl;
+	if (log) {
+		fprintf(log, "%d,%.3f,%.3f,%.3f,%s,%s,%d,%.2f,%d,%g,%g,%g\n", frame, cpuMs, gpuMs, targetMs,
+		        delta > 0 ? "lower" : "raise", qualityKnobName(knob), levels[knob], settings.renderScale,
+		        settings.shadowResolution, settings.drawDistance, settings.animationNear, settings.animationFar);
+		fflush(log);
+	}
+}
+
+bool QualityGovernor::update(double frameCpuMs, double frameGpuMs)
+{
+	frame++;
+	cpuMs = (cpuMs == 0.0) ? frameCpuMs : cpuMs * 0.9 + frameCpuMs * 0.1;
+	if (frameGpuMs > 0.0) gpuMs = (gpuMs == 0.0) ? frameGpuMs : gpuMs * 0.9 + frameGpuMs * 0.1;
+	if (!enabled) return false;
+	if (cooldown > 0) {
+		cooldown--;
+		return false;
+	}
+
+	double worst = std::max(cpuMs, gpuMs);
+	overFrames = worst > targetMs ? overFrames + 1 : 0;
+	underFrames = worst < targetMs * headroom ? underFrames + 1 : 0;
+
+	if (overFrames >= overHoldFrames) {
+		// The GPU span follows the CPU while the GPU keeps up, so it only
+		// exceeds the CPU time when the GPU is the bottleneck
+		bool gpuBound = gpuMs > cpuMs;
+		const int *knobs = gpuBound ? gpuKnobs : cpuKnobs;
+		int numKnobs = gpuBound ? (int)(sizeof(gpuKnobs) / sizeof(int)) : (int)(sizeof(cpuKnobs) / sizeof(int));
+		int knob = -1;
+		for (int i = 0; i < numKnobs && knob < 0; ++i) {
+			if (levels[knobs[i]] < QUALITY_LEVELS - 1) knob = knobs[i];
+		}
+		// Anything else left is still worth a try
+		for (int i = 0; i < QUALITY_KNOB_COUNT && knob < 0; ++i) {
+			if (levels[i] < QUALITY_LEVELS - 1) knob = i;
+		}
+
+		if (knob < 0) {
+			overFrames = 0;
+			if (!atMinimum) {
+				std::cout << "Quality: every knob is at its lowest level, " << worst << " ms is over the "
+				          << targetMs << " ms target" << std::endl;
+				if (log) {
+					fprintf(log, "%d,%.3f,%.3f,%.3f,minimum,,,,,,,\n", frame, cpuMs, gpuMs, targetMs);
+					fflush(log);
+				}
+				atMinimum = true;
+			}
+			return false;
+		}
+		step(knob, 1, gpuBound ? "GPU-bound" : "CPU-bound");
+		lowered.push_back(knob);
+		return true;
+	}
+
+	if (underFrames >= underHoldFrames && !lowered.empty()) {
+		int knob = lowered.back();
+		lowered.pop_back();
+		atMinimum = false;
+		step(knob, -1, "headroom");
+		return true;
+	}
+	return false;
+}
+
+void QualityGovernor::cleanup()
+{
+	if (log) fclose(log);
+	log = NULL;
+}
@@ -0,0 +1,69 @@
+#ifndef _QUALITY_GOVERNOR_H_
+#define _QUALITY_GOVERNOR_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Knobs the governor turns
+enum QualityKnob {
+    QUALITY_RENDER_SCALE = 0,       // Scene resolution relative to the window
+    QUALITY_SHADOW_RESOLUTION = 1,  // Size of the shadow cascades
+    QUALITY_DRAW_DISTANCE = 2,      // Buildings and rockets further away are not drawn
+    QUALITY_ANIMATION_LOD = 3,      // Distances at which bots animate less often
+    QUALITY_KNOB_COUNT = 4
+};
+
+// Levels of every knob, 0 is full quality
+#define QUALITY_LEVELS 4
+
+const char *qualityKnobName(int knob);
+
+// The settings of one frame. They travel with the frame input, so the
+// simulation and the render stage of a frame always agree on them.
+struct QualitySettings {
+    float renderScale;
+    int shadowResolution;
+    float drawDistance;
+    float animationNear;    // Bots beyond this distance are posed at 15 Hz
+    float animationFar;     // and beyond this one hold their pose
+};
+
+// Holds a frame time target by stepping the knobs down one level at a time
+// while the smoothed CPU or GPU frame time is over it, and back up once both
+// have been well under it for a while. GPU-bound frames lower the shadow
+// resolution and render scale first, CPU-bound frames the animation and draw
+// distances. Raising undoes the most recent step first. Every decision is
+// written to the log.
+struct QualityGovernor {
+    bool enabled;
+    double targetMs;
+    double cpuMs;           // Smoothed main thread time of a frame, without the swap
+    double gpuMs;           // Smoothed GPU time of a frame
+    int levels[QUALITY_KNOB_COUNT];
+    QualitySettings settings;
+
+    // Full quality uses the given shadow resolution and draw distance
+    void initialize(double targetMs, int shadowResolution, float drawDistance, const std::string &logPath);
+
+    // Feeds the times of a finished frame. Returns true if the settings changed.
+    bool update(double frameCpuMs, double frameGpuMs);
+
+    void cleanup();
+
+private:
+    int fullShadowResolution;
+    float fullDrawDistance;
+    int frame;
+    int overFrames;         // Consecutive frames over the target
+    int underFrames;        // Consecutive frames well under it
+    int cooldown;           // Frames left before the next step, while the averages settle
+    bool atMinimum;
+    std::vector<int> lowered;   // Knobs in the order they were stepped down
+    FILE *log;
+
+    void step(int knob, int delta, const char *reason);
+    void applyLevels();
+};
+
+#endif
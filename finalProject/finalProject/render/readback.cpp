@@ -0,0 +1,221 @@
+#include "readback.h"
+
+#include <stb/stb_image_write.h>
+
+#include <cstring>
+#include <iostream>
+
+void AsyncReadback::initialize(int numWorkers)
+{
+	for (int i = 0; i < READBACK_RING_SIZE; ++i) {
+		glGenBuffers(1, &slots[i].buffer);
+		slots[i].capacity = 0;
+		slots[i].fence = 0;
+		slots[i].busy = false;
+	}
+	next = 0;
+	requests = 0;
+	stalls = 0;
+
+	runningJobs = 0;
+	stopping = false;
+	for (int i = 0; i < numWorkers; ++i) {
+		workers.push_back(std::thread(&AsyncReadback::workerLoop, this));
+	}
+}
+
+void AsyncReadback::request(GLuint fbo, ReadbackFormat format, int width, int height, ReadbackCallback callback)
+{
+	Slot &slot = slots[next];
+	if (slot.busy) {
+		// The ring is full, the oldest transfer has to finish first
+		complete(slot, true);
+		stalls++;
+	}
+
+	GLsizeiptr size = (GLsizeiptr)width * height * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	if (slot.capacity < size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		slot.capacity = size;
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	if (format == READBACK_COLOR) {
+		glReadBuffer(fbo == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+	} else {
+		glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, (void*)0);
+	}
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.busy = true;
+	slot.image.width = width;
+	slot.image.height = height;
+	slot.image.format = format;
+	slot.callback = callback;
+
+	next = (next + 1) % READBACK_RING_SIZE;
+	requests++;
+}
+
+void AsyncReadback::complete(Slot &slot, bool wait)
+{
+	if (!slot.busy) return;
+
+	GLenum status = glClientWaitSync(slot.fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		if (!wait) return;
+		do {
+			status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		} while (status == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+	slot.busy = false;
+
+	ReadbackImage image;
+	image.width = slot.image.width;
+	image.height = slot.image.height;
+	image.format = slot.image.format;
+	image.pixels.resize((size_t)image.width * image.height * 4);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, image.pixels.size(), GL_MAP_READ_BIT);
+	if (data != NULL) {
+		memcpy(image.pixels.data(), data, image.pixels.size());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	} else {
+		std::cerr << "Failed to map readback buffer." << std::endl;
+		std::vector<unsigned char>().swap(image.pixels);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	ReadbackCallback callback;
+	callback.swap(slot.callback);
+	// Failed transfers are handed over too, the requester may be counting on them
+	if (callback) {
+		callback(image);
+	}
+}
+
+void AsyncReadback::update()
+{
+	// Walk from the oldest transfer and stop at the first unfinished one, so
+	// callbacks always run in request order
+	for (int i = 0; i < READBACK_RING_SIZE; ++i) {
+		Slot &slot = slots[(next + i) % READBACK_RING_SIZE];
+		if (!slot.busy) continue;
+		complete(slot, false);
+		if (slot.busy) break;
+	}
+}
+
+void AsyncReadback::savePNG(GLuint fbo, ReadbackFormat format, int width, int height, const std::string &filename)
+{
+	request(fbo, format, width, height, [this, filename](ReadbackImage &image) {
+		if (image.pixels.empty()) {
+			std::cerr << "Failed to save " << filename << std::endl;
+			return;
+		}
+
+		// Move the pixels into the job, conversion and compression happen off the render thread
+		std::shared_ptr<ReadbackImage> pending = std::make_shared<ReadbackImage>();
+		pending->width = image.width;
+		pending->height = image.height;
+		pending->format = image.format;
+		pending->pixels.swap(image.pixels);
+
+		enqueue([pending, filename]() {
+			int width = pending->width;
+			int height = pending->height;
+			int channels = 3;
+
+			// Flip to top row first while dropping alpha or expanding depth to grey
+			std::vector<unsigned char> img((size_t)width * height * channels);
+			for (int y = 0; y < height; ++y) {
+				const unsigned char *src = &pending->pixels[(size_t)(height - 1 - y) * width * 4];
+				unsigned char *dst = &img[(size_t)y * width * channels];
+				for (int x = 0; x < width; ++x) {
+					if (pending->format == READBACK_DEPTH) {
+						float depth;
+						memcpy(&depth, src + 4 * x, sizeof(float));
+						dst[3 * x] = dst[3 * x + 1] = dst[3 * x + 2] = (unsigned char)(depth * 255);
+					} else {
+						dst[3 * x] = src[4 * x];
+						dst[3 * x + 1] = src[4 * x + 1];
+						dst[3 * x + 2] = src[4 * x + 2];
+					}
+				}
+			}
+
+			if (stbi_write_png(filename.c_str(), width, height, channels, img.data(), width * channels)) {
+				std::cout << "Saved " << filename << std::endl;
+			} else {
+				std::cerr << "Failed to write " << filename << std::endl;
+			}
+		});
+	});
+}
+
+void AsyncReadback::enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(job);
+	}
+	condition.notify_one();
+}
+
+void AsyncReadback::workerLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		condition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+		if (jobs.empty()) break;
+
+		std::function<void()> job = jobs.front();
+		jobs.pop_front();
+		runningJobs++;
+
+		lock.unlock();
+		job();
+		lock.lock();
+
+		runningJobs--;
+		if (jobs.empty() && runningJobs == 0) {
+			idle.notify_all();
+		}
+	}
+}
+
+void AsyncReadback::flush()
+{
+	for (int i = 0; i < READBACK_RING_SIZE; ++i) {
+		complete(slots[(next + i) % READBACK_RING_SIZE], true);
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [this]() { return jobs.empty() && runningJobs == 0; });
+}
+
+void AsyncReadback::cleanup()
+{
+	flush();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+
+	for (int i = 0; i < READBACK_RING_SIZE; ++i) {
+		glDeleteBuffers(1, &slots[i].buffer);
+	}
+}
@@ -0,0 +1,87 @@
+#ifndef _READBACK_H_
+#define _READBACK_H_
+
+#include <glad/gl.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define READBACK_RING_SIZE 3
+
+enum ReadbackFormat {
+    READBACK_COLOR = 0,     // RGBA8, 4 bytes per pixel
+    READBACK_DEPTH = 1      // 32-bit float depth, 4 bytes per pixel
+};
+
+// Pixels of a finished transfer, bottom row first as returned by glReadPixels.
+// No pixels when the transfer failed.
+struct ReadbackImage {
+    int width;
+    int height;
+    ReadbackFormat format;
+    std::vector<unsigned char> pixels;
+};
+
+typedef std::function<void(ReadbackImage &image)> ReadbackCallback;
+
+// Asynchronous framebuffer readback. glReadPixels writes into a ring of pixel
+// pack buffers and a fence marks the end of each transfer. Finished transfers
+// are mapped a frame or two later, so the CPU does not wait for the GPU. Image
+// encoding then runs on a pool of worker threads.
+struct AsyncReadback {
+    struct Slot {
+        GLuint buffer;
+        GLsizeiptr capacity;
+        GLsync fence;
+        bool busy;
+        ReadbackImage image;        // Size and format of the pending transfer
+        ReadbackCallback callback;
+    };
+
+    Slot slots[READBACK_RING_SIZE];
+    int next;               // Oldest slot, also the next one to be reused
+    int requests;           // Statistics
+    int stalls;             // Requests that had to wait because the ring was full
+
+    // Starts copying a framebuffer into the next pixel buffer and returns at
+    // once. The callback runs on the render thread inside update() once the
+    // pixels are available, or with no pixels if they could not be read.
+    // Transfers complete in the order they were requested.
+    void request(GLuint fbo, ReadbackFormat format, int width, int height, ReadbackCallback callback);
+
+    // Reads a framebuffer and writes it to a PNG on a worker thread. Depth
+    // is stored as grey levels.
+    void savePNG(GLuint fbo, ReadbackFormat format, int width, int height, const std::string &filename);
+
+    // Hands finished transfers to their callbacks, call once per frame
+    void update();
+
+    // Runs a job on one of the worker threads
+    void enqueue(std::function<void()> job);
+
+    // Waits for every pending transfer and worker job
+    void flush();
+
+    void initialize(int numWorkers = 1);
+    void cleanup();
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::condition_variable idle;
+    std::deque<std::function<void()> > jobs;
+    int runningJobs;
+    bool stopping;
+
+    void complete(Slot &slot, bool wait);
+    void workerLoop();
+};
+
+#endif
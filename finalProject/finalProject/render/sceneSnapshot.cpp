@@ -0,0 +1,151 @@
+#include "sceneSnapshot.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+static const char snapshotMagic[8] = { 'F', 'P', 'S', 'C', 'E', 'N', 'E', '\0' };
+
+static size_t alignUp(size_t offset)
+{
+	return (offset + 15) & ~(size_t)15;
+}
+
+// Byte sizes of the arrays, in file order
+static void getArraySizes(uint32_t numBuildings, uint32_t numRockets, uint32_t numBots, uint32_t numLights,
+                          size_t sizes[8])
+{
+	sizes[0] = numBuildings * sizeof(glm::vec3);
+	sizes[1] = numBuildings * sizeof(glm::vec3);
+	sizes[2] = numBuildings * sizeof(uint32_t);
+	sizes[3] = numRockets * sizeof(glm::vec3);
+	sizes[4] = numRockets * sizeof(glm::vec3);
+	sizes[5] = numRockets * sizeof(uint32_t);
+	sizes[6] = numBots * sizeof(glm::vec3);
+	sizes[7] = numLights * sizeof(PointLight);
+}
+
+static uint64_t checksum(const unsigned char *data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool SceneSnapshotData::write(const std::string &path, uint32_t seed) const
+{
+	SceneSnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+	header.version = SCENE_SNAPSHOT_VERSION;
+	header.headerSize = sizeof(SceneSnapshotHeader);
+	header.seed = seed;
+	header.numBuildings = (uint32_t)buildingPositions.size();
+	header.numRockets = (uint32_t)rocketPositions.size();
+	header.numBots = (uint32_t)botPositions.size();
+	header.numLights = (uint32_t)lights.size();
+
+	size_t sizes[8];
+	getArraySizes(header.numBuildings, header.numRockets, header.numBots, header.numLights, sizes);
+	const void *arrays[8] = {
+		buildingPositions.data(), buildingScales.data(), buildingTextures.data(),
+		rocketPositions.data(), rocketScales.data(), rocketTextures.data(),
+		botPositions.data(), lights.data(),
+	};
+
+	// Lay the arrays out in memory first, the checksum covers the padding too
+	std::vector<unsigned char> payload;
+	for (int i = 0; i < 8; ++i) {
+		size_t offset = alignUp(payload.size());
+		payload.resize(offset + sizes[i], 0);
+		if (sizes[i] > 0) memcpy(&payload[offset], arrays[i], sizes[i]);
+	}
+	payload.resize(alignUp(payload.size()), 0);
+	header.payloadSize = payload.size();
+	header.checksum = checksum(payload.data(), payload.size());
+
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file) {
+		std::cerr << "Failed to write " << path << std::endl;
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+	          (payload.empty() || fwrite(payload.data(), 1, payload.size(), file) == payload.size());
+	ok = fclose(file) == 0 && ok;
+	if (!ok) {
+		std::cerr << "Failed to write " << path << std::endl;
+	}
+	return ok;
+}
+
+SceneSnapshot::SceneSnapshot() : header(NULL)
+{
+}
+
+SceneSnapshot::~SceneSnapshot()
+{
+	close();
+}
+
+bool SceneSnapshot::open(const std::string &path)
+{
+	close();
+	if (!file.open(path)) {
+		return false;
+	}
+
+	const unsigned char *bytes = file.data;
+	size_t size = file.size;
+	const SceneSnapshotHeader *candidate = (const SceneSnapshotHeader *)bytes;
+	if (size < sizeof(SceneSnapshotHeader) || memcmp(candidate->magic, snapshotMagic, sizeof(snapshotMagic)) != 0) {
+		std::cerr << path << " is not a scene snapshot." << std::endl;
+		close();
+		return false;
+	}
+	if (candidate->version != SCENE_SNAPSHOT_VERSION || candidate->headerSize != sizeof(SceneSnapshotHeader)) {
+		std::cerr << path << " is a version " << candidate->version << " snapshot, version "
+		          << SCENE_SNAPSHOT_VERSION << " is supported." << std::endl;
+		close();
+		return false;
+	}
+
+	size_t sizes[8];
+	getArraySizes(candidate->numBuildings, candidate->numRockets, candidate->numBots, candidate->numLights, sizes);
+	size_t offsets[8];
+	size_t end = 0;
+	for (int i = 0; i < 8; ++i) {
+		offsets[i] = alignUp(end);
+		end = offsets[i] + sizes[i];
+	}
+	if (alignUp(end) != candidate->payloadSize || size != candidate->headerSize + candidate->payloadSize) {
+		std::cerr << path << " is truncated or has inconsistent counts." << std::endl;
+		close();
+		return false;
+	}
+	const unsigned char *payload = bytes + candidate->headerSize;
+	if (checksum(payload, (size_t)candidate->payloadSize) != candidate->checksum) {
+		std::cerr << path << " failed its checksum." << std::endl;
+		close();
+		return false;
+	}
+
+	header = candidate;
+	buildingPositions = (const glm::vec3 *)(payload + offsets[0]);
+	buildingScales = (const glm::vec3 *)(payload + offsets[1]);
+	buildingTextures = (const uint32_t *)(payload + offsets[2]);
+	rocketPositions = (const glm::vec3 *)(payload + offsets[3]);
+	rocketScales = (const glm::vec3 *)(payload + offsets[4]);
+	rocketTextures = (const uint32_t *)(payload + offsets[5]);
+	botPositions = (const glm::vec3 *)(payload + offsets[6]);
+	lights = (const PointLight *)(payload + offsets[7]);
+	return true;
+}
+
+void SceneSnapshot::close()
+{
+	file.close();
+	header = NULL;
+}
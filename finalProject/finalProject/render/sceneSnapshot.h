@@ -0,0 +1,77 @@
+#ifndef _SCENE_SNAPSHOT_H_
+#define _SCENE_SNAPSHOT_H_
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "deferred.h"
+#include "mappedFile.h"
+
+// Binary snapshot of a generated city, for --save-scene and --load-scene.
+// A header is followed by one array per attribute (structure of arrays), each
+// starting on a 16-byte boundary, in this order:
+//   building positions (vec3), building scales (vec3), building texture indices (uint32),
+//   rocket positions (vec3), rocket scales (vec3), rocket texture indices (uint32),
+//   bot positions (vec3), point lights (PointLight)
+// Every array has the layout of a per-instance vertex stream, and the lights
+// that of the deferred renderer's instance buffer, so the file is mapped and
+// the arrays used in place. Little-endian, as written by the machine.
+#define SCENE_SNAPSHOT_VERSION 1
+
+struct SceneSnapshotHeader {
+    char magic[8];              // "FPSCENE"
+    uint32_t version;
+    uint32_t headerSize;        // The arrays start here
+    uint32_t seed;              // Layout seed the city was generated from
+    uint32_t numBuildings;
+    uint32_t numRockets;
+    uint32_t numBots;
+    uint32_t numLights;
+    uint32_t padding;
+    uint64_t payloadSize;       // Bytes after the header
+    uint64_t checksum;          // 64-bit FNV-1a of those bytes
+};
+
+// A city to write
+struct SceneSnapshotData {
+    std::vector<glm::vec3> buildingPositions;
+    std::vector<glm::vec3> buildingScales;
+    std::vector<uint32_t> buildingTextures;     // Indices into the building texture list
+    std::vector<glm::vec3> rocketPositions;
+    std::vector<glm::vec3> rocketScales;
+    std::vector<uint32_t> rocketTextures;
+    std::vector<glm::vec3> botPositions;
+    std::vector<PointLight> lights;
+
+    bool write(const std::string &path, uint32_t seed) const;
+};
+
+// A snapshot file mapped into memory. The pointers stay valid until close().
+struct SceneSnapshot {
+    const SceneSnapshotHeader *header;
+    const glm::vec3 *buildingPositions;
+    const glm::vec3 *buildingScales;
+    const uint32_t *buildingTextures;
+    const glm::vec3 *rocketPositions;
+    const glm::vec3 *rocketScales;
+    const uint32_t *rocketTextures;
+    const glm::vec3 *botPositions;
+    const PointLight *lights;
+
+    SceneSnapshot();
+    ~SceneSnapshot();
+
+    // Maps the file and checks its header, sizes and checksum
+    bool open(const std::string &path);
+    void close();
+
+private:
+    MappedFile file;
+
+    SceneSnapshot(const SceneSnapshot &);
+    SceneSnapshot &operator=(const SceneSnapshot &);
+};
+
+#endif
@@ -1,195 +1,232 @@
 #include "shader.h"
+#include "uniformBuffers.h"
+#include "programCache.h"
 
 #include <string> 
 #include <iostream> 
 #include <fstream>
 #include <sstream> 
 #include <vector>
+#include <chrono>
+#include <unordered_map>
 
-GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path)
+// Reads a shader file and expands #include "file" lines, relative to the including file
+static bool ReadShaderFile(const std::string &path, std::string &code, int depth = 0)
 {
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if (VertexShaderStream.is_open())
-	{
-		std::stringstream sstr;
-		sstr << VertexShaderStream.rdbuf();
-		VertexShaderCode = sstr.str();
-		VertexShaderStream.close();
-	}
-	else
+	std::ifstream stream(path, std::ios::in);
+	if (!stream.is_open() || depth > 8)
 	{
-		printf("Vertex shader not found %s.\n", vertex_file_path);
-		return 0;
+		return false;
 	}
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if (FragmentShaderStream.is_open())
+	std::string directory;
+	size_t slash = path.find_last_of("/\\");
+	if (slash != std::string::npos)
 	{
-		std::stringstream sstr;
-		sstr << FragmentShaderStream.rdbuf();
-		FragmentShaderCode = sstr.str();
-		FragmentShaderStream.close();
+		directory = path.substr(0, slash + 1);
 	}
-	else
+
+	std::string line;
+	while (std::getline(stream, line))
 	{
-		printf("Fragment shader not found %s.\n", fragment_file_path);
-		return 0;
+		size_t include = line.find("#include");
+		size_t open = line.find('"');
+		size_t close = line.rfind('"');
+		if (include != std::string::npos && line.find_first_not_of(" \t") == include &&
+			open != std::string::npos && close > open)
+		{
+			std::string includePath = directory + line.substr(open + 1, close - open - 1);
+			if (!ReadShaderFile(includePath, code, depth + 1))
+			{
+				printf("Shader include not found %s.\n", includePath.c_str());
+				return false;
+			}
+			continue;
+		}
+		code += line;
+		code += '\n';
 	}
+	return true;
+}
 
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
-
-	// Compile Vertex Shader
-	printf("Compiling vertex shader : %s\n", vertex_file_path);
+// A program handed to the driver. Nothing is queried until FinishProgram, so
+// with KHR_parallel_shader_compile the driver builds it in the background.
+struct ProgramBuild
+{
+	GLuint VertexShaderID;
+	GLuint FragmentShaderID;
+	GLuint ProgramID;
+	std::string VertexName;
+	std::string FragmentName;
+};
+
+// Programs started by PrecompileShaders, by program key
+static std::unordered_map<uint64_t, ProgramBuild> PendingPrograms;
+
+static void BeginProgram(const std::string &VertexShaderCode, const std::string &FragmentShaderCode,
+	ProgramBuild &Build)
+{
+	// Compile the shaders
+	Build.VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
 	char const *VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
-	glCompileShader(VertexShaderID);
+	glShaderSource(Build.VertexShaderID, 1, &VertexSourcePointer, NULL);
+	glCompileShader(Build.VertexShaderID);
+
+	Build.FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+	char const *FragmentSourcePointer = FragmentShaderCode.c_str();
+	glShaderSource(Build.FragmentShaderID, 1, &FragmentSourcePointer, NULL);
+	glCompileShader(Build.FragmentShaderID);
 
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
+	// Link the program
+	Build.ProgramID = glCreateProgram();
+	prepareProgramBinary(Build.ProgramID);
+	glAttachShader(Build.ProgramID, Build.VertexShaderID);
+	glAttachShader(Build.ProgramID, Build.FragmentShaderID);
+	glLinkProgram(Build.ProgramID);
+}
+
+static bool CheckShader(GLuint ShaderID, const char *Kind, const std::string &Name)
+{
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+	glGetShaderiv(ShaderID, GL_COMPILE_STATUS, &Result);
 	if (!Result) {
-		printf("Error compiling vertex shader : %s\n", vertex_file_path);
-		glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		printf("Error compiling %s shader : %s\n", Kind, Name.c_str());
+		glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
 		if (InfoLogLength > 0) {
-			std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-			glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-			printf("%s\n", &VertexShaderErrorMessage[0]);
+			std::vector<char> ShaderErrorMessage(InfoLogLength + 1);
+			glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+			printf("%s\n", &ShaderErrorMessage[0]);
 		}
-		return 0;
+		return false;
 	}
+	return true;
+}
 
-	// Compile Fragment Shader
-	printf("Compiling fragment shader : %s\n", fragment_file_path);
-	char const *FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
-	glCompileShader(FragmentShaderID);
+// Waits for the driver, reports errors and keeps the binary of the program
+static GLuint FinishProgram(ProgramBuild &Build, uint64_t Key)
+{
+	bool Compiled = CheckShader(Build.VertexShaderID, "vertex", Build.VertexName);
+	Compiled = CheckShader(Build.FragmentShaderID, "fragment", Build.FragmentName) && Compiled;
 
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	if (!Result) {
-		printf("Error compiling fragment shader : %s\n", fragment_file_path);
-		glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-		if (InfoLogLength > 0)
-		{
-			std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-			glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-			printf("%s\n", &FragmentShaderErrorMessage[0]);
+	// Check the program
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+	if (Compiled) {
+		glGetProgramiv(Build.ProgramID, GL_LINK_STATUS, &Result);
+		if (!Result) {
+			printf("Error linking program : %s + %s\n", Build.VertexName.c_str(), Build.FragmentName.c_str());
+			glGetProgramiv(Build.ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+			if (InfoLogLength > 0)
+			{
+				std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
+				glGetProgramInfoLog(Build.ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+				printf("%s\n", &ProgramErrorMessage[0]);
+			}
 		}
-		return 0;
 	}
 
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
+	glDetachShader(Build.ProgramID, Build.VertexShaderID);
+	glDetachShader(Build.ProgramID, Build.FragmentShaderID);
+
+	glDeleteShader(Build.VertexShaderID);
+	glDeleteShader(Build.FragmentShaderID);
 
-	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
 	if (!Result) {
-		printf("Error linking program\n");
-		glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-		if (InfoLogLength > 0)
-		{
-			std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-			glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-			printf("%s\n", &ProgramErrorMessage[0]);
-		}
+		glDeleteProgram(Build.ProgramID);
 		return 0;
 	}
 
-	glDetachShader(ProgramID, VertexShaderID);
-	glDetachShader(ProgramID, FragmentShaderID);
-
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
-
-	return ProgramID;
+	storeProgramBinary(Key, Build.ProgramID);
+	return Build.ProgramID;
 }
 
-GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode)
+// Takes the program from a precompile or the binary cache, or builds it
+static GLuint LoadProgram(const std::string &VertexShaderCode, const std::string &FragmentShaderCode,
+	const std::string &VertexName, const std::string &FragmentName)
 {
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+	std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+	uint64_t Key = getProgramKey(VertexShaderCode, FragmentShaderCode);
+
+	GLuint ProgramID = 0;
+	auto Pending = PendingPrograms.find(Key);
+	if (Pending != PendingPrograms.end()) {
+		ProgramBuild Build = Pending->second;
+		PendingPrograms.erase(Pending);
+		ProgramID = FinishProgram(Build, Key);
+	} else {
+		ProgramID = loadProgramBinary(Key);
+		if (ProgramID == 0) {
+			printf("Compiling program : %s + %s\n", VertexName.c_str(), FragmentName.c_str());
+			ProgramBuild Build;
+			Build.VertexName = VertexName;
+			Build.FragmentName = FragmentName;
+			BeginProgram(VertexShaderCode, FragmentShaderCode, Build);
+			ProgramID = FinishProgram(Build, Key);
+		}
+	}
 
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
+	// Connect the shared uniform blocks to their fixed binding points. Loaded
+	// binaries start with default uniform state, so this is always done here.
+	if (ProgramID != 0) {
+		bindUniformBlocks(ProgramID);
+	}
 
-	// Compile Vertex Shader
-	printf("Compiling vertex shader\n");
-	char const *VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
-	glCompileShader(VertexShaderID);
+	getProgramCacheStats().ms += std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - Start).count();
+	return ProgramID;
+}
 
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	if (!Result) {
-		printf("Error compiling vertex shader\n");
-		glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-		if (InfoLogLength > 0) {
-			std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-			glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-			printf("%s\n", &VertexShaderErrorMessage[0]);
-		}
+GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path)
+{
+	// Read the Vertex Shader code from the file
+	std::string VertexShaderCode;
+	if (!ReadShaderFile(vertex_file_path, VertexShaderCode))
+	{
+		printf("Vertex shader not found %s.\n", vertex_file_path);
 		return 0;
 	}
 
-	// Compile Fragment Shader
-	printf("Compiling fragment shader\n");
-	char const *FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
-	glCompileShader(FragmentShaderID);
-
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	if (!Result) {
-		printf("Error compiling fragment shader\n");
-		glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-		if (InfoLogLength > 0)
-		{
-			std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-			glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-			printf("%s\n", &FragmentShaderErrorMessage[0]);
-		}
+	// Read the Fragment Shader code from the file
+	std::string FragmentShaderCode;
+	if (!ReadShaderFile(fragment_file_path, FragmentShaderCode))
+	{
+		printf("Fragment shader not found %s.\n", fragment_file_path);
 		return 0;
 	}
 
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
+	return LoadProgram(VertexShaderCode, FragmentShaderCode, vertex_file_path, fragment_file_path);
+}
 
-	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	if (!Result) {
-		printf("Error linking program\n");
-		glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-		if (InfoLogLength > 0)
+GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode)
+{
+	return LoadProgram(VertexShaderCode, FragmentShaderCode, "(string)", "(string)");
+}
+
+void PrecompileShaders(const std::vector<ShaderFiles> &Programs)
+{
+	std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+	for (const ShaderFiles &Files : Programs)
+	{
+		std::string VertexShaderCode, FragmentShaderCode;
+		if (!ReadShaderFile(Files.vertex, VertexShaderCode) || !ReadShaderFile(Files.fragment, FragmentShaderCode))
 		{
-			std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-			glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-			printf("%s\n", &ProgramErrorMessage[0]);
+			// Reported by the LoadShadersFromFile call that needs it
+			continue;
 		}
-		return 0;
-	}
 
-	glDetachShader(ProgramID, VertexShaderID);
-	glDetachShader(ProgramID, FragmentShaderID);
-
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
+		uint64_t Key = getProgramKey(VertexShaderCode, FragmentShaderCode);
+		if (PendingPrograms.count(Key) || hasProgramBinary(Key))
+		{
+			continue;
+		}
 
-	return ProgramID;
+		printf("Compiling program : %s + %s\n", Files.vertex, Files.fragment);
+		ProgramBuild &Build = PendingPrograms[Key];
+		Build.VertexName = Files.vertex;
+		Build.FragmentName = Files.fragment;
+		BeginProgram(VertexShaderCode, FragmentShaderCode, Build);
+	}
+	getProgramCacheStats().ms += std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - Start).count();
 }
@@ -3,9 +3,22 @@
 
 #include <glad/gl.h>
 #include <string>
+#include <vector>
 
+// Both loaders take the program from the binary cache (programCache.h) when
+// they can, and only compile when they must
 GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path);
 
 GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode);
 
+struct ShaderFiles {
+    const char *vertex;
+    const char *fragment;
+};
+
+// Starts compiling the programs that are not cached, all before waiting on
+// any, so a driver with KHR_parallel_shader_compile builds them at once. The
+// later LoadShadersFromFile calls for the same files pick them up.
+void PrecompileShaders(const std::vector<ShaderFiles> &Programs);
+
 #endif
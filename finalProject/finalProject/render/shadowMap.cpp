@@ -0,0 +1,346 @@
+#include "shadowMap.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+const char *shadowFilterName(int filter)
+{
+	switch (filter) {
+	case SHADOW_FILTER_PCF2X2: return "PCF 2x2";
+	case SHADOW_FILTER_POISSON: return "Poisson PCF";
+	case SHADOW_FILTER_PCSS: return "PCSS";
+	}
+	return "Unknown";
+}
+
+void setShadowSamplers(GLuint programID, int textureUnit, int depthTextureUnit)
+{
+	glUniform1i(glGetUniformLocation(programID, "shadowMap"), textureUnit);
+	glUniform1i(glGetUniformLocation(programID, "shadowDepthMap"), depthTextureUnit);
+}
+
+static GLuint createDepthArray(int resolution, int layers)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, layers,
+	             0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+	return texture;
+}
+
+static GLuint createDepthFramebuffer(GLuint depthArray)
+{
+	GLuint framebuffer;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Shadow map framebuffer is not complete." << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return framebuffer;
+}
+
+void CascadedShadowMap::initialize(int numCascades, int resolution, float shadowDistance)
+{
+	this->numCascades = std::min(std::max(numCascades, 1), MAX_SHADOW_CASCADES);
+	this->resolution = resolution;
+	this->shadowDistance = shadowDistance;
+	splitLambda = 0.75f;
+	casterMargin = 2000.0f;
+
+	// One depth layer per cascade, for the final and for the static-only shadows
+	depthTextureArray = createDepthArray(resolution, this->numCascades);
+	staticDepthTextureArray = createDepthArray(resolution, this->numCascades);
+	fbo = createDepthFramebuffer(depthTextureArray);
+	staticFbo = createDepthFramebuffer(staticDepthTextureArray);
+
+	for (int i = 0; i < MAX_SHADOW_CASCADES; ++i) {
+		splitDepths[i] = 0.0f;
+		cascadeRadii[i] = 0.0f;
+		lightViewMatrices[i] = glm::mat4(1.0f);
+		lightSpaceMatrices[i] = glm::mat4(1.0f);
+		staticValid[i] = false;
+		staticLightSpaceMatrices[i] = glm::mat4(1.0f);
+	}
+	direction = glm::vec3(0.0f, -1.0f, 0.0f);
+
+	filter = SHADOW_FILTER_PCF2X2;
+	lightSize = 0.02f;
+	slopeScaledBias = 1.5f;
+	constantBias = 2.0f;
+
+	// Sampler objects let the same depth array be read both ways
+	glGenSamplers(1, &compareSampler);
+	glSamplerParameteri(compareSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(compareSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(compareSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glSamplerParameteri(compareSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glSamplerParameteri(compareSampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glSamplerParameteri(compareSampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glSamplerParameterfv(compareSampler, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+	glGenSamplers(1, &depthSampler);
+	glSamplerParameteri(depthSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glSamplerParameteri(depthSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glSamplerParameteri(depthSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glSamplerParameteri(depthSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glSamplerParameterfv(depthSampler, GL_TEXTURE_BORDER_COLOR, borderColor);
+	staticLightDirection = glm::vec3(0.0f);
+	staticCasterVersion = 0;
+	cachedCasterVersion = -1;
+	staticCascadesRendered = 0;
+}
+
+// Tests a world-space box against the light-space box of one cascade
+static bool isInCascade(const glm::mat4 &lightView, float radius, float casterMargin,
+                        const glm::vec3 &boxMin, const glm::vec3 &boxMax)
+{
+	glm::vec3 lightMin(1e30f), lightMax(-1e30f);
+	for (int j = 0; j < 8; ++j) {
+		glm::vec3 corner((j & 1) ? boxMax.x : boxMin.x,
+		                 (j & 2) ? boxMax.y : boxMin.y,
+		                 (j & 4) ? boxMax.z : boxMin.z);
+		glm::vec3 p = glm::vec3(lightView * glm::vec4(corner, 1.0f));
+		lightMin = glm::min(lightMin, p);
+		lightMax = glm::max(lightMax, p);
+	}
+
+	// Casters in front of the near plane are kept, depth clamping flattens them onto it
+	float farPlane = 2.0f * radius + casterMargin;
+	return lightMax.x >= -radius && lightMin.x <= radius &&
+	       lightMax.y >= -radius && lightMin.y <= radius &&
+	       lightMax.z >= -farPlane;
+}
+
+bool ShadowCascadeFit::isVisible(int cascade, const glm::vec3 &boxMin, const glm::vec3 &boxMax) const
+{
+	return isInCascade(lightViewMatrices[cascade], cascadeRadii[cascade], casterMargin, boxMin, boxMax);
+}
+
+void CascadedShadowMap::setResolution(int resolution)
+{
+	if (resolution == this->resolution) return;
+	this->resolution = resolution;
+
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteFramebuffers(1, &staticFbo);
+	glDeleteTextures(1, &depthTextureArray);
+	glDeleteTextures(1, &staticDepthTextureArray);
+	depthTextureArray = createDepthArray(resolution, numCascades);
+	staticDepthTextureArray = createDepthArray(resolution, numCascades);
+	fbo = createDepthFramebuffer(depthTextureArray);
+	staticFbo = createDepthFramebuffer(staticDepthTextureArray);
+
+	// The cached static depth is gone with the old arrays
+	for (int i = 0; i < MAX_SHADOW_CASCADES; ++i) staticValid[i] = false;
+}
+
+void CascadedShadowMap::update(const glm::mat4 &viewMatrix, float fov, float aspect, float zNear, float zFar,
+                               const glm::vec3 &lightDirection)
+{
+	ShadowCascadeFit cascades;
+	fit(viewMatrix, fov, aspect, zNear, zFar, lightDirection, resolution, cascades);
+	apply(cascades);
+}
+
+void CascadedShadowMap::apply(const ShadowCascadeFit &cascades)
+{
+	direction = cascades.direction;
+	for (int i = 0; i < numCascades; ++i) {
+		splitDepths[i] = cascades.splitDepths[i];
+		cascadeRadii[i] = cascades.cascadeRadii[i];
+		lightViewMatrices[i] = cascades.lightViewMatrices[i];
+		lightSpaceMatrices[i] = cascades.lightSpaceMatrices[i];
+	}
+}
+
+void CascadedShadowMap::fit(const glm::mat4 &viewMatrix, float fov, float aspect, float zNear, float zFar,
+                            const glm::vec3 &lightDirection, int resolution, ShadowCascadeFit &cascades) const
+{
+	cascades.numCascades = numCascades;
+	cascades.resolution = resolution;
+	cascades.casterMargin = casterMargin;
+	cascades.direction = lightDirection;
+	float farDistance = std::min(zFar, shadowDistance);
+	glm::mat4 inverseView = glm::inverse(viewMatrix);
+	float tanHalfY = tanf(glm::radians(fov) * 0.5f);
+	float tanHalfX = tanHalfY * aspect;
+
+	// Pick an up vector that is never parallel to the light
+	glm::vec3 lightUp = fabsf(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), lightDirection, lightUp);
+	glm::mat4 inverseLightRotation = glm::inverse(lightRotation);
+
+	float sliceNear = zNear;
+	for (int i = 0; i < numCascades; ++i) {
+		// Practical split scheme: blend logarithmic and uniform distributions
+		float p = (i + 1) / (float)numCascades;
+		float logSplit = zNear * powf(farDistance / zNear, p);
+		float uniformSplit = zNear + (farDistance - zNear) * p;
+		float sliceFar = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+		cascades.splitDepths[i] = sliceFar;
+
+		// Corners of the frustum slice in world space
+		glm::vec3 corners[8];
+		glm::vec3 center(0.0f);
+		for (int j = 0; j < 8; ++j) {
+			float d = (j < 4) ? sliceNear : sliceFar;
+			float x = ((j & 1) ? 1.0f : -1.0f) * tanHalfX * d;
+			float y = ((j & 2) ? 1.0f : -1.0f) * tanHalfY * d;
+			corners[j] = glm::vec3(inverseView * glm::vec4(x, y, -d, 1.0f));
+			center += corners[j];
+		}
+		center /= 8.0f;
+
+		// A bounding sphere keeps the cascade size independent of camera rotation
+		float radius = 0.0f;
+		for (int j = 0; j < 8; ++j) {
+			radius = std::max(radius, glm::length(corners[j] - center));
+		}
+		radius = ceilf(radius * 16.0f) / 16.0f;
+
+		// Move the cascade in coarse steps of whole texels so the cached static
+		// depth stays valid while the camera moves within one step. The cascade
+		// is grown by one step so the slice is still covered after snapping.
+		float texelSize = 2.0f * radius / resolution;
+		float step = texelSize * floorf(resolution / 16.0f);
+		radius += step;
+		texelSize = 2.0f * radius / resolution;
+		step = texelSize * floorf(resolution / 16.0f);
+		glm::vec3 lightSpaceCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+		lightSpaceCenter = glm::floor(lightSpaceCenter / step + 0.5f) * step;
+		center = glm::vec3(inverseLightRotation * glm::vec4(lightSpaceCenter, 1.0f));
+		cascades.cascadeRadii[i] = radius;
+
+		glm::mat4 lightView = glm::lookAt(center - lightDirection * (radius + casterMargin), center, lightUp);
+		glm::mat4 lightProjection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + casterMargin);
+
+		// Snap the projection to whole texels so shadow edges do not shimmer as the camera moves
+		glm::mat4 shadowMatrix = lightProjection * lightView;
+		glm::vec4 origin = shadowMatrix * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		origin *= resolution * 0.5f;
+		glm::vec4 rounded = glm::floor(origin + 0.5f);
+		glm::vec4 offset = (rounded - origin) * (2.0f / resolution);
+		lightProjection[3][0] += offset.x;
+		lightProjection[3][1] += offset.y;
+
+		cascades.lightViewMatrices[i] = lightView;
+		cascades.lightSpaceMatrices[i] = lightProjection * lightView;
+
+		sliceNear = sliceFar;
+	}
+}
+
+bool CascadedShadowMap::isVisible(int cascade, const glm::vec3 &boxMin, const glm::vec3 &boxMax) const
+{
+	return isInCascade(lightViewMatrices[cascade], cascadeRadii[cascade], casterMargin, boxMin, boxMax);
+}
+
+void CascadedShadowMap::invalidateStaticCasters()
+{
+	staticCasterVersion++;
+}
+
+bool CascadedShadowMap::isStaticCacheValid(int cascade) const
+{
+	return staticValid[cascade] &&
+	       cachedCasterVersion == staticCasterVersion &&
+	       staticLightDirection == direction &&
+	       staticLightSpaceMatrices[cascade] == lightSpaceMatrices[cascade];
+}
+
+void CascadedShadowMap::beginStaticCascade(int cascade)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, staticFbo);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticDepthTextureArray, 0, cascade);
+	glViewport(0, 0, resolution, resolution);
+	glEnable(GL_DEPTH_CLAMP);
+
+	// Slope-scaled offset pushes steep surfaces back to avoid shadow acne
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(slopeScaledBias, constantBias);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void CascadedShadowMap::endStaticCascade(int cascade)
+{
+	// A new caster version or light direction invalidates every other cascade
+	if (cachedCasterVersion != staticCasterVersion || staticLightDirection != direction) {
+		for (int i = 0; i < MAX_SHADOW_CASCADES; ++i) staticValid[i] = false;
+		cachedCasterVersion = staticCasterVersion;
+		staticLightDirection = direction;
+	}
+	staticValid[cascade] = true;
+	staticLightSpaceMatrices[cascade] = lightSpaceMatrices[cascade];
+	staticCascadesRendered++;
+}
+
+void CascadedShadowMap::beginCascade(int cascade)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFbo);
+	glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticDepthTextureArray, 0, cascade);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTextureArray, 0, cascade);
+
+	// Copy the static casters, this replaces the clear
+	glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, resolution, resolution);
+	glEnable(GL_DEPTH_CLAMP);
+
+	// Slope-scaled offset pushes steep surfaces back to avoid shadow acne
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(slopeScaledBias, constantBias);
+}
+
+void CascadedShadowMap::end(int viewportWidth, int viewportHeight)
+{
+	glDisable(GL_DEPTH_CLAMP);
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, viewportWidth, viewportHeight);
+}
+
+void CascadedShadowMap::getCascadeSizes(glm::vec4 sizes[MAX_SHADOW_CASCADES]) const
+{
+	for (int i = 0; i < MAX_SHADOW_CASCADES; ++i) {
+		float worldSize = 2.0f * cascadeRadii[i];
+		sizes[i] = glm::vec4(worldSize, worldSize + casterMargin, 0.0f, 0.0f);
+	}
+}
+
+void CascadedShadowMap::bindForShading(int textureUnit, int depthTextureUnit) const
+{
+	glActiveTexture(GL_TEXTURE0 + textureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, depthTextureArray);
+	glBindSampler(textureUnit, compareSampler);
+
+	glActiveTexture(GL_TEXTURE0 + depthTextureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, depthTextureArray);
+	glBindSampler(depthTextureUnit, depthSampler);
+}
+
+void CascadedShadowMap::cleanup()
+{
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteFramebuffers(1, &staticFbo);
+	glDeleteTextures(1, &depthTextureArray);
+	glDeleteTextures(1, &staticDepthTextureArray);
+	glDeleteSamplers(1, &compareSampler);
+	glDeleteSamplers(1, &depthSampler);
+}
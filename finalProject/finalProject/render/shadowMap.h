@@ -0,0 +1,128 @@
+#ifndef _SHADOW_MAP_H_
+#define _SHADOW_MAP_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#define MAX_SHADOW_CASCADES 4
+
+// Texture units reserved for the shadow maps while shading. Both have sampler
+// objects bound to them, so other passes should not reuse these units.
+#define SHADOW_TEXTURE_UNIT 1
+#define SHADOW_DEPTH_TEXTURE_UNIT 2
+
+// Shadow filter quality tiers, cheapest first
+enum ShadowFilter {
+    SHADOW_FILTER_PCF2X2 = 0,   // One hardware-compared tap, bilinear 2x2 PCF
+    SHADOW_FILTER_POISSON = 1,  // 16 rotated Poisson taps, each a hardware 2x2 PCF
+    SHADOW_FILTER_PCSS = 2,     // Blocker search + Poisson PCF sized by the penumbra
+    SHADOW_FILTER_COUNT = 3
+};
+
+const char *shadowFilterName(int filter);
+
+// Points the shadow samplers of a shading program at the texture units
+// bindForShading() uses. The program must be in use; sampler values stay with
+// the program, so this is done once after linking.
+void setShadowSamplers(GLuint programID, int textureUnit, int depthTextureUnit);
+
+// Cascade placement for one frame, computed without touching GL so it can be
+// prepared on a simulation thread and applied on the GL thread
+struct ShadowCascadeFit {
+    int numCascades;
+    int resolution;         // Texels per side the cascades were snapped to
+    float casterMargin;
+    glm::vec3 direction;
+    float splitDepths[MAX_SHADOW_CASCADES];
+    float cascadeRadii[MAX_SHADOW_CASCADES];
+    glm::mat4 lightViewMatrices[MAX_SHADOW_CASCADES];
+    glm::mat4 lightSpaceMatrices[MAX_SHADOW_CASCADES];
+
+    // Returns true if a world-space box can cast a shadow into the given cascade
+    bool isVisible(int cascade, const glm::vec3 &boxMin, const glm::vec3 &boxMax) const;
+};
+
+// Directional-light cascaded shadow maps. Each cascade covers one slice of the
+// view frustum and is stored as one layer of a depth texture array.
+struct CascadedShadowMap {
+    int numCascades;
+    int resolution;
+    float shadowDistance;   // Shadows are only rendered up to this view distance
+    float splitLambda;      // 0 = uniform splits, 1 = logarithmic splits
+    float casterMargin;     // Extra distance towards the light to catch tall casters
+    glm::vec3 direction;    // Light direction used by the last update
+
+    // Filtering
+    int filter;             // One of ShadowFilter
+    float lightSize;        // Tangent of the angular radius of the sun, drives PCSS penumbrae
+    float slopeScaledBias;  // glPolygonOffset factor applied while rendering depth
+    float constantBias;     // glPolygonOffset units applied while rendering depth
+    GLuint compareSampler;  // Samples the depth array with GL_COMPARE_REF_TO_TEXTURE
+    GLuint depthSampler;    // Samples raw depth values
+
+    GLuint fbo;
+    GLuint depthTextureArray;
+
+    // Static casters are rendered once into a persistent copy of the cascades.
+    // Each frame that copy is blitted into depthTextureArray before the dynamic
+    // casters are drawn on top.
+    GLuint staticFbo;
+    GLuint staticDepthTextureArray;
+    bool staticValid[MAX_SHADOW_CASCADES];
+    glm::mat4 staticLightSpaceMatrices[MAX_SHADOW_CASCADES];
+    glm::vec3 staticLightDirection;
+    int staticCasterVersion;    // Bumped whenever the set of static casters changes
+    int cachedCasterVersion;
+    int staticCascadesRendered; // Number of cascade refreshes, for statistics
+
+    float splitDepths[MAX_SHADOW_CASCADES];             // Far distance of each cascade in view space
+    float cascadeRadii[MAX_SHADOW_CASCADES];            // Radius of the bounding sphere of each slice
+    glm::mat4 lightViewMatrices[MAX_SHADOW_CASCADES];
+    glm::mat4 lightSpaceMatrices[MAX_SHADOW_CASCADES];  // Projection * view of each cascade
+
+    void initialize(int numCascades, int resolution, float shadowDistance);
+
+    // Fits every cascade to its slice of the camera frustum
+    void update(const glm::mat4 &viewMatrix, float fov, float aspect, float zNear, float zFar,
+                const glm::vec3 &lightDirection);
+
+    // The two halves of update(). fit() only reads the settings above and is
+    // safe to call from another thread while this map is being rendered. It
+    // snaps to the given resolution, so a change can travel with the frame and
+    // be applied with setResolution() before apply().
+    void fit(const glm::mat4 &viewMatrix, float fov, float aspect, float zNear, float zFar,
+             const glm::vec3 &lightDirection, int resolution, ShadowCascadeFit &cascades) const;
+    void apply(const ShadowCascadeFit &cascades);
+
+    // Reallocates the cascades, which drops the cached static depth
+    void setResolution(int resolution);
+
+    // Returns true if a world-space box can cast a shadow into the given cascade
+    bool isVisible(int cascade, const glm::vec3 &boxMin, const glm::vec3 &boxMax) const;
+
+    // Marks the cached static shadows as stale, e.g. after buildings are added or removed
+    void invalidateStaticCasters();
+
+    // Returns true if the cached static depth of a cascade can be reused this frame
+    bool isStaticCacheValid(int cascade) const;
+
+    // Binds the persistent static framebuffer and clears one of its layers
+    void beginStaticCascade(int cascade);
+    void endStaticCascade(int cascade);
+
+    // Binds the framebuffer of one cascade and fills it with the cached static depth
+    void beginCascade(int cascade);
+    void end(int viewportWidth, int viewportHeight);
+
+    // World size (x) and depth range (y) of each cascade, which turn texel and
+    // depth differences into world units for the bias and the penumbra estimate.
+    // They go into the frame uniforms along with lightSpaceMatrices.
+    void getCascadeSizes(glm::vec4 sizes[MAX_SHADOW_CASCADES]) const;
+
+    // Binds the depth array to two texture units, compared and raw
+    void bindForShading(int textureUnit, int depthTextureUnit) const;
+
+    void cleanup();
+};
+
+#endif
@@ -0,0 +1,343 @@
+#include "sphericalHarmonics.h"
+#include "mappedFile.h"
+
+#include <stb/stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SH_USE_SSE
+#endif
+
+#define SH_CACHE_VERSION 3
+
+static const double shPi = 3.14159265358979323846;
+
+// Normalisation constants of the real SH basis
+static const float shY0 = 0.282095f;
+static const float shY1 = 0.488603f;
+static const float shY2 = 1.092548f;
+static const float shY20 = 0.315392f;
+static const float shY22 = 0.546274f;
+
+// Clamped cosine convolution per coefficient (Ramamoorthi and Hanrahan), divided by pi
+static const float shBandScale[9] = {
+	1.0f,
+	2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f,
+	0.25f, 0.25f, 0.25f, 0.25f, 0.25f
+};
+
+// One face of the sky box: its texel rectangle in the image and the box-space
+// frame that maps texture coordinates to directions
+struct SHFace {
+	int x0, x1, y0, y1;
+	float u0, du, v0, dv;
+	glm::vec3 origin, axisU, axisV;
+	float texelArea;
+};
+
+// Per-thread sums, coefficient k of channel c is at 3 * k + c
+struct SHSum {
+	double c[27];
+	double weight;
+};
+
+static inline void evaluateBasis(float x, float y, float z, float basis[9])
+{
+	basis[0] = shY0;
+	basis[1] = shY1 * y;
+	basis[2] = shY1 * z;
+	basis[3] = shY1 * x;
+	basis[4] = shY2 * x * y;
+	basis[5] = shY2 * y * z;
+	basis[6] = shY20 * (3.0f * z * z - 1.0f);
+	basis[7] = shY2 * x * z;
+	basis[8] = shY22 * (x * x - y * y);
+}
+
+static void projectRow(const unsigned char *pixels, int width, int height, int channels, const float *lut,
+                       const SHFace &face, int y, SHSum &sum)
+{
+	float v = (y + 0.5f) / height;
+	float t = (v - face.v0) / face.dv;
+	glm::vec3 base = face.origin + t * face.axisV;
+	const unsigned char *row = pixels + (size_t)y * width * channels;
+	int x = face.x0;
+
+#ifdef SH_USE_SSE
+	__m128 acc[27];
+	for (int k = 0; k < 27; ++k) acc[k] = _mm_setzero_ps();
+	__m128 accWeight = _mm_setzero_ps();
+
+	const __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	const __m128 invWidth = _mm_set1_ps(1.0f / width);
+	const __m128 u0 = _mm_set1_ps(face.u0);
+	const __m128 invDu = _mm_set1_ps(1.0f / face.du);
+	const __m128 area = _mm_set1_ps(face.texelArea);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 three = _mm_set1_ps(3.0f);
+
+	for (; x + 4 <= face.x1; x += 4) {
+		// Box-space position of four texel centres
+		__m128 u = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)x), lane), invWidth);
+		__m128 s = _mm_mul_ps(_mm_sub_ps(u, u0), invDu);
+		__m128 px = _mm_add_ps(_mm_set1_ps(base.x), _mm_mul_ps(s, _mm_set1_ps(face.axisU.x)));
+		__m128 py = _mm_add_ps(_mm_set1_ps(base.y), _mm_mul_ps(s, _mm_set1_ps(face.axisU.y)));
+		__m128 pz = _mm_add_ps(_mm_set1_ps(base.z), _mm_mul_ps(s, _mm_set1_ps(face.axisU.z)));
+
+		// Direction, and the solid angle of the texel: area / distance^3
+		__m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(pz, pz));
+		__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(length2));
+		__m128 weight = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(invLength, invLength), invLength), area);
+		__m128 dx = _mm_mul_ps(px, invLength);
+		__m128 dy = _mm_mul_ps(py, invLength);
+		__m128 dz = _mm_mul_ps(pz, invLength);
+
+		const unsigned char *p = row + (size_t)x * channels;
+		__m128 r = _mm_set_ps(lut[p[3 * channels]], lut[p[2 * channels]], lut[p[channels]], lut[p[0]]);
+		__m128 g = _mm_set_ps(lut[p[3 * channels + 1]], lut[p[2 * channels + 1]], lut[p[channels + 1]], lut[p[1]]);
+		__m128 b = _mm_set_ps(lut[p[3 * channels + 2]], lut[p[2 * channels + 2]], lut[p[channels + 2]], lut[p[2]]);
+		r = _mm_mul_ps(r, weight);
+		g = _mm_mul_ps(g, weight);
+		b = _mm_mul_ps(b, weight);
+
+		__m128 basis[9];
+		basis[0] = _mm_set1_ps(shY0);
+		basis[1] = _mm_mul_ps(_mm_set1_ps(shY1), dy);
+		basis[2] = _mm_mul_ps(_mm_set1_ps(shY1), dz);
+		basis[3] = _mm_mul_ps(_mm_set1_ps(shY1), dx);
+		basis[4] = _mm_mul_ps(_mm_set1_ps(shY2), _mm_mul_ps(dx, dy));
+		basis[5] = _mm_mul_ps(_mm_set1_ps(shY2), _mm_mul_ps(dy, dz));
+		basis[6] = _mm_mul_ps(_mm_set1_ps(shY20), _mm_sub_ps(_mm_mul_ps(three, _mm_mul_ps(dz, dz)), one));
+		basis[7] = _mm_mul_ps(_mm_set1_ps(shY2), _mm_mul_ps(dx, dz));
+		basis[8] = _mm_mul_ps(_mm_set1_ps(shY22), _mm_sub_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+
+		for (int k = 0; k < 9; ++k) {
+			acc[3 * k] = _mm_add_ps(acc[3 * k], _mm_mul_ps(basis[k], r));
+			acc[3 * k + 1] = _mm_add_ps(acc[3 * k + 1], _mm_mul_ps(basis[k], g));
+			acc[3 * k + 2] = _mm_add_ps(acc[3 * k + 2], _mm_mul_ps(basis[k], b));
+		}
+		accWeight = _mm_add_ps(accWeight, weight);
+	}
+
+	// Fold the lanes into the double precision totals once per row
+	float lanes[4];
+	for (int k = 0; k < 27; ++k) {
+		_mm_storeu_ps(lanes, acc[k]);
+		sum.c[k] += (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+	_mm_storeu_ps(lanes, accWeight);
+	sum.weight += (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+	// Scalar path for the remaining texels, or all of them without SSE
+	for (; x < face.x1; ++x) {
+		float s = ((x + 0.5f) / width - face.u0) / face.du;
+		glm::vec3 position = base + s * face.axisU;
+		float invLength = 1.0f / glm::length(position);
+		float weight = invLength * invLength * invLength * face.texelArea;
+		glm::vec3 direction = position * invLength;
+
+		float basis[9];
+		evaluateBasis(direction.x, direction.y, direction.z, basis);
+		const unsigned char *p = row + (size_t)x * channels;
+		for (int k = 0; k < 9; ++k) {
+			sum.c[3 * k] += basis[k] * lut[p[0]] * weight;
+			sum.c[3 * k + 1] += basis[k] * lut[p[1]] * weight;
+			sum.c[3 * k + 2] += basis[k] * lut[p[2]] * weight;
+		}
+		sum.weight += weight;
+	}
+}
+
+// 64-bit FNV-1a of the image file, a cache is only reused for the same bytes
+static uint64_t hashImage(const unsigned char *data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static bool loadCache(const std::string &cachePath, long long imageBytes, uint64_t imageHash,
+                      SHIrradiance &irradiance)
+{
+	std::ifstream file(cachePath.c_str(), std::ios::binary);
+	if (!file.is_open()) return false;
+
+	char magic[4];
+	int version = 0;
+	long long cachedImageBytes = 0;
+	uint64_t cachedImageHash = 0;
+	file.read(magic, 4);
+	file.read((char*)&version, sizeof(version));
+	file.read((char*)&cachedImageBytes, sizeof(cachedImageBytes));
+	file.read((char*)&cachedImageHash, sizeof(cachedImageHash));
+	if (!file || memcmp(magic, "SH9 ", 4) != 0 || version != SH_CACHE_VERSION || cachedImageBytes != imageBytes ||
+	    cachedImageHash != imageHash) {
+		return false;
+	}
+
+	float data[27];
+	file.read((char*)data, sizeof(data));
+	if (!file) return false;
+	for (int k = 0; k < 9; ++k) {
+		irradiance.coefficients[k] = glm::vec3(data[3 * k], data[3 * k + 1], data[3 * k + 2]);
+	}
+	return true;
+}
+
+static void saveCache(const std::string &cachePath, long long imageBytes, uint64_t imageHash,
+                      const SHIrradiance &irradiance)
+{
+	std::ofstream file(cachePath.c_str(), std::ios::binary);
+	if (!file.is_open()) {
+		std::cerr << "Failed to write " << cachePath << std::endl;
+		return;
+	}
+
+	int version = SH_CACHE_VERSION;
+	float data[27];
+	for (int k = 0; k < 9; ++k) {
+		data[3 * k] = irradiance.coefficients[k].x;
+		data[3 * k + 1] = irradiance.coefficients[k].y;
+		data[3 * k + 2] = irradiance.coefficients[k].z;
+	}
+	file.write("SH9 ", 4);
+	file.write((const char*)&version, sizeof(version));
+	file.write((const char*)&imageBytes, sizeof(imageBytes));
+	file.write((const char*)&imageHash, sizeof(imageHash));
+	file.write((const char*)data, sizeof(data));
+}
+
+bool computeSkyIrradiance(const char *imagePath, const float *positions, const float *uvs, int numFaces,
+                          SHIrradiance &irradiance, bool useCache)
+{
+	// The mapping is hashed for the cache and decoded on a miss
+	MappedFile file;
+	if (!file.open(imagePath)) {
+		std::cerr << "Failed to load sky image " << imagePath << std::endl;
+		return false;
+	}
+	std::string cachePath = std::string(imagePath) + ".sh";
+	long long imageBytes = (long long)file.size;
+	uint64_t imageHash = useCache ? hashImage(file.data, file.size) : 0;
+	if (useCache && loadCache(cachePath, imageBytes, imageHash, irradiance)) {
+		std::cout << "Sky irradiance loaded from " << cachePath << std::endl;
+		return true;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	int width, height, channels;
+	unsigned char *pixels = stbi_load_from_memory(file.data, (int)file.size, &width, &height, &channels, 3);
+	file.close();
+	if (pixels == NULL) {
+		std::cerr << "Failed to load sky image " << imagePath << std::endl;
+		return false;
+	}
+	channels = 3;
+	std::chrono::steady_clock::time_point decoded = std::chrono::steady_clock::now();
+
+	// Decode sRGB to linear, matching the GL_SRGB8 sky texture
+	float lut[256];
+	for (int i = 0; i < 256; ++i) {
+		float c = i / 255.0f;
+		lut[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	// Locate each face in the image
+	std::vector<SHFace> faces(numFaces);
+	std::vector<std::pair<int, int> > rows;
+	for (int f = 0; f < numFaces; ++f) {
+		const float *p = positions + 12 * f;
+		const float *t = uvs + 8 * f;
+		SHFace &face = faces[f];
+
+		float uMin = std::min(std::min(t[0], t[2]), std::min(t[4], t[6]));
+		float uMax = std::max(std::max(t[0], t[2]), std::max(t[4], t[6]));
+		float vMin = std::min(std::min(t[1], t[3]), std::min(t[5], t[7]));
+		float vMax = std::max(std::max(t[1], t[3]), std::max(t[5], t[7]));
+		face.x0 = (int)std::floor(uMin * width + 0.5f);
+		face.x1 = std::min(width, (int)std::floor(uMax * width + 0.5f));
+		face.y0 = (int)std::floor(vMin * height + 0.5f);
+		face.y1 = std::min(height, (int)std::floor(vMax * height + 0.5f));
+
+		// Corner 1 lies along u from corner 0, corner 3 along v
+		face.origin = glm::vec3(p[0], p[1], p[2]);
+		face.axisU = glm::vec3(p[3], p[4], p[5]) - face.origin;
+		face.axisV = glm::vec3(p[9], p[10], p[11]) - face.origin;
+		face.u0 = t[0];
+		face.du = t[2] - t[0];
+		face.v0 = t[1];
+		face.dv = t[7] - t[1];
+		int texels = std::max(1, (face.x1 - face.x0) * (face.y1 - face.y0));
+		face.texelArea = glm::length(face.axisU) * glm::length(face.axisV) / texels;
+
+		for (int y = face.y0; y < face.y1; ++y) {
+			rows.push_back(std::make_pair(f, y));
+		}
+	}
+
+	// Interleave rows across threads so every thread sees every face
+	int numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	std::vector<SHSum> sums(numThreads);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < numThreads; ++i) {
+		threads.push_back(std::thread([&, i]() {
+			SHSum &sum = sums[i];
+			memset(&sum, 0, sizeof(sum));
+			for (size_t r = i; r < rows.size(); r += numThreads) {
+				projectRow(pixels, width, height, channels, lut, faces[rows[r].first], rows[r].second, sum);
+			}
+		}));
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	stbi_image_free(pixels);
+
+	SHSum total;
+	memset(&total, 0, sizeof(total));
+	for (const auto &sum : sums) {
+		for (int k = 0; k < 27; ++k) total.c[k] += sum.c[k];
+		total.weight += sum.weight;
+	}
+
+	// The weights integrate to the full sphere, rescale to exactly 4 pi
+	double normalization = total.weight > 0.0 ? 4.0 * shPi / total.weight : 0.0;
+	for (int k = 0; k < 9; ++k) {
+		irradiance.coefficients[k] = glm::vec3(total.c[3 * k], total.c[3 * k + 1], total.c[3 * k + 2]) *
+		                             (float)(normalization * shBandScale[k]);
+	}
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	std::cout << "Sky irradiance for " << imagePath << " (" << width << "x" << height << "): decode "
+	          << std::chrono::duration<double, std::milli>(decoded - start).count() << " ms, projection "
+	          << std::chrono::duration<double, std::milli>(end - decoded).count() << " ms on " << numThreads
+	          << " threads" << std::endl;
+
+	if (useCache) {
+		saveCache(cachePath, imageBytes, imageHash, irradiance);
+	}
+	return true;
+}
+
+void SHIrradiance::getPadded(glm::vec4 padded[9]) const
+{
+	for (int i = 0; i < 9; ++i) {
+		padded[i] = glm::vec4(coefficients[i], 0.0f);
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef _SPHERICAL_HARMONICS_H_
+#define _SPHERICAL_HARMONICS_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+// Diffuse environment lighting as 9 spherical harmonics coefficients (bands
+// 0-2). The coefficients are already convolved with the clamped cosine lobe
+// and divided by pi, so evaluating them for a normal gives the light reflected
+// by a white diffuse surface. See shader/sh.glsl.
+struct SHIrradiance {
+    glm::vec3 coefficients[9];
+
+    // The coefficients as the vec4[9] of the std140 frame uniforms
+    void getPadded(glm::vec4 padded[9]) const;
+};
+
+// Projects a sky box image onto SH irradiance. The image is laid out like the
+// Skybox texture: positions holds 4 corners per face (12 floats) and uvs the
+// matching texture coordinates (8 floats). Rows are split across threads and
+// texels are processed four at a time with SSE where available. With useCache
+// the result is stored next to the image as <imagePath>.sh and reused while
+// the image file keeps the same contents. Returns false if the image cannot be read.
+bool computeSkyIrradiance(const char *imagePath, const float *positions, const float *uvs, int numFaces,
+                          SHIrradiance &irradiance, bool useCache);
+
+#endif
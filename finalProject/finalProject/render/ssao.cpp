@@ -0,0 +1,217 @@
+#include "ssao.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <random>
+
+const SSAOPreset ssaoPresets[SSAO_PRESET_COUNT] = {
+	// name      kernel  radius  blur  divisor
+	{ "Off",     0,      0.0f,   0,    0 },
+	{ "Low",     8,      12.0f,  2,    2 },
+	{ "Medium",  12,     12.0f,  3,    2 },
+	{ "High",    24,     12.0f,  4,    2 },
+	{ "Full",    24,     12.0f,  4,    1 },
+};
+
+void SSAO::initialize(int width, int height, int preset)
+{
+	this->width = width;
+	this->height = height;
+	targetWidth = width;
+	targetHeight = height;
+	this->preset = preset;
+	aoWidth = 0;
+	aoHeight = 0;
+	aoTargetWidth = 0;
+	aoTargetHeight = 0;
+	fbo[0] = fbo[1] = 0;
+	aoTexture[0] = aoTexture[1] = 0;
+
+	// Random rotations around the normal, tiled over the screen
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	float noise[SSAO_NOISE_SIZE * SSAO_NOISE_SIZE * 2];
+	for (int i = 0; i < SSAO_NOISE_SIZE * SSAO_NOISE_SIZE * 2; ++i) {
+		noise[i] = unit(random);
+	}
+	glGenTextures(1, &noiseTexture);
+	glBindTexture(GL_TEXTURE_2D, noiseTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, SSAO_NOISE_SIZE, SSAO_NOISE_SIZE, 0, GL_RG, GL_FLOAT, noise);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	glGenVertexArrays(1, &emptyVAO);
+
+	programID = LoadShadersFromFile("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\fullscreen.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\ssao.frag");
+	if (programID == 0) {
+		std::cerr << "Failed to load SSAO shaders." << std::endl;
+	}
+	depthMapID = glGetUniformLocation(programID, "depthMap");
+	normalMapID = glGetUniformLocation(programID, "normalMap");
+	noiseMapID = glGetUniformLocation(programID, "noiseMap");
+	noiseScaleID = glGetUniformLocation(programID, "noiseScale");
+	kernelID = glGetUniformLocation(programID, "kernel");
+	kernelSizeID = glGetUniformLocation(programID, "kernelSize");
+	radiusID = glGetUniformLocation(programID, "radius");
+
+	blurProgramID = LoadShadersFromFile("C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\fullscreen.vert", "C:\\Computer_Graphics_Git\\Computer_Graphics\\finalProject\\finalProject\\shader\\ssao_blur.frag");
+	if (blurProgramID == 0) {
+		std::cerr << "Failed to load SSAO blur shaders." << std::endl;
+	}
+	blurAOMapID = glGetUniformLocation(blurProgramID, "aoMap");
+	blurDirectionID = glGetUniformLocation(blurProgramID, "direction");
+	blurRadiusID = glGetUniformLocation(blurProgramID, "blurRadius");
+	blurRegionID = glGetUniformLocation(blurProgramID, "aoRegion");
+
+	for (int i = 0; i < SSAO_PRESET_COUNT; ++i) {
+		timers[i].initialize();
+	}
+
+	setPreset(preset);
+}
+
+void SSAO::createTargets()
+{
+	for (int i = 0; i < 2; ++i) {
+		glGenTextures(1, &aoTexture[i]);
+		glBindTexture(GL_TEXTURE_2D, aoTexture[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, aoTargetWidth, aoTargetHeight, 0, GL_RG, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glGenFramebuffers(1, &fbo[i]);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo[i]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, aoTexture[i], 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			std::cerr << "SSAO framebuffer is not complete." << std::endl;
+		}
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void SSAO::deleteTargets()
+{
+	glDeleteFramebuffers(2, fbo);
+	glDeleteTextures(2, aoTexture);
+	fbo[0] = fbo[1] = 0;
+	aoTexture[0] = aoTexture[1] = 0;
+}
+
+void SSAO::setPreset(int preset)
+{
+	this->preset = preset;
+	const SSAOPreset &settings = ssaoPresets[preset];
+	if (settings.kernelSize == 0) return;
+
+	int divisor = settings.resolutionDivisor;
+	aoWidth = (width + divisor - 1) / divisor;
+	aoHeight = (height + divisor - 1) / divisor;
+	int newWidth = (targetWidth + divisor - 1) / divisor;
+	int newHeight = (targetHeight + divisor - 1) / divisor;
+	if (newWidth != aoTargetWidth || newHeight != aoTargetHeight) {
+		deleteTargets();
+		aoTargetWidth = newWidth;
+		aoTargetHeight = newHeight;
+		createTargets();
+	}
+
+	// Hemisphere samples, scaled so more of them land close to the surface
+	std::mt19937 random(5678);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (int i = 0; i < settings.kernelSize; ++i) {
+		glm::vec3 sample(unit(random) * 2.0f - 1.0f, unit(random) * 2.0f - 1.0f, unit(random));
+		sample = glm::normalize(sample) * unit(random);
+		float scale = (float)i / settings.kernelSize;
+		kernel[i] = sample * (0.1f + 0.9f * scale * scale);
+	}
+}
+
+void SSAO::setRenderSize(int width, int height)
+{
+	this->width = std::min(std::max(width, 1), targetWidth);
+	this->height = std::min(std::max(height, 1), targetHeight);
+	const SSAOPreset &settings = ssaoPresets[preset];
+	if (settings.kernelSize == 0) return;
+	aoWidth = (this->width + settings.resolutionDivisor - 1) / settings.resolutionDivisor;
+	aoHeight = (this->height + settings.resolutionDivisor - 1) / settings.resolutionDivisor;
+}
+
+void SSAO::render(GLuint depthTexture, GLuint normalTexture)
+{
+	if (!isEnabled()) return;
+	const SSAOPreset &settings = ssaoPresets[preset];
+	GpuTimer &timer = timers[preset];
+	timer.begin();
+
+	glDisable(GL_DEPTH_TEST);
+	glViewport(0, 0, aoWidth, aoHeight);
+	glBindVertexArray(emptyVAO);
+
+	// Occlusion into buffer 0
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo[0]);
+	glUseProgram(programID);
+	glUniform2f(noiseScaleID, (float)aoWidth / SSAO_NOISE_SIZE, (float)aoHeight / SSAO_NOISE_SIZE);
+	glUniform3fv(kernelID, settings.kernelSize, &kernel[0][0]);
+	glUniform1i(kernelSizeID, settings.kernelSize);
+	glUniform1f(radiusID, settings.radius);
+
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, normalTexture);
+	glUniform1i(normalMapID, 3);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glUniform1i(depthMapID, 4);
+	glActiveTexture(GL_TEXTURE0 + SSAO_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, noiseTexture);
+	glUniform1i(noiseMapID, SSAO_TEXTURE_UNIT);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	// Separable bilateral blur: horizontal into buffer 1, vertical back into buffer 0
+	glUseProgram(blurProgramID);
+	glUniform1i(blurAOMapID, SSAO_TEXTURE_UNIT);
+	glUniform1i(blurRadiusID, settings.blurRadius);
+	glUniform4f(blurRegionID, (float)aoWidth, (float)aoHeight, 1.0f / aoTargetWidth, 1.0f / aoTargetHeight);
+	for (int pass = 0; pass < 2; ++pass) {
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo[1 - pass]);
+		glBindTexture(GL_TEXTURE_2D, aoTexture[pass]);
+		if (pass == 0) glUniform2f(blurDirectionID, 1.0f, 0.0f);
+		else glUniform2f(blurDirectionID, 0.0f, 1.0f);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, width, height);
+	glEnable(GL_DEPTH_TEST);
+	glActiveTexture(GL_TEXTURE0);
+
+	timer.end();
+}
+
+void SSAO::printTimings() const
+{
+	std::cout << "SSAO preset timings (GPU, AO + blur):" << std::endl;
+	for (int i = 0; i < SSAO_PRESET_COUNT; ++i) {
+		const SSAOPreset &settings = ssaoPresets[i];
+		if (settings.kernelSize == 0 || timers[i].averageMs == 0.0) continue;
+		printf("  %-8s %2d samples, 1/%d res, blur %d: %6.3f ms\n", settings.name, settings.kernelSize,
+		       settings.resolutionDivisor, settings.blurRadius, timers[i].averageMs);
+	}
+}
+
+void SSAO::cleanup()
+{
+	deleteTargets();
+	glDeleteTextures(1, &noiseTexture);
+	glDeleteVertexArrays(1, &emptyVAO);
+	glDeleteProgram(programID);
+	glDeleteProgram(blurProgramID);
+	for (int i = 0; i < SSAO_PRESET_COUNT; ++i) {
+		timers[i].cleanup();
+	}
+}
@@ -0,0 +1,102 @@
+#ifndef _SSAO_H_
+#define _SSAO_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "gpuTimer.h"
+
+#define SSAO_MAX_KERNEL_SIZE 32
+#define SSAO_NOISE_SIZE 4
+
+// Texture unit the composite pass samples the AO buffer from
+#define SSAO_TEXTURE_UNIT 6
+
+// Quality/performance presets, cycled at runtime
+struct SSAOPreset {
+    const char *name;
+    int kernelSize;         // Samples per pixel, 0 disables SSAO
+    float radius;           // World units
+    int blurRadius;         // Taps on each side of the separable bilateral blur
+    int resolutionDivisor;  // 2 = half resolution
+};
+
+enum {
+    SSAO_PRESET_OFF = 0,
+    SSAO_PRESET_LOW = 1,
+    SSAO_PRESET_MEDIUM = 2,
+    SSAO_PRESET_HIGH = 3,
+    SSAO_PRESET_FULL = 4,
+    SSAO_PRESET_COUNT = 5
+};
+
+extern const SSAOPreset ssaoPresets[SSAO_PRESET_COUNT];
+
+// Screen-space ambient occlusion from the deferred G-buffer. Occlusion is
+// computed at reduced resolution with a rotated hemisphere kernel, then
+// blurred twice with a depth-aware filter. The composite pass upsamples it
+// with depth weights (shader/ssao_upsample.glsl).
+struct SSAO {
+    int width;              // Render resolution
+    int height;
+    int targetWidth;        // Largest render resolution
+    int targetHeight;
+    int aoWidth;            // Rendered part of the AO buffers, for the current preset
+    int aoHeight;
+    int aoTargetWidth;      // Size of the AO buffers, allocated for the largest render resolution
+    int aoTargetHeight;
+    int preset;
+
+    // Ping-pong AO buffers, RG16F: r = visibility, g = linear depth
+    GLuint fbo[2];
+    GLuint aoTexture[2];
+    GLuint noiseTexture;
+    GLuint emptyVAO;
+    glm::vec3 kernel[SSAO_MAX_KERNEL_SIZE];
+
+    GLuint programID;
+    GLint depthMapID;
+    GLint normalMapID;
+    GLint noiseMapID;
+    GLint noiseScaleID;
+    GLint kernelID;
+    GLint kernelSizeID;
+    GLint radiusID;
+
+    GLuint blurProgramID;
+    GLint blurAOMapID;
+    GLint blurDirectionID;
+    GLint blurRadiusID;
+    GLint blurRegionID;
+
+    // GPU time of the AO and blur passes, measured separately for every preset
+    GpuTimer timers[SSAO_PRESET_COUNT];
+
+    void initialize(int width, int height, int preset);
+
+    // Follows the G-buffer to another render resolution, without reallocating
+    void setRenderSize(int width, int height);
+
+    // Switches preset and reallocates the AO buffers if their divisor changes
+    void setPreset(int preset);
+    bool isEnabled() const { return ssaoPresets[preset].kernelSize > 0; }
+
+    // Computes AO from the G-buffer depth and normals, with the camera taken
+    // from the frame uniforms. Leaves the default framebuffer bound with a
+    // viewport of the render resolution.
+    void render(GLuint depthTexture, GLuint normalTexture);
+
+    // The blurred result, still at AO resolution in the bottom-left aoWidth x aoHeight
+    GLuint getResult() const { return aoTexture[0]; }
+
+    // Prints the average GPU time of every preset that has been used
+    void printTimings() const;
+
+    void cleanup();
+
+private:
+    void createTargets();
+    void deleteTargets();
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include "uniformBuffers.h"
+
+#include <cstring>
+
+static UniformStats stats;
+
+static void countUniform(long long bytes)
+{
+	stats.uniformCalls++;
+	stats.uniformBytes += bytes;
+}
+
+// The glad entry points the wrappers forward to
+static PFNGLUNIFORM1IPROC uniform1i;
+static PFNGLUNIFORM1FPROC uniform1f;
+static PFNGLUNIFORM2FPROC uniform2f;
+static PFNGLUNIFORM3FPROC uniform3f;
+static PFNGLUNIFORM1FVPROC uniform1fv;
+static PFNGLUNIFORM3FVPROC uniform3fv;
+static PFNGLUNIFORM4FVPROC uniform4fv;
+static PFNGLUNIFORMMATRIX3FVPROC uniformMatrix3fv;
+static PFNGLUNIFORMMATRIX4FVPROC uniformMatrix4fv;
+
+static void GLAD_API_PTR countedUniform1i(GLint location, GLint v0)
+{
+	countUniform(sizeof(GLint));
+	uniform1i(location, v0);
+}
+
+static void GLAD_API_PTR countedUniform1f(GLint location, GLfloat v0)
+{
+	countUniform(sizeof(GLfloat));
+	uniform1f(location, v0);
+}
+
+static void GLAD_API_PTR countedUniform2f(GLint location, GLfloat v0, GLfloat v1)
+{
+	countUniform(2 * sizeof(GLfloat));
+	uniform2f(location, v0, v1);
+}
+
+static void GLAD_API_PTR countedUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+{
+	countUniform(3 * sizeof(GLfloat));
+	uniform3f(location, v0, v1, v2);
+}
+
+static void GLAD_API_PTR countedUniform1fv(GLint location, GLsizei count, const GLfloat *value)
+{
+	countUniform(count * sizeof(GLfloat));
+	uniform1fv(location, count, value);
+}
+
+static void GLAD_API_PTR countedUniform3fv(GLint location, GLsizei count, const GLfloat *value)
+{
+	countUniform(count * 3 * sizeof(GLfloat));
+	uniform3fv(location, count, value);
+}
+
+static void GLAD_API_PTR countedUniform4fv(GLint location, GLsizei count, const GLfloat *value)
+{
+	countUniform(count * 4 * sizeof(GLfloat));
+	uniform4fv(location, count, value);
+}
+
+static void GLAD_API_PTR countedUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+	countUniform(count * 9 * sizeof(GLfloat));
+	uniformMatrix3fv(location, count, transpose, value);
+}
+
+static void GLAD_API_PTR countedUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+	countUniform(count * 16 * sizeof(GLfloat));
+	uniformMatrix4fv(location, count, transpose, value);
+}
+
+void installUniformCounters()
+{
+	if (uniform1i != NULL) return;
+	uniform1i = glad_glUniform1i;
+	uniform1f = glad_glUniform1f;
+	uniform2f = glad_glUniform2f;
+	uniform3f = glad_glUniform3f;
+	uniform1fv = glad_glUniform1fv;
+	uniform3fv = glad_glUniform3fv;
+	uniform4fv = glad_glUniform4fv;
+	uniformMatrix3fv = glad_glUniformMatrix3fv;
+	uniformMatrix4fv = glad_glUniformMatrix4fv;
+
+	glad_glUniform1i = countedUniform1i;
+	glad_glUniform1f = countedUniform1f;
+	glad_glUniform2f = countedUniform2f;
+	glad_glUniform3f = countedUniform3f;
+	glad_glUniform1fv = countedUniform1fv;
+	glad_glUniform3fv = countedUniform3fv;
+	glad_glUniform4fv = countedUniform4fv;
+	glad_glUniformMatrix3fv = countedUniformMatrix3fv;
+	glad_glUniformMatrix4fv = countedUniformMatrix4fv;
+}
+
+UniformStats takeUniformStats()
+{
+	UniformStats result = stats;
+	memset(&stats, 0, sizeof(stats));
+	return result;
+}
+
+void bindUniformBlocks(GLuint programID)
+{
+	static const struct {
+		const char *name;
+		GLuint binding;
+	} blocks[] = {
+		{ "FrameUniforms", FRAME_UNIFORM_BINDING },
+		{ "ObjectUniforms", OBJECT_UNIFORM_BINDING },
+		{ "SkinUniforms", SKIN_UNIFORM_BINDING },
+	};
+	for (const auto &block : blocks) {
+		GLuint index = glGetUniformBlockIndex(programID, block.name);
+		if (index != GL_INVALID_INDEX) {
+			glUniformBlockBinding(programID, index, block.binding);
+		}
+	}
+}
+
+void FrameUniformBuffer::initialize()
+{
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_STREAM_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, buffer);
+}
+
+void FrameUniformBuffer::update(const FrameUniforms &uniforms)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), &uniforms, GL_STREAM_DRAW);
+	stats.bufferUploads++;
+	stats.bufferBytes += sizeof(FrameUniforms);
+}
+
+void FrameUniformBuffer::cleanup()
+{
+	glDeleteBuffers(1, &buffer);
+}
+
+void UniformRing::initialize(GLsizeiptr size)
+{
+	this->size = size;
+	head = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment < 16) alignment = 16;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+}
+
+GLsizeiptr UniformRing::stride(GLsizeiptr elementSize) const
+{
+	return (elementSize + alignment - 1) / alignment * alignment;
+}
+
+void UniformRing::reserve(GLsizeiptr bytes)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	if (head + bytes <= size) return;
+
+	// Orphan: draws still in flight keep the old storage
+	if (bytes > size) size = bytes * 2;
+	glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_STREAM_DRAW);
+	head = 0;
+}
+
+GLintptr UniformRing::upload(const void *elements, int count, GLsizeiptr elementSize)
+{
+	GLsizeiptr elementStride = stride(elementSize);
+	GLsizeiptr bytes = elementStride * count;
+	reserve(bytes);
+
+	// Nothing queued reads this range, so there is nothing to synchronise with
+	GLintptr offset = head;
+	unsigned char *destination = (unsigned char *)glMapBufferRange(GL_UNIFORM_BUFFER, offset, bytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (destination != NULL) {
+		const unsigned char *source = (const unsigned char *)elements;
+		for (int i = 0; i < count; ++i) {
+			memcpy(destination + i * elementStride, source + i * elementSize, elementSize);
+		}
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+	}
+	head += bytes;
+
+	stats.bufferUploads++;
+	stats.bufferBytes += count * elementSize;
+	return offset;
+}
+
+void UniformRing::bind(GLuint binding, GLintptr offset, int index, GLsizeiptr elementSize) const
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset + index * stride(elementSize), elementSize);
+	stats.rangeBinds++;
+}
+
+void UniformRing::cleanup()
+{
+	glDeleteBuffers(1, &buffer);
+}
@@ -0,0 +1,113 @@
+#ifndef _UNIFORM_BUFFERS_H_
+#define _UNIFORM_BUFFERS_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <stdint.h>
+
+#include "shadowMap.h"
+
+// Binding points of the uniform blocks in shader/*_uniforms.glsl. GLSL 3.30
+// cannot set them in the shader, so LoadShadersFromFile assigns them.
+#define FRAME_UNIFORM_BINDING 0
+#define OBJECT_UNIFORM_BINDING 1
+#define SKIN_UNIFORM_BINDING 2
+
+#define MAX_JOINTS 100
+
+// C++ mirrors of the std140 blocks. They only hold mat4, vec4 and groups of
+// four 4-byte scalars, so the std140 layout is the plain struct layout.
+
+// Constants shared by every draw of a frame, see shader/frame_uniforms.glsl
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::mat4 inverseProjection;
+    glm::mat4 inverseViewProjection;
+    glm::mat4 lightSpaceMatrices[MAX_SHADOW_CASCADES];
+    glm::vec4 cascadeSizes[MAX_SHADOW_CASCADES];    // x = world size, y = depth range
+    glm::vec4 shCoefficients[9];                    // Sky irradiance, rgb
+    glm::vec4 lightDirection;                       // Sun, xyz
+    glm::vec4 pointLightPosition;                   // Light of the forward bot shader, xyz
+    glm::vec4 pointLightIntensity;                  // rgb
+    glm::vec4 renderSize;                           // xy = render resolution, zw = 1 / size of the screen targets
+    int32_t numCascades;
+    int32_t shadowFilter;
+    float lightSize;
+    float padding;
+};
+
+// Constants of one draw, see shader/object_uniforms.glsl
+struct ObjectUniforms {
+    glm::mat4 mvp;
+    glm::mat4 model;
+};
+
+// Joint matrices of one skinned model, see shader/skin_uniforms.glsl
+struct SkinUniforms {
+    glm::mat4 jointMatrices[MAX_JOINTS];
+};
+
+// Uniform traffic counted since the last takeUniformStats()
+struct UniformStats {
+    int uniformCalls;           // glUniform* calls
+    long long uniformBytes;     // Values passed to them
+    int bufferUploads;          // Writes into uniform buffers
+    long long bufferBytes;
+    int rangeBinds;             // glBindBufferRange calls selecting a block
+};
+
+// Replaces the glUniform* entry points loaded by glad with counting wrappers.
+// Call once after gladLoadGL.
+void installUniformCounters();
+
+// Returns the counts so far and starts over, call once per frame
+UniformStats takeUniformStats();
+
+// Points the blocks a program declares at the binding points above
+void bindUniformBlocks(GLuint programID);
+
+// The per-frame block. update() orphans the storage so the driver never
+// waits for the previous frame to stop reading it.
+struct FrameUniformBuffer {
+    GLuint buffer;
+
+    void initialize();
+    void update(const FrameUniforms &uniforms);
+    void cleanup();
+};
+
+// Per-draw blocks, written front to back through unsynchronised mappings so
+// the CPU never waits for draws still reading earlier blocks. When the end is
+// reached the storage is orphaned and writing starts over in a fresh one while
+// the GPU finishes with the old one. A draw list is written with one upload
+// and each draw then selects its block with bind(). Offsets are only good
+// until an upload orphans, so blocks used together are uploaded after one
+// reserve() for all of them.
+struct UniformRing {
+    GLuint buffer;
+    GLsizeiptr size;
+    GLintptr head;
+    GLint alignment;            // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+
+    void initialize(GLsizeiptr size);
+
+    // Distance between two elements of an upload
+    GLsizeiptr stride(GLsizeiptr elementSize) const;
+
+    // Makes sure the next uploads totalling bytes (counted in strides) fit
+    // without orphaning, growing the buffer if it is too small
+    void reserve(GLsizeiptr bytes);
+
+    // Copies count elements of elementSize bytes, each to an aligned offset.
+    // Returns the offset of the first one.
+    GLintptr upload(const void *elements, int count, GLsizeiptr elementSize);
+
+    // Binds element index of the upload at offset to a binding point
+    void bind(GLuint binding, GLintptr offset, int index, GLsizeiptr elementSize) const;
+
+    void cleanup();
+};
+
+#endif
@@ -5,20 +5,14 @@ in vec3 worldNormal;
 
 out vec3 finalColor;
 
-uniform vec3 lightPosition;
-uniform vec3 lightIntensity;
+#include "frame_uniforms.glsl"
 
 void main()
 {
 	// Lighting
-	vec3 lightDir = lightPosition - worldPosition;
+	vec3 lightDir = pointLightPosition.xyz - worldPosition;
 	float lightDist = dot(lightDir, lightDir);
 	lightDir = normalize(lightDir);
-	vec3 v = lightIntensity * clamp(dot(lightDir, worldNormal), 0.0, 1.0) / lightDist;
-
-	// Tone mapping
-	v = v / (1.0 + v);
-
-	// Gamma correction
-	finalColor = pow(v, vec3(1.0 / 2.2));
+	// Linear radiance, tone mapped and encoded by the resolve pass
+	finalColor = pointLightIntensity.rgb * clamp(dot(lightDir, worldNormal), 0.0, 1.0) / lightDist;
 }
@@ -9,9 +9,8 @@ layout(location = 4) in vec4 weights;
 out vec3 worldPosition;
 out vec3 worldNormal;
 
-uniform mat4 MVP;
-uniform mat4 jointMatrices[100];  
-uniform vec3 lightPosition;
+#include "object_uniforms.glsl"
+#include "skin_uniforms.glsl"
 
 void main() {
     // Initialise transformed position and normal
@@ -0,0 +1,20 @@
+#version 330 core
+
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 3) in uvec4 joints;
+layout(location = 4) in vec4 weights;
+
+#include "object_uniforms.glsl"
+#include "skin_uniforms.glsl"
+
+void main() {
+    // Only the skinned position matters for the shadow map
+    vec4 skinnedPosition = vec4(0.0);
+    for(int i = 0; i < 4; i++) {
+        if(weights[i] > 0.0){
+            skinnedPosition += (jointMatrices[joints[i]] * vec4(vertexPosition, 1.0)) * weights[i];
+        }
+    }
+
+    gl_Position = MVP * skinnedPosition;
+}
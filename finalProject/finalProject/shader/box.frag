@@ -1,15 +1,31 @@
 #version 330 core
 
 in vec2 uv;  // Input UV coordinate from vertex shader
+in vec3 worldPosition;
 
 out vec4 color;  // Output color
 
 uniform sampler2D textureSampler;  // Texture sampler to access the texture
 
+// Directional light and its cascaded shadow maps
+#include "frame_uniforms.glsl"
+#include "shadow.glsl"
+
+// Ambient light from the sky image
+#include "sh.glsl"
+
+const float sunStrength = 0.7;
+
 void main() {
     // Perform texture lookup using the UV coordinates
-    vec3 finalColor = texture(textureSampler, uv).rgb;  // Fetch texture color based on UV coordinates
+    vec3 albedo = texture(textureSampler, uv).rgb;  // Fetch texture color based on UV coordinates
+
+    // Boxes carry no normals, so derive the face normal from screen-space derivatives
+    vec3 normal = normalize(cross(dFdx(worldPosition), dFdy(worldPosition)));
+    float cosTheta = max(dot(normal, -lightDirection.xyz), 0.0);
+
+    float shadow = cosTheta > 0.0 ? locateShadow(worldPosition, cosTheta) : 0.0;
+    vec3 finalColor = albedo * (skyIrradiance(normal) + sunStrength * cosTheta * shadow);
 
-    // Optionally, apply the vertex color (if any) to the final color (you can remove vertex color if not needed)
     color = vec4(finalColor, 1.0);  // Set the output color with an alpha value of 1 (opaque)
 }
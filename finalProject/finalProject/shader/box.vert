@@ -4,11 +4,17 @@ layout(location = 0) in vec3 vertexPosition; // Position of the vertex
 layout(location = 1) in vec3 vertexColor;    // Color for the vertex (optional if you're using textures)
 layout(location = 2) in vec2 vertexUV;       // UV coordinates for texture mapping
 
-uniform mat4 MVP;  // Model-View-Projection matrix
+// Model-View-Projection matrix, and the model matrix that places the fragment in the shadow cascades
+#include "object_uniforms.glsl"
 
 out vec2 uv;  // Output UV coordinate for the fragment shader
+out vec3 worldPosition;
+
+// Must match depth.vert bit for bit, see the depth pre-pass
+invariant gl_Position;
 
 void main() {
     gl_Position = MVP * vec4(vertexPosition, 1.0);  // Apply transformation to vertex position
     uv = vertexUV;  // Pass UV coordinates to the fragment shader
+    worldPosition = vec3(M * vec4(vertexPosition, 1.0));
 }
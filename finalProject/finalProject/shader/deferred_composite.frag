@@ -0,0 +1,45 @@
+#version 330 core
+
+in vec2 uv;
+
+out vec4 color;
+
+uniform sampler2D albedoMap;
+uniform sampler2D normalMap;
+uniform sampler2D depthMap;
+uniform sampler2D lightMap;     // Accumulated point light irradiance
+
+// Camera and directional light, then its cascaded shadow maps
+#include "frame_uniforms.glsl"
+#include "shadow.glsl"
+#include "octahedral.glsl"
+
+// Ambient light from the sky image, darkened by SSAO
+#include "sh.glsl"
+#include "ssao_upsample.glsl"
+
+const float sunStrength = 0.7;
+
+void main() {
+    // uv spans the rendered area, coord addresses it in the G-buffer
+    vec2 coord = screenUV(uv);
+    float depth = texture(depthMap, coord).r;
+
+    // Nothing was drawn here, keep the sky that is already in the framebuffer
+    if (depth == 1.0) discard;
+
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 worldPosition = world.xyz / world.w;
+
+    vec3 albedo = texture(albedoMap, coord).rgb;
+    vec3 normal = decodeNormal(texture(normalMap, coord).rg);
+    float cosTheta = max(dot(normal, -lightDirection.xyz), 0.0);
+
+    float shadow = cosTheta > 0.0 ? locateShadow(worldPosition, cosTheta) : 0.0;
+    float linearDepth = -(view * vec4(worldPosition, 1.0)).z;
+    float ambientOcclusion = upsampleAO(uv, linearDepth);
+
+    vec3 light = skyIrradiance(normal) * ambientOcclusion + sunStrength * cosTheta * shadow;
+
+    color = vec4(albedo * (light + texture(lightMap, coord).rgb), 1.0);
+}
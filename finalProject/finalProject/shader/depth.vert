@@ -2,8 +2,11 @@
 
 layout(location = 0) in vec3 position;
 
-uniform mat4 lightSpaceMatrix;
+#include "object_uniforms.glsl"
+
+// Must match box.vert bit for bit, the depth pre-pass is followed by a GL_EQUAL colour pass
+invariant gl_Position;
 
 void main() {
-    gl_Position = lightSpaceMatrix * vec4(position, 1.0);
+    gl_Position = MVP * vec4(position, 1.0);
 }
\ No newline at end of file
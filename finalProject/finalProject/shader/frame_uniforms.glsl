@@ -0,0 +1,31 @@
+// Constants shared by every draw of a frame, updated once per frame.
+// Mirrored by FrameUniforms in render/uniformBuffers.h.
+#ifndef FRAME_UNIFORMS_GLSL
+#define FRAME_UNIFORMS_GLSL
+
+layout(std140) uniform FrameUniforms {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 inverseProjection;
+    mat4 inverseViewProjection;
+    mat4 lightSpaceMatrices[4];
+    vec4 cascadeSizes[4];       // x = world size, y = depth range
+    vec4 shCoefficients[9];     // Sky irradiance, rgb
+    vec4 lightDirection;        // Sun, xyz
+    vec4 pointLightPosition;    // Light of the forward bot shader, xyz
+    vec4 pointLightIntensity;
+    vec4 renderSize;            // xy = render resolution, zw = 1 / size of the screen targets
+    int numCascades;
+    int shadowFilter;
+    float lightSize;
+};
+
+// The scene is rendered into the bottom-left corner of screen targets that
+// keep the window size. Maps a coordinate over that corner to a texture
+// coordinate, clamped to it as GL_CLAMP_TO_EDGE would.
+vec2 screenUV(vec2 coord) {
+    return clamp(coord * renderSize.xy, vec2(0.5), renderSize.xy - 0.5) * renderSize.zw;
+}
+
+#endif
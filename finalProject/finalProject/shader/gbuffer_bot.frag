@@ -0,0 +1,14 @@
+#version 330 core
+
+in vec3 worldPosition;
+in vec3 worldNormal;
+
+layout(location = 0) out vec4 albedo;
+layout(location = 1) out vec2 normal;
+
+#include "octahedral.glsl"
+
+void main() {
+    albedo = vec4(0.8, 0.8, 0.8, 1.0);
+    normal = encodeNormal(normalize(worldNormal));
+}
@@ -0,0 +1,18 @@
+#version 330 core
+
+in vec2 uv;
+in vec3 worldPosition;
+
+layout(location = 0) out vec4 albedo;
+layout(location = 1) out vec2 normal;
+
+uniform sampler2D textureSampler;
+
+#include "octahedral.glsl"
+
+void main() {
+    albedo = vec4(texture(textureSampler, uv).rgb, 1.0);
+
+    // Boxes carry no normals, so derive the face normal from screen-space derivatives
+    normal = encodeNormal(normalize(cross(dFdx(worldPosition), dFdy(worldPosition))));
+}
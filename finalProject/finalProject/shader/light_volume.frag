@@ -0,0 +1,33 @@
+#version 330 core
+
+flat in vec4 positionRadius;
+flat in vec3 color;
+
+out vec4 irradiance;
+
+uniform sampler2D normalMap;
+uniform sampler2D depthMap;
+
+#include "frame_uniforms.glsl"
+#include "octahedral.glsl"
+
+void main() {
+    vec2 uv = gl_FragCoord.xy / renderSize.xy;
+    vec2 coord = gl_FragCoord.xy * renderSize.zw;
+    float depth = texture(depthMap, coord).r;
+
+    // Reconstruct the world position of the shaded surface
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 worldPosition = world.xyz / world.w;
+
+    vec3 toLight = positionRadius.xyz - worldPosition;
+    float distance = length(toLight);
+    if (distance > positionRadius.w) discard;
+
+    vec3 normal = decodeNormal(texture(normalMap, coord).rg);
+    float cosTheta = max(dot(normal, toLight / distance), 0.0);
+
+    // Smooth falloff that reaches zero at the edge of the light volume
+    float falloff = 1.0 - distance / positionRadius.w;
+    irradiance = vec4(color * cosTheta * falloff * falloff, 0.0);
+}
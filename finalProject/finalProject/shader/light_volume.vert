@@ -0,0 +1,18 @@
+#version 330 core
+
+layout(location = 0) in vec3 vertexPosition;       // Unit box corner
+layout(location = 1) in vec4 lightPositionRadius;  // Per instance
+layout(location = 2) in vec4 lightColor;           // Per instance
+
+flat out vec4 positionRadius;
+flat out vec3 color;
+
+#include "frame_uniforms.glsl"
+
+void main() {
+    // Scale the unit box so it bounds the sphere of influence of the light
+    vec3 worldPosition = lightPositionRadius.xyz + vertexPosition * lightPositionRadius.w;
+    gl_Position = viewProjection * vec4(worldPosition, 1.0);
+    positionRadius = lightPositionRadius;
+    color = lightColor.rgb;
+}
@@ -0,0 +1,11 @@
+// Constants of one draw, a block of the uniform ring selected per draw.
+// Mirrored by ObjectUniforms in render/uniformBuffers.h.
+#ifndef OBJECT_UNIFORMS_GLSL
+#define OBJECT_UNIFORMS_GLSL
+
+layout(std140) uniform ObjectUniforms {
+    mat4 MVP;
+    mat4 M;     // Model matrix
+};
+
+#endif
@@ -0,0 +1,56 @@
+#version 330 core
+
+in vec2 uv;
+
+out vec4 color;
+
+uniform sampler2D hdrMap;       // Linear scene radiance
+uniform float exposure;
+uniform int tonemap;            // 0 = Reinhard, 1 = ACES
+uniform bool encodeSRGB;        // False when the framebuffer encodes in hardware
+uniform float sharpness;        // 0 = plain bilinear upscale, 1 = strongest sharpening
+
+#include "frame_uniforms.glsl"
+
+vec3 reinhard(vec3 v) {
+    return v / (1.0 + v);
+}
+
+// Narkowicz's fit of the ACES filmic curve
+vec3 aces(vec3 v) {
+    return clamp((v * (2.51 * v + 0.03)) / (v * (2.43 * v + 0.59) + 0.14), 0.0, 1.0);
+}
+
+vec3 linearToSRGB(vec3 v) {
+    vec3 low = v * 12.92;
+    vec3 high = 1.055 * pow(v, vec3(1.0 / 2.4)) - 0.055;
+    return mix(high, low, vec3(lessThanEqual(v, vec3(0.0031308))));
+}
+
+// Tone mapped colour at a coordinate over the rendered part of the target
+vec3 toneMapped(vec2 coord) {
+    vec3 v = texture(hdrMap, screenUV(coord)).rgb * exposure;
+    return tonemap == 0 ? reinhard(v) : aces(v);
+}
+
+void main() {
+    vec3 v = toneMapped(uv);
+
+    // Contrast adaptive sharpening of the upscale: a negative lobe on the four
+    // neighbours, weakened where the neighbourhood already has contrast so
+    // edges do not ring. Works on the tone mapped colour, which lies in [0, 1].
+    if (sharpness > 0.0) {
+        vec2 texel = 1.0 / renderSize.xy;
+        vec3 north = toneMapped(uv + vec2(0.0, texel.y));
+        vec3 south = toneMapped(uv - vec2(0.0, texel.y));
+        vec3 east = toneMapped(uv + vec2(texel.x, 0.0));
+        vec3 west = toneMapped(uv - vec2(texel.x, 0.0));
+        vec3 low = min(v, min(min(north, south), min(east, west)));
+        vec3 high = max(v, max(max(north, south), max(east, west)));
+        vec3 amount = sqrt(clamp(min(low, 1.0 - high) / max(high, 1.0e-4), 0.0, 1.0));
+        vec3 weight = -amount * mix(0.125, 0.2, sharpness);
+        v = clamp((v + (north + south + east + west) * weight) / (1.0 + 4.0 * weight), 0.0, 1.0);
+    }
+
+    color = vec4(encodeSRGB ? linearToSRGB(v) : v, 1.0);
+}
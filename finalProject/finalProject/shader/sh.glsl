@@ -0,0 +1,17 @@
+// Sky irradiance as 9 spherical harmonics coefficients, convolved with the
+// cosine lobe on the CPU (see render/sphericalHarmonics.h), in the frame block
+#include "frame_uniforms.glsl"
+
+// Light reflected by a white diffuse surface with normal n
+vec3 skyIrradiance(vec3 n) {
+    vec3 result = shCoefficients[0].rgb * 0.282095
+                + shCoefficients[1].rgb * (0.488603 * n.y)
+                + shCoefficients[2].rgb * (0.488603 * n.z)
+                + shCoefficients[3].rgb * (0.488603 * n.x)
+                + shCoefficients[4].rgb * (1.092548 * n.x * n.y)
+                + shCoefficients[5].rgb * (1.092548 * n.y * n.z)
+                + shCoefficients[6].rgb * (0.315392 * (3.0 * n.z * n.z - 1.0))
+                + shCoefficients[7].rgb * (1.092548 * n.x * n.z)
+                + shCoefficients[8].rgb * (0.546274 * (n.x * n.x - n.y * n.y));
+    return max(result, vec3(0.0));
+}
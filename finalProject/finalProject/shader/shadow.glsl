@@ -0,0 +1,90 @@
+// Cascaded shadow maps of the directional light, included by the forward
+// and the deferred lighting shaders. The cascade matrices, sizes and filter
+// settings come from the frame block.
+#include "frame_uniforms.glsl"
+
+uniform sampler2DArrayShadow shadowMap;  // Hardware depth comparison
+uniform sampler2DArray shadowDepthMap;   // Raw depth for the PCSS blocker search
+
+#define SHADOW_FILTER_PCF2X2 0
+#define SHADOW_FILTER_POISSON 1
+#define SHADOW_FILTER_PCSS 2
+
+const vec2 poissonDisk[16] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+    vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+    vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+    vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790)
+);
+
+float poissonPCF(vec3 coords, float layer, float ref, float radius, mat2 rotation) {
+    float sum = 0.0;
+    for (int i = 0; i < 16; ++i) {
+        vec2 offset = rotation * poissonDisk[i] * radius;
+        sum += texture(shadowMap, vec4(coords.xy + offset, layer, ref));
+    }
+    return sum / 16.0;
+}
+
+float filterShadow(vec3 coords, int cascade, float bias) {
+    float layer = float(cascade);
+    float ref = coords.z - bias;
+    float texelSize = 1.0 / float(textureSize(shadowMap, 0).x);
+
+    // One tap, the comparison sampler blends the 2x2 neighbourhood in hardware
+    if (shadowFilter == SHADOW_FILTER_PCF2X2) {
+        return texture(shadowMap, vec4(coords.xy, layer, ref));
+    }
+
+    // Rotate the disk per pixel to trade banding for noise
+    float angle = 6.2831853 * fract(sin(dot(gl_FragCoord.xy, vec2(12.9898, 78.233))) * 43758.5453);
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+
+    if (shadowFilter == SHADOW_FILTER_POISSON) {
+        return poissonPCF(coords, layer, ref, 2.0 * texelSize, rotation);
+    }
+
+    // PCSS: the light is directional, so penumbra width grows linearly with the
+    // distance between blocker and receiver along the light
+    float worldToUV = 1.0 / cascadeSizes[cascade].x;
+    float depthRange = cascadeSizes[cascade].y;
+    float searchRadius = clamp(lightSize * ref * depthRange * worldToUV, texelSize, 32.0 * texelSize);
+
+    float blockerSum = 0.0;
+    float blockerCount = 0.0;
+    for (int i = 0; i < 16; ++i) {
+        vec2 offset = rotation * poissonDisk[i] * searchRadius;
+        float depth = texture(shadowDepthMap, vec3(coords.xy + offset, layer)).r;
+        if (depth < ref) {
+            blockerSum += depth;
+            blockerCount += 1.0;
+        }
+    }
+    if (blockerCount == 0.0) return 1.0;
+
+    float blockerDepth = blockerSum / blockerCount;
+    float penumbra = (ref - blockerDepth) * depthRange * lightSize * worldToUV;
+    return poissonPCF(coords, layer, ref, clamp(penumbra, texelSize, 32.0 * texelSize), rotation);
+}
+
+float locateShadow(vec3 worldPos, float cosTheta) {
+    // Use the first (finest) cascade that contains the fragment
+    for (int i = 0; i < numCascades; ++i) {
+        vec4 lightSpacePos = lightSpaceMatrices[i] * vec4(worldPos, 1.0);
+        vec3 projCoords = lightSpacePos.xyz / lightSpacePos.w;
+        projCoords = projCoords * 0.5 + 0.5;
+
+        if (all(greaterThan(projCoords, vec3(0.0))) && all(lessThan(projCoords, vec3(1.0)))) {
+            // Slope-scaled bias of about one texel in world units, converted to depth
+            float texelWorld = cascadeSizes[i].x / float(textureSize(shadowMap, 0).x);
+            float tanTheta = clamp(sqrt(1.0 - cosTheta * cosTheta) / max(cosTheta, 1e-3), 0.0, 10.0);
+            float bias = texelWorld * (0.5 + tanTheta) / cascadeSizes[i].y;
+            return filterShadow(projCoords, i, bias);
+        }
+    }
+    return 1.0;
+}
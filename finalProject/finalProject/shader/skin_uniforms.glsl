@@ -0,0 +1,10 @@
+// Joint matrices of one skinned model, uploaded once per frame.
+// Mirrored by SkinUniforms in render/uniformBuffers.h.
+#ifndef SKIN_UNIFORMS_GLSL
+#define SKIN_UNIFORMS_GLSL
+
+layout(std140) uniform SkinUniforms {
+    mat4 jointMatrices[100];
+};
+
+#endif
@@ -12,7 +12,7 @@ out vec3 color;
 out vec2 uv;
 
 // Matrix for vertex transformation
-uniform mat4 MVP;
+#include "object_uniforms.glsl"
 
 void main() {
     // Transform vertex
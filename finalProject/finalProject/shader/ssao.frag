@@ -0,0 +1,58 @@
+#version 330 core
+
+in vec2 uv;
+
+// r = ambient visibility, g = linear view depth for the depth-aware blur and upsample
+out vec2 result;
+
+uniform sampler2D depthMap;
+uniform sampler2D normalMap;
+uniform sampler2D noiseMap;     // Small tiled texture of random rotations around the normal
+uniform vec2 noiseScale;        // AO resolution / noise texture size
+
+uniform vec3 kernel[32];        // Hemisphere samples around +Z, denser near the origin
+uniform int kernelSize;
+uniform float radius;
+
+#include "frame_uniforms.glsl"
+#include "octahedral.glsl"
+
+const float bias = 0.5;
+const float farDepth = 1.0e6;   // Linear depth given to the sky
+
+// Takes a coordinate over the rendered area, see screenUV()
+vec3 viewPosition(vec2 coord) {
+    float depth = texture(depthMap, screenUV(coord)).r;
+    vec4 position = inverseProjection * vec4(vec3(coord, depth) * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+void main() {
+    if (texture(depthMap, screenUV(uv)).r == 1.0) {
+        result = vec2(1.0, farDepth);
+        return;
+    }
+
+    vec3 position = viewPosition(uv);
+    vec3 normal = normalize(mat3(view) * decodeNormal(texture(normalMap, screenUV(uv)).rg));
+
+    // Orient the kernel around the normal with a per-pixel random rotation
+    vec3 random = vec3(texture(noiseMap, uv * noiseScale).xy, 0.0);
+    vec3 tangent = normalize(random - normal * dot(random, normal));
+    mat3 tbn = mat3(tangent, cross(normal, tangent), normal);
+
+    float occlusion = 0.0;
+    for (int i = 0; i < kernelSize; ++i) {
+        vec3 samplePosition = position + tbn * kernel[i] * radius;
+
+        vec4 offset = projection * vec4(samplePosition, 1.0);
+        vec2 sampleUV = offset.xy / offset.w * 0.5 + 0.5;
+        float sceneDepth = viewPosition(sampleUV).z;
+
+        // Ignore occluders far outside the kernel, they are a different object
+        float rangeCheck = smoothstep(0.0, 1.0, radius / abs(position.z - sceneDepth));
+        occlusion += (sceneDepth >= samplePosition.z + bias ? 1.0 : 0.0) * rangeCheck;
+    }
+
+    result = vec2(1.0 - occlusion / float(kernelSize), -position.z);
+}
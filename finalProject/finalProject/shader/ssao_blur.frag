@@ -0,0 +1,39 @@
+#version 330 core
+
+in vec2 uv;
+
+out vec2 result;
+
+uniform sampler2D aoMap;        // r = visibility, g = linear depth
+uniform vec2 direction;         // Blur axis, in texels
+uniform vec4 aoRegion;          // xy = rendered size of the AO buffer, zw = 1 / its allocated size
+uniform int blurRadius;
+
+// Relative depth difference at which a neighbour stops contributing
+const float depthTolerance = 0.05;
+
+// Texel of the rendered region, clamped to it
+vec2 fetchAO(vec2 texel) {
+    return texture(aoMap, clamp(texel, vec2(0.5), aoRegion.xy - 0.5) * aoRegion.zw).rg;
+}
+
+void main() {
+    vec2 texel = uv * aoRegion.xy;
+    vec2 center = fetchAO(texel);
+    float sum = center.r;
+    float weightSum = 1.0;
+
+    float sigma = float(blurRadius) * 0.5 + 0.5;
+    for (int i = -blurRadius; i <= blurRadius; ++i) {
+        if (i == 0) continue;
+        vec2 neighbour = fetchAO(texel + direction * float(i));
+
+        // Gaussian falloff, cut across depth discontinuities so AO does not bleed between objects
+        float spatial = exp(-float(i * i) / (2.0 * sigma * sigma));
+        float range = max(0.0, 1.0 - abs(neighbour.g - center.g) / (depthTolerance * center.g));
+        sum += neighbour.r * spatial * range;
+        weightSum += spatial * range;
+    }
+
+    result = vec2(sum / weightSum, center.g);
+}
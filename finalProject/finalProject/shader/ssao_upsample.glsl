@@ -0,0 +1,27 @@
+// Depth-aware upsampling of the ambient occlusion buffer (see ssao.frag).
+// The four nearest low resolution texels are weighted bilinearly and by how
+// close their depth is to the full resolution depth.
+uniform sampler2D aoMap;
+uniform vec2 aoSize;
+uniform bool aoEnabled;
+
+float upsampleAO(vec2 coord, float linearDepth) {
+    if (!aoEnabled) return 1.0;
+
+    vec2 position = coord * aoSize - 0.5;
+    vec2 base = floor(position);
+    vec2 f = position - base;
+    ivec2 maxTexel = ivec2(aoSize) - 1;
+
+    float sum = 0.0;
+    float weightSum = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        vec2 texel = texelFetch(aoMap, clamp(ivec2(base) + offset, ivec2(0), maxTexel), 0).rg;
+        float bilinear = (offset.x == 1 ? f.x : 1.0 - f.x) * (offset.y == 1 ? f.y : 1.0 - f.y);
+        float depthWeight = 1.0 / (1.0e-3 + abs(texel.g - linearDepth) / linearDepth);
+        sum += texel.r * bilinear * depthWeight;
+        weightSum += bilinear * depthWeight;
+    }
+    return weightSum > 0.0 ? sum / weightSum : 1.0;
+}